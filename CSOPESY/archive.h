@@ -0,0 +1,113 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// One archived process as screen -ls showed it, kept only for the most recent ones.
+struct ArchivedProcess {
+	string name;
+	string listing;
+};
+
+// Finished processes taken out of the console's process list (archive-finished on). Each one
+// leaves only its contribution to the totals and histograms below, so millions of finished
+// processes cost a few kilobytes; the last RECENT_LIMIT keep their screen -ls line.
+class ProcessArchive {
+private:
+	mutable mutex archiveMutex;
+	ll archived = 0;
+	ll instructions = 0;
+	ll turnaroundSumUs = 0;
+	ll responseSumUs = 0;
+	ll responded = 0;
+	LatencyHistogram turnaroundUs;
+	LatencyHistogram responseUs;
+	deque<ArchivedProcess> recent;
+
+public:
+	static const size_t RECENT_LIMIT = 1000;
+
+	void add(Screen& screen) {
+		ll turnaround = screen.finishedAt > 0 ? (screen.finishedAt - screen.createdAt) / 1000 : 0;
+		ll response = screen.firstRunAt > 0 ? (screen.firstRunAt - screen.createdAt) / 1000 : -1;
+		ArchivedProcess entry{ screen.getProcessName(), screen.listProcess() };
+		lock_guard<mutex> lock(archiveMutex);
+		archived++;
+		instructions += screen.getTotalLine();
+		turnaroundSumUs += turnaround;
+		turnaroundUs.record(static_cast<ull>(max(turnaround, 0LL)));
+		if (response >= 0) {
+			responseSumUs += response;
+			responded++;
+			responseUs.record(static_cast<ull>(response));
+		}
+		recent.push_back(move(entry));
+		if (recent.size() > RECENT_LIMIT) {
+			recent.pop_front();
+		}
+	}
+
+	void clear() {
+		lock_guard<mutex> lock(archiveMutex);
+		archived = 0;
+		instructions = 0;
+		turnaroundSumUs = 0;
+		responseSumUs = 0;
+		responded = 0;
+		turnaroundUs.reset();
+		responseUs.reset();
+		recent.clear();
+	}
+
+	ll size() const {
+		lock_guard<mutex> lock(archiveMutex);
+		return archived;
+	}
+
+	ll getInstructions() const {
+		lock_guard<mutex> lock(archiveMutex);
+		return instructions;
+	}
+
+	// Sums and counts let callers fold in processes that were not archived before taking means.
+	void totals(ll& turnaroundSum, ll& turnaroundCount, ll& responseSum, ll& responseCount) const {
+		lock_guard<mutex> lock(archiveMutex);
+		turnaroundSum = turnaroundSumUs;
+		turnaroundCount = archived;
+		responseSum = responseSumUs;
+		responseCount = responded;
+	}
+
+	void histograms(HistogramSnapshot& turnaround, HistogramSnapshot& response) const {
+		lock_guard<mutex> lock(archiveMutex);
+		turnaround.counts.assign(LatencyHistogram::BUCKETS, 0);
+		response.counts.assign(LatencyHistogram::BUCKETS, 0);
+		turnaroundUs.mergeInto(turnaround);
+		responseUs.mergeInto(response);
+	}
+
+	// Newest first, keeping those whose name contains filter.
+	vector<ArchivedProcess> recentMatching(const string& filter) const {
+		lock_guard<mutex> lock(archiveMutex);
+		vector<ArchivedProcess> matching;
+		for (auto it = recent.rbegin(); it != recent.rend(); ++it) {
+			if (filter.empty() || it->name.find(filter) != string::npos) {
+				matching.push_back(*it);
+			}
+		}
+		return matching;
+	}
+
+	string summary() const {
+		lock_guard<mutex> lock(archiveMutex);
+		HistogramSnapshot turnaround;
+		turnaround.counts.assign(LatencyHistogram::BUCKETS, 0);
+		turnaroundUs.mergeInto(turnaround);
+		ostringstream oss;
+		oss << "Archived processes: " << archived << ", instructions: " << instructions;
+		if (archived > 0) {
+			oss << ", turnaround (us): mean " << turnaroundSumUs / archived << ", p50 " << turnaround.percentile(50) << ", p99 " << turnaround.percentile(99);
+		}
+		return oss.str();
+	}
+};
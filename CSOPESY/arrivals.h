@@ -0,0 +1,315 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// The arrival-* keys of SchedulerConfig. rate is arrivals per 1000 ticks: "poisson" keeps it
+// constant, "bursty" arrives at it for onTicks and not at all for offTicks, "diurnal" swings it by
+// amplitude percent along a sine of periodTicks. "trace" replays tracePath instead.
+struct ArrivalSettings {
+	string process = "fixed";
+	ll rate = 1000;
+	ll onTicks = 100;
+	ll offTicks = 400;
+	ll periodTicks = 10000;
+	ll amplitude = 80;
+	string tracePath;
+	ll priorities = 1;
+	ll seed = 1;
+
+	bool operator==(const ArrivalSettings&) const = default;
+
+	static ArrivalSettings from(const SchedulerConfig& config) {
+		ArrivalSettings settings;
+		settings.process = config.arrivalProcess;
+		settings.rate = config.arrivalRate;
+		settings.onTicks = config.arrivalOnTicks;
+		settings.offTicks = config.arrivalOffTicks;
+		settings.periodTicks = config.arrivalPeriodTicks;
+		settings.amplitude = config.arrivalAmplitude;
+		settings.tracePath = config.arrivalTrace;
+		settings.priorities = config.arrivalPriorities;
+		settings.seed = config.arrivalSeed;
+		return settings;
+	}
+
+	void store(SchedulerConfig& config) const {
+		config.arrivalProcess = process;
+		config.arrivalRate = rate;
+		config.arrivalOnTicks = onTicks;
+		config.arrivalOffTicks = offTicks;
+		config.arrivalPeriodTicks = periodTicks;
+		config.arrivalAmplitude = amplitude;
+		config.arrivalTrace = tracePath;
+		config.arrivalPriorities = priorities;
+		config.arrivalSeed = seed;
+	}
+
+	string describe() const {
+		if (process == "fixed") {
+			return "fixed";
+		}
+		if (process == "trace") {
+			return "trace " + tracePath;
+		}
+		string text = process + " " + to_string(rate) + "/1000 ticks";
+		if (process == "bursty") {
+			text += ", on " + to_string(onTicks) + " off " + to_string(offTicks);
+		}
+		else if (process == "diurnal") {
+			text += ", +-" + to_string(amplitude) + "% over " + to_string(periodTicks);
+		}
+		return text + ", seed " + to_string(seed);
+	}
+};
+
+// One process to create. tick is when it is meant to arrive, in ticks since the generator started.
+struct Arrival {
+	double tick = 0;
+	ll instructions = 0;
+	ll memory = 0;
+	ll priority = 0;
+};
+
+// Produces arrivals in intended-time order. It is open-loop: what it emits depends only on the
+// settings, the seed and the clock, never on how far behind the scheduler is.
+class ArrivalGenerator {
+private:
+	ArrivalSettings settings;
+	mt19937_64 rng;
+	vector<Arrival> trace;
+	size_t traceNext = 0;
+	// Synthetic processes: time on the process's own clock (for bursty, time spent "on") and the
+	// next intended arrival it maps to.
+	double clock = 0;
+	double pending = 0;
+
+	double perTick() const {
+		return settings.rate / 1000.0;
+	}
+
+	double nextSynthetic() {
+		exponential_distribution<double> gap(settings.process == "diurnal" ? perTick() * (1 + settings.amplitude / 100.0) : perTick());
+		if (settings.process == "bursty") {
+			clock += gap(rng);
+			double cycles = floor(clock / settings.onTicks);
+			return cycles * (settings.onTicks + settings.offTicks) + (clock - cycles * settings.onTicks);
+		}
+		if (settings.process == "diurnal") {
+			// Thinning: candidates at the peak rate, each kept with probability rate(t) / peak.
+			uniform_real_distribution<double> keep(0, 1);
+			double peak = 1 + settings.amplitude / 100.0;
+			while (true) {
+				clock += gap(rng);
+				double level = 1 + settings.amplitude / 100.0 * sin(2 * numbers::pi * clock / settings.periodTicks);
+				if (keep(rng) * peak < level) {
+					return clock;
+				}
+			}
+		}
+		clock += gap(rng);
+		return clock;
+	}
+
+	// tick,instructions,memory[,priority] per line; a header line, blank lines and # comments are
+	// skipped. Rows need not be sorted.
+	bool loadTrace(ll maxMemory, string& error) {
+		ifstream file(settings.tracePath);
+		if (!file.is_open()) {
+			error = "could not open arrival trace " + settings.tracePath;
+			return false;
+		}
+		trace.clear();
+		// Rows are held to the same instruction limits as min-ins/max-ins in config files.
+		ll minInstructions = 1;
+		ll maxInstructions = CONFIG_INT_MAX;
+		for (const auto& field : configSchema()) {
+			if (string_view(field.key) == "min-ins") {
+				minInstructions = field.minValue;
+				maxInstructions = field.maxValue;
+			}
+		}
+		string line;
+		int lineNumber = 0;
+		bool firstRow = true;
+		while (getline(file, line)) {
+			lineNumber++;
+			string_view text = trimConfigText(line);
+			if (text.empty() || text[0] == '#') {
+				continue;
+			}
+			string where = settings.tracePath + ":" + to_string(lineNumber);
+			vector<string> fields;
+			stringstream row{ string(text) };
+			string field;
+			while (getline(row, field, ',')) {
+				fields.push_back(string(trimConfigText(field)));
+			}
+			bool header = firstRow && !fields.empty() && !fields[0].empty() && isalpha(static_cast<unsigned char>(fields[0][0]));
+			firstRow = false;
+			if (header) {
+				continue;
+			}
+			if (fields.size() < 3 || fields.size() > 4) {
+				error = where + ": expected tick,instructions,memory[,priority]";
+				return false;
+			}
+			Arrival arrival;
+			try {
+				size_t used = 0;
+				arrival.tick = stod(fields[0], &used);
+				bool whole = used == fields[0].size();
+				arrival.instructions = stoll(fields[1], &used);
+				whole = whole && used == fields[1].size();
+				arrival.memory = stoll(fields[2], &used);
+				whole = whole && used == fields[2].size();
+				if (fields.size() == 4) {
+					arrival.priority = stoll(fields[3], &used);
+					whole = whole && used == fields[3].size();
+				}
+				if (!whole) {
+					throw invalid_argument(line);
+				}
+			}
+			catch (...) {
+				error = where + ": '" + string(text) + "' is not a row of numbers";
+				return false;
+			}
+			if (arrival.tick < 0 || arrival.instructions < minInstructions || arrival.instructions > maxInstructions || arrival.memory < 1 || arrival.memory > maxMemory) {
+				error = where + ": tick must be >= 0, instructions " + to_string(minInstructions) + ".." + to_string(maxInstructions) + " and memory 1.." + to_string(maxMemory);
+				return false;
+			}
+			trace.push_back(arrival);
+		}
+		stable_sort(trace.begin(), trace.end(), [](const Arrival& a, const Arrival& b) { return a.tick < b.tick; });
+		return true;
+	}
+
+public:
+	// maxMemory bounds the memory of traced processes, which must fit in max-overall-mem.
+	bool start(const ArrivalSettings& next, ll maxMemory, string& error) {
+		settings = next;
+		rng.seed(static_cast<ull>(settings.seed));
+		traceNext = 0;
+		clock = 0;
+		if (settings.process == "trace") {
+			return loadTrace(maxMemory, error);
+		}
+		pending = nextSynthetic();
+		return true;
+	}
+
+	// Appends every arrival meant to arrive by tick. Synthetic arrivals draw instructions and
+	// memory uniformly from the given ranges, as scheduler-test's fixed batches do.
+	void due(double tick, ll minIns, ll maxIns, ll minMem, ll maxMem, vector<Arrival>& out) {
+		if (settings.process == "trace") {
+			while (traceNext < trace.size() && trace[traceNext].tick <= tick) {
+				out.push_back(trace[traceNext++]);
+			}
+			return;
+		}
+		uniform_int_distribution<ll> instructions(minIns, maxIns);
+		uniform_int_distribution<ll> memory(minMem, maxMem);
+		uniform_int_distribution<ll> priority(0, settings.priorities - 1);
+		while (pending <= tick) {
+			Arrival arrival;
+			arrival.tick = pending;
+			arrival.instructions = instructions(rng);
+			arrival.memory = memory(rng);
+			arrival.priority = priority(rng);
+			out.push_back(arrival);
+			pending = nextSynthetic();
+		}
+	}
+
+	// True once a trace has been replayed to the end; synthetic processes never run out.
+	bool exhausted() const {
+		return settings.process == "trace" && traceNext >= trace.size();
+	}
+
+	size_t getTraceSize() const { return trace.size(); }
+};
+
+// How late arrivals reached the ready queue: the tick each was queued on minus the tick it was
+// meant for. Waiting for the next whole tick costs up to one tick by itself; an arrival queued
+// after that tick is counted as late, which means scheduler-test fell behind the clock.
+class ArrivalLog {
+private:
+	mutable mutex logMutex;
+	ll arrivals = 0;
+	ll batches = 0;
+	ll late = 0;
+	double lagSum = 0;
+	double maxLag = 0;
+	// In thousandths of a tick.
+	LatencyHistogram lagMilliTicks;
+
+public:
+	void record(const vector<Arrival>& batch, ll queuedTick) {
+		lock_guard<mutex> lock(logMutex);
+		batches++;
+		for (const auto& arrival : batch) {
+			double lag = max(0.0, queuedTick - arrival.tick);
+			arrivals++;
+			lagSum += lag;
+			maxLag = max(maxLag, lag);
+			lagMilliTicks.record(static_cast<ull>(lag * 1000));
+			if (queuedTick > ceil(arrival.tick)) {
+				late++;
+			}
+		}
+	}
+
+	void clear() {
+		lock_guard<mutex> lock(logMutex);
+		arrivals = 0;
+		batches = 0;
+		late = 0;
+		lagSum = 0;
+		maxLag = 0;
+		lagMilliTicks.reset();
+	}
+
+	ll getArrivals() const {
+		lock_guard<mutex> lock(logMutex);
+		return arrivals;
+	}
+
+	ll getLate() const {
+		lock_guard<mutex> lock(logMutex);
+		return late;
+	}
+
+	double getMeanLag() const {
+		lock_guard<mutex> lock(logMutex);
+		return arrivals > 0 ? lagSum / arrivals : 0;
+	}
+
+	double getMaxLag() const {
+		lock_guard<mutex> lock(logMutex);
+		return maxLag;
+	}
+
+	double getLagPercentile(double p) const {
+		lock_guard<mutex> lock(logMutex);
+		HistogramSnapshot snapshot;
+		snapshot.counts.assign(LatencyHistogram::BUCKETS, 0);
+		lagMilliTicks.mergeInto(snapshot);
+		return snapshot.percentile(p) / 1000.0;
+	}
+
+	string summary() const {
+		ostringstream oss;
+		oss << fixed << setprecision(2);
+		ll count;
+		ll batchCount;
+		{
+			lock_guard<mutex> lock(logMutex);
+			count = arrivals;
+			batchCount = batches;
+		}
+		oss << "Arrivals: " << count << " in " << batchCount << " batches, lag (ticks): mean " << getMeanLag() << ", p99 " << getLagPercentile(99)
+			<< ", max " << getMaxLag() << ", late " << getLate();
+		return oss.str();
+	}
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// Minimal Google-Benchmark style harness: benchmarks loop over `for (auto _ : state)`,
+// the runner grows the iteration count until a run lasts at least minTimeMs, and results
+// are written in Google Benchmark's JSON layout so its compare.py works on them.
+
+class BenchState {
+private:
+	ll maxIterations;
+	ll startedAt = 0;
+	ll startedCpuAt = 0;
+	ll elapsedNs = 0;
+	ll elapsedCpuNs = 0;
+	bool timing = false;
+
+	static ll cpuNow() {
+		return static_cast<ll>(clock()) * (1000000000LL / CLOCKS_PER_SEC);
+	}
+
+public:
+	ll itemsProcessed = 0;
+	map<string, double> counters;
+	string error;
+
+	BenchState(ll iterations) : maxIterations(iterations) {}
+
+	struct Iterator {
+		BenchState* state;
+		ll remaining;
+
+		bool operator!=(const Iterator&) {
+			if (remaining > 0) {
+				remaining--;
+				return true;
+			}
+			state->pauseTiming();
+			return false;
+		}
+		void operator++() {}
+		int operator*() const {
+			return 0;
+		}
+	};
+
+	Iterator begin() {
+		resumeTiming();
+		return { this, maxIterations };
+	}
+
+	Iterator end() {
+		return { this, 0 };
+	}
+
+	void pauseTiming() {
+		if (timing) {
+			elapsedNs += nowNs() - startedAt;
+			elapsedCpuNs += cpuNow() - startedCpuAt;
+			timing = false;
+		}
+	}
+
+	void resumeTiming() {
+		if (!timing) {
+			startedAt = nowNs();
+			startedCpuAt = cpuNow();
+			timing = true;
+		}
+	}
+
+	void skipWithError(const string& message) {
+		error = message;
+	}
+
+	ll iterations() const {
+		return maxIterations;
+	}
+
+	ll getElapsedNs() const {
+		return elapsedNs;
+	}
+
+	ll getElapsedCpuNs() const {
+		return elapsedCpuNs;
+	}
+};
+
+struct BenchResult {
+	string name;
+	ll iterations;
+	double realTimeNs;
+	double cpuTimeNs;
+	double itemsPerSecond;
+	map<string, double> counters;
+	string error;
+};
+
+struct BenchCase {
+	string name;
+	function<void(BenchState&)> run;
+	// 0 lets the runner pick; end-to-end runs pin this to 1.
+	ll fixedIterations;
+};
+
+class BenchRunner {
+private:
+	vector<BenchCase> cases;
+	vector<BenchResult> results;
+	double minTimeMs = 200;
+
+public:
+	void setMinTimeMs(double ms) {
+		minTimeMs = ms;
+	}
+
+	void add(const string& name, function<void(BenchState&)> run, ll fixedIterations = 0) {
+		cases.push_back({ name, run, fixedIterations });
+	}
+
+	void runAll(const string& filter) {
+		for (auto& benchCase : cases) {
+			if (!filter.empty() && benchCase.name.find(filter) == string::npos) {
+				continue;
+			}
+			ll iterations = benchCase.fixedIterations > 0 ? benchCase.fixedIterations : 1;
+			while (true) {
+				BenchState state(iterations);
+				benchCase.run(state);
+				double elapsedMs = state.getElapsedNs() / 1e6;
+				bool done = benchCase.fixedIterations > 0 || !state.error.empty() || elapsedMs >= minTimeMs || iterations >= 1000000000LL;
+				if (done) {
+					BenchResult result;
+					result.name = benchCase.name;
+					result.iterations = iterations;
+					result.realTimeNs = static_cast<double>(state.getElapsedNs()) / iterations;
+					result.cpuTimeNs = static_cast<double>(state.getElapsedCpuNs()) / iterations;
+					result.itemsPerSecond = state.getElapsedNs() > 0 ? state.itemsProcessed * 1e9 / state.getElapsedNs() : 0;
+					result.counters = state.counters;
+					result.error = state.error;
+					report(result);
+					results.push_back(result);
+					break;
+				}
+				double scale = elapsedMs > 0 ? minTimeMs * 1.4 / elapsedMs : 10;
+				iterations = static_cast<ll>(iterations * clamp(scale, 2.0, 10.0));
+			}
+		}
+	}
+
+	void report(const BenchResult& result) {
+		cout << left << setw(44) << result.name;
+		if (!result.error.empty()) {
+			cout << "ERROR: " << result.error << endl;
+			return;
+		}
+		cout << right << fixed << setprecision(0) << setw(14) << result.realTimeNs << " ns" << setw(14) << result.cpuTimeNs << " ns" << setw(12) << result.iterations;
+		if (result.itemsPerSecond > 0) {
+			cout << setprecision(1) << "  items/s=" << result.itemsPerSecond;
+		}
+		for (auto& [key, value] : result.counters) {
+			cout << setprecision(2) << " " << key << "=" << value;
+		}
+		cout << endl;
+	}
+
+	bool writeJson(const string& path, const string& label) {
+		ofstream out(path);
+		if (!out.is_open()) {
+			return false;
+		}
+		time_t now = time(nullptr);
+		char date[32];
+		strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", gmtime(&now));
+		out << "{\n  \"context\": {\n";
+		out << "    \"date\": \"" << date << "\",\n";
+		out << "    \"label\": \"" << label << "\",\n";
+		out << "    \"num_cpus\": " << thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+		out << "    \"library_build_type\": \"release\"\n";
+#else
+		out << "    \"library_build_type\": \"debug\"\n";
+#endif
+		out << "  },\n  \"benchmarks\": [";
+		bool first = true;
+		for (auto& result : results) {
+			out << (first ? "\n" : ",\n");
+			first = false;
+			out << "    {\"name\": \"" << result.name << "\", \"run_name\": \"" << result.name << "\", \"run_type\": \"iteration\"";
+			out << ", \"iterations\": " << result.iterations;
+			out << fixed << setprecision(3) << ", \"real_time\": " << result.realTimeNs << ", \"cpu_time\": " << result.cpuTimeNs << ", \"time_unit\": \"ns\"";
+			if (result.itemsPerSecond > 0) {
+				out << ", \"items_per_second\": " << result.itemsPerSecond;
+			}
+			for (auto& [key, value] : result.counters) {
+				out << ", \"" << key << "\": " << value;
+			}
+			if (!result.error.empty()) {
+				out << ", \"error_occurred\": true, \"error_message\": \"" << result.error << "\"";
+			}
+			out << "}";
+		}
+		out << "\n  ]\n}\n";
+		return true;
+	}
+};
@@ -0,0 +1,868 @@
+#include "platform.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <set>
+#include <sstream>
+#include <ctime>
+#include <cstdio>
+#include <mutex>
+#include <map>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <queue>
+#include <memory>
+#include <filesystem>
+#include <chrono>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <charconv>
+#include <string_view>
+#include <unordered_map>
+#include <tuple>
+#include <condition_variable>
+#include <coroutine>
+#include <random>
+#include <numbers>
+#include <limits>
+#include "stats.h"
+#include "metrics.h"
+#include "screen.h"
+#include "pool.h"
+#include "trace.h"
+#include "workerpool.h"
+#include "proclog.h"
+#include "config.h"
+#include "physmem.h"
+#include "bitmap.h"
+#include "checkpoint.h"
+#include "arrivals.h"
+#include "scheduler.h"
+#include "archive.h"
+#include "sweep.h"
+#include "bench/bench.h"
+
+#ifndef CSOPESY_BENCH_PRESETS
+#define CSOPESY_BENCH_PRESETS "presets"
+#endif
+#ifndef CSOPESY_GIT_COMMIT
+#define CSOPESY_GIT_COMMIT "unknown"
+#endif
+
+using namespace std;
+typedef long long ll;
+
+volatile ll mainCtr = 0;
+
+// Every global operator new in the benchmark binary, so a benchmark can report heap allocations per item.
+// All the plain, array, sized and aligned forms go through allocateBlock/releaseBlock; the nothrow
+// forms in the standard library call these. The helpers are kept out of line so the compiler
+// never sees free() applied to the result of a new-expression.
+atomic<ll> heapAllocations = 0;
+
+[[gnu::noinline]] void* allocateBlock(size_t size, size_t alignment) {
+	heapAllocations.fetch_add(1, memory_order_relaxed);
+	size = size == 0 ? 1 : size;
+	void* block;
+#ifdef _WIN32
+	block = alignment > alignof(max_align_t) ? _aligned_malloc(size, alignment) : malloc(size);
+#else
+	block = alignment > alignof(max_align_t) ? aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : malloc(size);
+#endif
+	if (block == nullptr) {
+		throw bad_alloc();
+	}
+	return block;
+}
+
+[[gnu::noinline]] void releaseBlock(void* block, size_t alignment) noexcept {
+#ifdef _WIN32
+	if (alignment > alignof(max_align_t)) {
+		_aligned_free(block);
+		return;
+	}
+#endif
+	(void)alignment;
+	free(block);
+}
+
+void* operator new(size_t size) {
+	return allocateBlock(size, alignof(max_align_t));
+}
+
+void* operator new[](size_t size) {
+	return allocateBlock(size, alignof(max_align_t));
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+	return allocateBlock(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+	return allocateBlock(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* block) noexcept {
+	releaseBlock(block, alignof(max_align_t));
+}
+
+void operator delete[](void* block) noexcept {
+	releaseBlock(block, alignof(max_align_t));
+}
+
+void operator delete(void* block, size_t) noexcept {
+	releaseBlock(block, alignof(max_align_t));
+}
+
+void operator delete[](void* block, size_t) noexcept {
+	releaseBlock(block, alignof(max_align_t));
+}
+
+void operator delete(void* block, align_val_t alignment) noexcept {
+	releaseBlock(block, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* block, align_val_t alignment) noexcept {
+	releaseBlock(block, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* block, size_t, align_val_t alignment) noexcept {
+	releaseBlock(block, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* block, size_t, align_val_t alignment) noexcept {
+	releaseBlock(block, static_cast<size_t>(alignment));
+}
+
+// A preset is an ordinary config.txt; keys starting with "bench-" are read here and skipped by the config parser.
+// makeScheduler is only called for presets that already loaded cleanly in main.
+struct Preset {
+	string name;
+	string path;
+	ll processes = 32;
+	ll timeoutMs = 120000;
+};
+
+Preset loadPreset(const filesystem::path& path) {
+	Preset preset;
+	preset.name = path.stem().string();
+	preset.path = path.string();
+	ifstream file(path);
+	string line;
+	while (getline(file, line)) {
+		istringstream iss(line);
+		string key;
+		string value;
+		iss >> key >> value;
+		if (key == "bench-processes") {
+			preset.processes = stoll(value);
+		}
+		else if (key == "bench-timeout-ms") {
+			preset.timeoutMs = stoll(value);
+		}
+	}
+	return preset;
+}
+
+unique_ptr<Scheduler> makeScheduler(const Preset& preset) {
+	auto scheduler = make_unique<Scheduler>();
+	vector<string> messages;
+	scheduler->loadConfig(preset.path, messages);
+	scheduler->createBackingStore();
+	return scheduler;
+}
+
+// prefix followed by the numbers, e.g. benchName("p", 3, 7) is "p3_7". Appending rather than
+// writing "p" + to_string(...) keeps GCC 12 from a false -Wrestrict warning on the inlined insert.
+template <class... Numbers>
+string benchName(const char* prefix, Numbers... numbers) {
+	string name = prefix;
+	bool first = true;
+	((name += first ? "" : "_", name += to_string(numbers), first = false), ...);
+	return name;
+}
+
+shared_ptr<Screen> makeProcess(Scheduler& scheduler, ll index) {
+	return makeScreen(benchName("p", index), scheduler.getMinIns(), scheduler.getMaxIns(), scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc());
+}
+
+void benchReadyQueue(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	for (int i = 0; i < 1024; i++) {
+		scheduler->pushQueue(makeProcess(*scheduler, i));
+	}
+	ll allocationsBefore = heapAllocations;
+	for ([[maybe_unused]] auto _ : state) {
+		lock_guard<StatMutex> lock(scheduler->queueMutex);
+		shared_ptr<Screen> screen = scheduler->popQueue();
+		scheduler->pushQueue(screen);
+	}
+	state.itemsProcessed = state.iterations();
+	state.counters["allocs_per_item"] = static_cast<double>(heapAllocations - allocationsBefore) / state.iterations();
+}
+
+void benchFrameAllocFree(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	auto screen = makeProcess(*scheduler, 0);
+	ll frames = scheduler->frameCountFor(screen->memory);
+	if (!scheduler->allocateMemoryPagingFCFS(screen)) {
+		state.skipWithError("process does not fit in memory");
+		return;
+	}
+	scheduler->releaseMemory(screen);
+	ll allocationsBefore = heapAllocations;
+	for ([[maybe_unused]] auto _ : state) {
+		scheduler->allocateMemoryPagingFCFS(screen);
+		scheduler->releaseMemory(screen);
+		screen->memoryAllocated = false;
+	}
+	state.itemsProcessed = state.iterations() * frames;
+	state.counters["allocs_per_alloc"] = static_cast<double>(heapAllocations - allocationsBefore) / state.iterations();
+	state.counters["frames_per_alloc"] = static_cast<double>(frames);
+	state.counters["internal_fragmentation_bytes"] = static_cast<double>(scheduler->frameBytesFor(screen->memory) - screen->memory);
+}
+
+void benchFlatFirstFit(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	auto screen = makeProcess(*scheduler, 0);
+	if (!scheduler->allocateMemoryFlatFCFS(screen)) {
+		state.skipWithError("process does not fit in memory");
+		return;
+	}
+	scheduler->releaseMemory(screen);
+	for ([[maybe_unused]] auto _ : state) {
+		scheduler->allocateMemoryFlatFCFS(screen);
+		scheduler->releaseMemory(screen);
+		screen->memoryAllocated = false;
+	}
+	state.itemsProcessed = state.iterations() * screen->memory;
+	state.counters["units_per_alloc"] = static_cast<double>(screen->memory);
+}
+
+// Fills flat memory with small blocks, frees every other one, and times one full compaction pass.
+void benchFlatCompaction(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	ll blockBytes = max(1LL, scheduler->getMinMemPerProc() / 4);
+	ll blocks = scheduler->getMaxMem() / blockBytes;
+	if (blocks < 4) {
+		state.skipWithError("memory too small to fragment");
+		return;
+	}
+	vector<shared_ptr<Screen>> pool;
+	for (ll i = 0; i < blocks; i++) {
+		auto screen = makeProcess(*scheduler, i);
+		screen->memory = static_cast<int>(blockBytes);
+		pool.push_back(screen);
+	}
+	ll bytesBefore = scheduler->getCompactionBytes();
+	for ([[maybe_unused]] auto _ : state) {
+		state.pauseTiming();
+		for (ll i = 0; i < blocks; i++) {
+			scheduler->allocateMemoryFlatFCFS(pool[i]);
+		}
+		for (ll i = 0; i < blocks; i += 2) {
+			scheduler->releaseMemory(pool[i]);
+		}
+		state.resumeTiming();
+		ll credit = scheduler->getMaxMem();
+		scheduler->compactStep(credit);
+		state.pauseTiming();
+		for (ll i = 1; i < blocks; i += 2) {
+			scheduler->releaseMemory(pool[i]);
+		}
+		state.resumeTiming();
+	}
+	state.itemsProcessed = state.iterations();
+	state.counters["bytes_moved_per_pass"] = static_cast<double>(scheduler->getCompactionBytes() - bytesBefore) / state.iterations();
+	state.counters["blocks"] = static_cast<double>(blocks);
+}
+
+// Forks a resident process, has the child write its program counter and a stack slot as after an
+// instruction (copying the frames it writes) and frees it again.
+void benchForkFault(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	auto parent = makeProcess(*scheduler, 0);
+	if (!scheduler->allocateMemoryPagingFCFS(parent)) {
+		state.skipWithError("process does not fit in memory");
+		return;
+	}
+	ll faultsBefore = scheduler->getCowFaults();
+	ll copiedBefore = scheduler->getCowBytesCopied();
+	ll index = 1;
+	for ([[maybe_unused]] auto _ : state) {
+		auto child = makeScreen(parent->forkState(benchName("f", index++)));
+		scheduler->forkMemory(parent, child);
+		scheduler->touchMemory(child);
+		scheduler->releaseMemory(child);
+	}
+	state.itemsProcessed = state.iterations();
+	state.counters["faults_per_fork"] = static_cast<double>(scheduler->getCowFaults() - faultsBefore) / state.iterations();
+	state.counters["copied_bytes_per_fork"] = static_cast<double>(scheduler->getCowBytesCopied() - copiedBefore) / state.iterations();
+	state.counters["process_bytes"] = static_cast<double>(parent->allocatedMemory);
+}
+
+// Keeps memory full with one more process than fits, so every allocation has to evict the oldest resident.
+void benchEvictionLoop(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	ll procBytes = scheduler->frameBytesFor(scheduler->getMaxMemPerProc());
+	ll resident = max(1LL, scheduler->getMaxMem() / procBytes);
+	vector<shared_ptr<Screen>> pool;
+	for (ll i = 0; i <= resident; i++) {
+		auto screen = makeProcess(*scheduler, i);
+		screen->memory = static_cast<int>(scheduler->getMaxMemPerProc());
+		if (!scheduler->allocateMemoryPagingWithInterupt(screen)) {
+			state.skipWithError("could not fill memory");
+			return;
+		}
+		pool.push_back(screen);
+	}
+	ll pagesOutBefore = scheduler->getPagesOut();
+	ll swappedBefore = scheduler->getBytesSwappedOut() + scheduler->getBytesSwappedIn();
+	size_t next = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		scheduler->allocateMemoryPagingWithInterupt(pool[next]);
+		next = (next + 1) % pool.size();
+	}
+	state.itemsProcessed = state.iterations();
+	state.counters["pages_out_per_alloc"] = static_cast<double>(scheduler->getPagesOut() - pagesOutBefore) / state.iterations();
+	state.counters["swap_bytes_per_alloc"] = static_cast<double>(scheduler->getBytesSwappedOut() + scheduler->getBytesSwappedIn() - swappedBefore) / state.iterations();
+	state.counters["resident_processes"] = static_cast<double>(resident);
+}
+
+void benchBackingStore(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	for (int i = 0; i < 256; i++) {
+		scheduler->putInBackingStore(makeProcess(*scheduler, i));
+	}
+	auto screen = makeProcess(*scheduler, 1000000);
+	for ([[maybe_unused]] auto _ : state) {
+		scheduler->putInBackingStore(screen);
+		scheduler->removeFromBackingStore(screen->getProcessName());
+	}
+	state.itemsProcessed = state.iterations() * 2;
+	state.counters["resident_entries"] = 256;
+}
+
+// 10k queued processes; capture is the part that holds the scheduler locks, encode runs on the writer thread.
+void benchCheckpointCapture(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	vector<shared_ptr<Screen>> registry;
+	for (int i = 0; i < 10000; i++) {
+		registry.push_back(makeProcess(*scheduler, i));
+		scheduler->pushQueue(registry.back());
+	}
+	for ([[maybe_unused]] auto _ : state) {
+		SchedulerCheckpoint checkpoint = scheduler->captureCheckpoint(registry);
+	}
+	state.itemsProcessed = state.iterations() * registry.size();
+	state.counters["processes"] = static_cast<double>(registry.size());
+}
+
+void benchCheckpointEncode(BenchState& state, const Preset& preset) {
+	auto scheduler = makeScheduler(preset);
+	vector<shared_ptr<Screen>> registry;
+	for (int i = 0; i < 10000; i++) {
+		registry.push_back(makeProcess(*scheduler, i));
+		scheduler->pushQueue(registry.back());
+	}
+	SchedulerCheckpoint checkpoint = scheduler->captureCheckpoint(registry);
+	size_t bytes = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		string data = encodeCheckpoint(checkpoint);
+		SchedulerCheckpoint decoded;
+		string error;
+		decodeCheckpoint(data, decoded, error);
+		bytes = data.size();
+	}
+	state.itemsProcessed = state.iterations() * registry.size();
+	state.counters["bytes"] = static_cast<double>(bytes);
+}
+
+// A started scheduler with nothing to run, left alone for IDLE_MS. Whatever CPU time the process
+// burns meanwhile is the cost of idle cores; busy_cores is that time in cores' worth.
+void benchIdleBurn(BenchState& state, const Preset& preset) {
+	const int IDLE_MS = 100;
+	int cores = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		state.pauseTiming();
+		auto scheduler = makeScheduler(preset);
+		cores = scheduler->getNumCpu();
+		state.resumeTiming();
+
+		scheduler->start();
+		this_thread::sleep_for(chrono::milliseconds(IDLE_MS));
+		scheduler->stop();
+	}
+	state.counters["cores"] = cores;
+	state.counters["busy_cores"] = state.getElapsedNs() > 0 ? static_cast<double>(state.getElapsedCpuNs()) / state.getElapsedNs() : 0;
+}
+
+void benchEndToEnd(BenchState& state, const Preset& preset) {
+	ll processes = preset.processes;
+	int cores = 0;
+	ll numaNodes = 1;
+	ll remoteDispatches = 0;
+	ll remoteStallTicks = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		state.pauseTiming();
+		auto scheduler = makeScheduler(preset);
+		cores = scheduler->getNumCpu();
+		numaNodes = scheduler->getNumaNodes();
+		for (ll i = 0; i < processes; i++) {
+			lock_guard<StatMutex> lock(scheduler->queueMutex);
+			scheduler->pushQueue(makeProcess(*scheduler, i));
+		}
+		ll deadline = nowNs() + preset.timeoutMs * 1000000LL;
+		state.resumeTiming();
+
+		scheduler->start();
+		while (scheduler->getFinishedProcesses() < processes && nowNs() < deadline) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+
+		state.pauseTiming();
+		if (scheduler->getFinishedProcesses() < processes) {
+			state.skipWithError("timed out with " + to_string(scheduler->getFinishedProcesses()) + " of " + to_string(processes) + " processes finished");
+		}
+		scheduler->stop();
+		remoteDispatches += scheduler->getRemoteDispatches();
+		remoteStallTicks += scheduler->getRemoteStallTicks();
+		state.resumeTiming();
+	}
+	state.itemsProcessed = state.iterations() * processes;
+	state.counters["processes"] = static_cast<double>(processes);
+	state.counters["cores"] = cores;
+	if (numaNodes > 1) {
+		state.counters["remote_dispatches_per_run"] = static_cast<double>(remoteDispatches) / state.iterations();
+		state.counters["remote_stall_ticks_per_run"] = static_cast<double>(remoteStallTicks) / state.iterations();
+	}
+}
+
+// Flat memory as the allocator sees it late in a run: everything in use except a 32-unit hole every
+// 4096 units, too small for the request, and one run of FIRST_FIT_UNITS at the very end. So a
+// first-fit search has to cross the whole map.
+const ll FIRST_FIT_UNITS = 1024;
+
+void fragmentBitmap(OccupancyBitmap& bitmap, ll units) {
+	bitmap.reset(units);
+	bitmap.setRange(0, units - 1);
+	for (ll start = 4096; start + 32 < units - FIRST_FIT_UNITS; start += 4096) {
+		bitmap.clearRange(start, start + 31);
+	}
+	bitmap.clearRange(units - FIRST_FIT_UNITS, units - 1);
+}
+
+// The same map as vector<bool> with true = free, scanned unit by unit as flat memory used to be.
+vector<bool> fragmentVectorBool(ll units) {
+	vector<bool> freeUnits(units, false);
+	for (ll start = 4096; start + 32 < units - FIRST_FIT_UNITS; start += 4096) {
+		fill(freeUnits.begin() + start, freeUnits.begin() + start + 32, true);
+	}
+	fill(freeUnits.end() - FIRST_FIT_UNITS, freeUnits.end(), true);
+	return freeUnits;
+}
+
+enum BitmapOp { BITMAP_COUNT, BITMAP_FIRST_FIT, BITMAP_LARGEST_RUN, BITMAP_RANGE };
+
+const char* bitmapOpName(BitmapOp op) {
+	switch (op) {
+	case BITMAP_COUNT: return "BM_BitmapCountUsed";
+	case BITMAP_FIRST_FIT: return "BM_BitmapFirstFit";
+	case BITMAP_LARGEST_RUN: return "BM_BitmapLargestFreeRun";
+	case BITMAP_RANGE: return "BM_BitmapSetClearRange";
+	}
+	return "unknown";
+}
+
+void benchBitmap(BenchState& state, BitmapOp op, const BitmapKernels& kernels, ll units) {
+	OccupancyBitmap bitmap(kernels);
+	fragmentBitmap(bitmap, units);
+	ll expected = units - FIRST_FIT_UNITS;
+	ll result = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		switch (op) {
+		case BITMAP_COUNT: result = bitmap.countUsed(); break;
+		case BITMAP_FIRST_FIT: result = bitmap.findFreeRun(FIRST_FIT_UNITS); break;
+		case BITMAP_LARGEST_RUN: result = bitmap.longestFreeRun(); break;
+		case BITMAP_RANGE:
+			bitmap.clearRange(units / 4, units / 4 * 3 - 1);
+			bitmap.setRange(units / 4, units / 4 * 3 - 1);
+			break;
+		}
+	}
+	if (op == BITMAP_FIRST_FIT && result != expected) {
+		state.skipWithError("first fit found " + to_string(result) + " instead of " + to_string(expected));
+	}
+	if (op == BITMAP_LARGEST_RUN && result != FIRST_FIT_UNITS) {
+		state.skipWithError("largest free run " + to_string(result) + " instead of " + to_string(FIRST_FIT_UNITS));
+	}
+	state.itemsProcessed = state.iterations() * units;
+	state.counters["units"] = static_cast<double>(units);
+}
+
+void benchVectorBool(BenchState& state, BitmapOp op, ll units) {
+	vector<bool> freeUnits = fragmentVectorBool(units);
+	ll result = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		switch (op) {
+		case BITMAP_COUNT:
+			result = 0;
+			for (ll i = 0; i < units; i++) {
+				result += !freeUnits[i];
+			}
+			break;
+		case BITMAP_FIRST_FIT: {
+			ll run = 0;
+			result = -1;
+			for (ll i = 0; i < units; i++) {
+				run = freeUnits[i] ? run + 1 : 0;
+				if (run == FIRST_FIT_UNITS) {
+					result = i - run + 1;
+					break;
+				}
+			}
+			break;
+		}
+		case BITMAP_LARGEST_RUN: {
+			ll run = 0;
+			result = 0;
+			for (ll i = 0; i < units; i++) {
+				run = freeUnits[i] ? run + 1 : 0;
+				result = max(result, run);
+			}
+			break;
+		}
+		case BITMAP_RANGE:
+			for (ll i = units / 4; i < units / 4 * 3; i++) {
+				freeUnits[i] = true;
+			}
+			for (ll i = units / 4; i < units / 4 * 3; i++) {
+				freeUnits[i] = false;
+			}
+			break;
+		}
+	}
+	if (op == BITMAP_FIRST_FIT && result != units - FIRST_FIT_UNITS) {
+		state.skipWithError("first fit found " + to_string(result));
+	}
+	state.itemsProcessed = state.iterations() * units;
+	state.counters["units"] = static_cast<double>(units);
+}
+
+// Every core prints as fast as it can through the same path the run loops use; one iteration is
+// LINES_PER_THREAD lines per thread, and stop() at the end makes sure they all reached the disk.
+void benchProcessLog(BenchState& state, ProcessLogMode mode, int threads) {
+	const ll LINES_PER_THREAD = 100000;
+	const int PROCESSES_PER_THREAD = 8;
+	filesystem::path target = filesystem::temp_directory_path() / ("csopesy_bench_log_" + string(processLogModeName(mode)));
+	vector<vector<shared_ptr<Screen>>> screens(threads);
+	for (int t = 0; t < threads; t++) {
+		for (int i = 0; i < PROCESSES_PER_THREAD; i++) {
+			screens[t].push_back(makeScreen(benchName("p", t * PROCESSES_PER_THREAD + i), 1, 1));
+		}
+	}
+	ProcessLog& log = ProcessLog::instance();
+	ll bytes = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		state.pauseTiming();
+		error_code ec;
+		filesystem::remove_all(target, ec);
+		string error;
+		if (!log.start(mode, target.string(), error)) {
+			state.skipWithError(error);
+			return;
+		}
+		state.resumeTiming();
+
+		vector<thread> workers;
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([&screens, t, LINES_PER_THREAD, PROCESSES_PER_THREAD] {
+				Tracer::currentCore() = t;
+				for (ll i = 0; i < LINES_PER_THREAD; i++) {
+					logInstruction(screens[t][i % PROCESSES_PER_THREAD]);
+				}
+			});
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		log.stop();
+		bytes += log.getBytesWritten();
+	}
+	error_code ec;
+	filesystem::remove_all(target, ec);
+	state.itemsProcessed = state.iterations() * threads * LINES_PER_THREAD;
+	state.counters["threads"] = threads;
+	state.counters["bytes_per_line"] = static_cast<double>(bytes) / state.itemsProcessed;
+}
+
+// What scheduler-test does for every new process, minus the scheduler: create it, file it under its
+// name and queue it, then drop it again once finished. One iteration is PROCESSES_PER_THREAD processes
+// per thread; pooled uses makeScreen and pooled containers, heap the plain make_shared and std ones.
+const int CHURN_PROCESSES_PER_THREAD = 1000;
+
+template <class Registry, class Queue>
+void processChurn(int thread, bool pooled) {
+	Registry screenList;
+	Queue readyQueue;
+	for (int i = 0; i < CHURN_PROCESSES_PER_THREAD; i++) {
+		string name = benchName("p", thread, i);
+		auto screen = pooled ? makeScreen(name, 100, 200, 64, 64) : make_shared<Screen>(name, 100, 200, 64, 64);
+		screenList[name] = screen;
+		readyQueue.push_back(screen);
+	}
+	while (!readyQueue.empty()) {
+		screenList.erase(readyQueue.front()->getProcessName());
+		readyQueue.pop_front();
+	}
+}
+
+void benchProcessChurn(BenchState& state, bool pooled, int threads) {
+	ll allocations = 0;
+	for ([[maybe_unused]] auto _ : state) {
+		ll before = heapAllocations;
+		vector<thread> workers;
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([t, pooled] {
+				if (pooled) {
+					processChurn<PooledMap<string, shared_ptr<Screen>>, PooledDeque<shared_ptr<Screen>>>(t, true);
+				}
+				else {
+					processChurn<map<string, shared_ptr<Screen>>, deque<shared_ptr<Screen>>>(t, false);
+				}
+			});
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		allocations += heapAllocations - before;
+	}
+	state.itemsProcessed = state.iterations() * threads * CHURN_PROCESSES_PER_THREAD;
+	state.counters["threads"] = threads;
+	state.counters["allocs_per_item"] = static_cast<double>(allocations) / state.itemsProcessed;
+	if (pooled) {
+		state.counters["pool_slab_bytes"] = static_cast<double>(PoolArena::instance().getSlabBytes());
+	}
+}
+
+// What a core does to a process on every dispatch and instruction, over more processes than fit in
+// cache, so the time per item is mostly the cache lines each process drags in. Each thread has its
+// own processes, as each core runs its own at any moment.
+void benchScreenExecute(BenchState& state, int threads) {
+	const int PROCESSES_PER_THREAD = 1 << 16;
+	vector<vector<shared_ptr<Screen>>> screens(threads);
+	for (int t = 0; t < threads; t++) {
+		for (int i = 0; i < PROCESSES_PER_THREAD; i++) {
+			screens[t].push_back(makeScreen(benchName("p", t, i), 1000000, 1000000, 64, 64));
+		}
+	}
+	for ([[maybe_unused]] auto _ : state) {
+		vector<thread> workers;
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([&screens, t] {
+				for (const auto& screen : screens[t]) {
+					if (!screen->memoryAllocated) {
+						screen->allocatedMemory = screen->memory;
+					}
+					screen->setCoreId(t);
+					screen->enqueuedAt = screen->firstRunAt;
+					screen->execute();
+					if (screen->isFinished()) {
+						screen->dispatched = false;
+					}
+				}
+			});
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+	state.itemsProcessed = state.iterations() * threads * PROCESSES_PER_THREAD;
+	state.counters["threads"] = threads;
+	state.counters["screen_bytes"] = static_cast<double>(sizeof(Screen));
+}
+
+// The counter updates a core makes for one process: dispatch, a quantum of instructions, page in and
+// out, finish. per-core uses the scheduler's CoreStatsTable; shared bumps one set of counters from
+// every thread, as the scheduler's globals did. Per-thread throughput should stay flat as threads
+// are added when nothing is shared.
+void benchCoreCounters(BenchState& state, bool perCore, int threads) {
+	const ll PROCESSES_PER_THREAD = 1 << 18;
+	const int QUANTUM = 4;
+	CoreStatsTable table;
+	for ([[maybe_unused]] auto _ : state) {
+		vector<thread> workers;
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([&table, perCore, t, PROCESSES_PER_THREAD, QUANTUM] {
+				Tracer::currentCore() = t;
+				CoreStats& stats = perCore ? table[t] : table.shared();
+				for (ll i = 0; i < PROCESSES_PER_THREAD; i++) {
+					stats.used.store(1, memory_order_relaxed);
+					stats.running.store(true, memory_order_relaxed);
+					stats.dispatches.fetch_add(1, memory_order_relaxed);
+					stats.pagesIn.fetch_add(16, memory_order_relaxed);
+					for (int q = 0; q < QUANTUM && stats.running.load(memory_order_relaxed); q++) {
+					}
+					stats.finished.fetch_add(1, memory_order_relaxed);
+					stats.pagesOut.fetch_add(16, memory_order_relaxed);
+					stats.used.store(0, memory_order_relaxed);
+				}
+				Tracer::currentCore() = -1;
+			});
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+	if (table.sum(&CoreStats::finished) != state.iterations() * threads * PROCESSES_PER_THREAD) {
+		state.skipWithError("finished count does not add up");
+	}
+	state.itemsProcessed = state.iterations() * threads * PROCESSES_PER_THREAD;
+	state.counters["threads"] = threads;
+	state.counters["items_per_thread_per_s"] = state.getElapsedNs() > 0 ? PROCESSES_PER_THREAD * state.iterations() * 1e9 / state.getElapsedNs() : 0;
+}
+
+signed main(int argc, char* argv[]) {
+	string presetDir = CSOPESY_BENCH_PRESETS;
+	string outputFileName = "bench_results.json";
+	string filter;
+	string label = CSOPESY_GIT_COMMIT;
+	double minTimeMs = 200;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (i + 1 >= argc) {
+			cerr << "Missing value for " << arg << endl;
+			return 1;
+		}
+		if (arg == "--presets") {
+			presetDir = argv[++i];
+		}
+		else if (arg == "--out") {
+			outputFileName = argv[++i];
+		}
+		else if (arg == "--filter") {
+			filter = argv[++i];
+		}
+		else if (arg == "--label") {
+			label = argv[++i];
+		}
+		else if (arg == "--min-time-ms") {
+			minTimeMs = stod(argv[++i]);
+		}
+		else {
+			cerr << "Usage: csopesy_bench [--presets dir] [--out file.json] [--filter substring] [--label text] [--min-time-ms n]" << endl;
+			return 1;
+		}
+	}
+
+	vector<filesystem::path> presetFiles;
+	error_code ec;
+	for (auto& entry : filesystem::directory_iterator(presetDir, ec)) {
+		if (entry.path().extension() == ".txt") {
+			presetFiles.push_back(entry.path());
+		}
+	}
+	if (presetFiles.empty()) {
+		cerr << "No presets found in " << presetDir << endl;
+		return 1;
+	}
+	sort(presetFiles.begin(), presetFiles.end());
+
+	atomic<bool> ticking = true;
+	thread ticker([&ticking] {
+		while (ticking) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+			TickClock::instance().advance(1000000);
+		}
+	});
+
+	BenchRunner runner;
+	runner.setMinTimeMs(minTimeMs);
+	for (auto& file : presetFiles) {
+		Preset preset = loadPreset(file);
+		Scheduler probe;
+		vector<string> errors;
+		if (!probe.loadConfig(preset.path, errors)) {
+			for (const auto& error : errors) {
+				cerr << "Skipping preset: " << error << endl;
+			}
+			continue;
+		}
+		runner.add("BM_ReadyQueuePushPop/" + preset.name, [preset](BenchState& state) { benchReadyQueue(state, preset); });
+		runner.add("BM_BackingStoreIO/" + preset.name, [preset](BenchState& state) { benchBackingStore(state, preset); });
+		runner.add("BM_CheckpointCapture/" + preset.name, [preset](BenchState& state) { benchCheckpointCapture(state, preset); });
+		runner.add("BM_CheckpointEncodeDecode/" + preset.name, [preset](BenchState& state) { benchCheckpointEncode(state, preset); });
+		if (probe.getAllocationType() == "flat") {
+			runner.add("BM_FlatFirstFit/" + preset.name, [preset](BenchState& state) { benchFlatFirstFit(state, preset); });
+			runner.add("BM_FlatCompaction/" + preset.name, [preset](BenchState& state) { benchFlatCompaction(state, preset); });
+		}
+		else {
+			runner.add("BM_FrameAllocFree/" + preset.name, [preset](BenchState& state) { benchFrameAllocFree(state, preset); });
+			runner.add("BM_EvictionLoop/" + preset.name, [preset](BenchState& state) { benchEvictionLoop(state, preset); });
+			runner.add("BM_ForkFault/" + preset.name, [preset](BenchState& state) { benchForkFault(state, preset); });
+		}
+		runner.add("BM_IdleBurn/" + preset.name, [preset](BenchState& state) { benchIdleBurn(state, preset); }, 5);
+		runner.add("BM_EndToEnd/" + preset.name + "/procs:" + to_string(preset.processes) + "/cores:" + to_string(probe.getNumCpu()),
+			[preset](BenchState& state) { benchEndToEnd(state, preset); }, 1);
+	}
+
+	for (BitmapOp op : { BITMAP_COUNT, BITMAP_FIRST_FIT, BITMAP_LARGEST_RUN, BITMAP_RANGE }) {
+		for (ll units : { 1LL << 20, 1LL << 24, 1LL << 30 }) {
+			string suffix = "/units:" + to_string(units);
+			runner.add(string(bitmapOpName(op)) + "/vector-bool" + suffix, [op, units](BenchState& state) { benchVectorBool(state, op, units); });
+			for (const BitmapKernels* kernels : supportedBitmapKernels()) {
+				runner.add(string(bitmapOpName(op)) + "/" + kernels->name + suffix,
+					[op, kernels, units](BenchState& state) { benchBitmap(state, op, *kernels, units); });
+			}
+		}
+	}
+
+	for (ProcessLogMode mode : { PROCESS_LOG_SHARED, PROCESS_LOG_PER_PROCESS }) {
+		for (int threads : { 1, 4 }) {
+			runner.add("BM_ProcessLog/" + string(processLogModeName(mode)) + "/threads:" + to_string(threads),
+				[mode, threads](BenchState& state) { benchProcessLog(state, mode, threads); });
+		}
+	}
+
+	for (int threads : { 1, 4 }) {
+		runner.add("BM_ScreenExecute/threads:" + to_string(threads), [threads](BenchState& state) { benchScreenExecute(state, threads); });
+	}
+
+	vector<int> counterThreads = { 1 };
+	int hostCores = max(1, static_cast<int>(thread::hardware_concurrency()));
+	for (int threads = 2; threads < hostCores; threads *= 2) {
+		counterThreads.push_back(threads);
+	}
+	if (hostCores > 1) {
+		counterThreads.push_back(hostCores);
+	}
+	for (bool perCore : { false, true }) {
+		for (int threads : counterThreads) {
+			runner.add(string("BM_CoreCounters/") + (perCore ? "per-core" : "shared") + "/threads:" + to_string(threads),
+				[perCore, threads](BenchState& state) { benchCoreCounters(state, perCore, threads); });
+		}
+	}
+
+	for (bool pooled : { false, true }) {
+		for (int threads : { 1, 4 }) {
+			runner.add(string("BM_ProcessChurn/") + (pooled ? "pool" : "heap") + "/threads:" + to_string(threads),
+				[pooled, threads](BenchState& state) { benchProcessChurn(state, pooled, threads); });
+		}
+	}
+
+	runner.runAll(filter);
+	ticking = false;
+	ticker.join();
+
+	if (!runner.writeJson(outputFileName, label)) {
+		cerr << "Could not write " << outputFileName << endl;
+		return 1;
+	}
+	cout << "Results written to " << outputFileName << endl;
+	return 0;
+}
@@ -0,0 +1,379 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CSOPESY_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define CSOPESY_X86 0
+#endif
+
+// GCC and clang only emit AVX2/SSSE3 instructions in functions marked for them; MSVC needs nothing.
+#if CSOPESY_X86 && (defined(__GNUC__) || defined(__clang__))
+#define CSOPESY_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CSOPESY_TARGET(isa)
+#endif
+
+using namespace std;
+typedef long long ll;
+typedef unsigned long long ull;
+
+// Word-level kernels behind OccupancyBitmap. Each instruction set gets one table; the bit-level
+// logic on top is shared, so the tables only have to agree on these three primitives.
+struct BitmapKernels {
+	const char* name;
+	ll (*countSet)(const ull* words, size_t count);
+	// Index of the first word in [from, count) that differs from value, or count.
+	size_t (*findWordNot)(const ull* words, size_t from, size_t count, ull value);
+	void (*fillWords)(ull* words, size_t count, ull value);
+};
+
+ll countSetPortable(const ull* words, size_t count) {
+	ll total = 0;
+	for (size_t i = 0; i < count; i++) {
+		total += popcount(words[i]);
+	}
+	return total;
+}
+
+size_t findWordNotPortable(const ull* words, size_t from, size_t count, ull value) {
+	size_t i = from;
+	while (i < count && words[i] == value) {
+		i++;
+	}
+	return i;
+}
+
+void fillWordsPortable(ull* words, size_t count, ull value) {
+	for (size_t i = 0; i < count; i++) {
+		words[i] = value;
+	}
+}
+
+#if CSOPESY_X86
+
+// Popcount by nibble lookup (pshufb), summed per 64-bit lane with psadbw.
+CSOPESY_TARGET("ssse3")
+ll countSetSse(const ull* words, size_t count) {
+	const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m128i lowMask = _mm_set1_epi8(0x0f);
+	__m128i total = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+		__m128i low = _mm_and_si128(v, lowMask);
+		__m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), lowMask);
+		__m128i bytes = _mm_add_epi8(_mm_shuffle_epi8(lookup, low), _mm_shuffle_epi8(lookup, high));
+		total = _mm_add_epi64(total, _mm_sad_epu8(bytes, _mm_setzero_si128()));
+	}
+	ull lanes[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), total);
+	return static_cast<ll>(lanes[0] + lanes[1]) + countSetPortable(words + i, count - i);
+}
+
+CSOPESY_TARGET("ssse3")
+size_t findWordNotSse(const ull* words, size_t from, size_t count, ull value) {
+	const __m128i target = _mm_set1_epi64x(static_cast<ll>(value));
+	size_t i = from;
+	for (; i + 2 <= count; i += 2) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, target)) != 0xffff) {
+			return words[i] != value ? i : i + 1;
+		}
+	}
+	return findWordNotPortable(words, i, count, value);
+}
+
+CSOPESY_TARGET("ssse3")
+void fillWordsSse(ull* words, size_t count, ull value) {
+	const __m128i fill = _mm_set1_epi64x(static_cast<ll>(value));
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(words + i), fill);
+	}
+	fillWordsPortable(words + i, count - i, value);
+}
+
+CSOPESY_TARGET("avx2")
+ll countSetAvx2(const ull* words, size_t count) {
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i lowMask = _mm256_set1_epi8(0x0f);
+	__m256i total = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+		__m256i low = _mm256_and_si256(v, lowMask);
+		__m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+		__m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+	}
+	ull lanes[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+	return static_cast<ll>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + countSetPortable(words + i, count - i);
+}
+
+CSOPESY_TARGET("avx2")
+size_t findWordNotAvx2(const ull* words, size_t from, size_t count, ull value) {
+	const __m256i target = _mm256_set1_epi64x(static_cast<ll>(value));
+	size_t i = from;
+	for (; i + 4 <= count; i += 4) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+		int equal = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, target)));
+		if (equal != 0xf) {
+			return i + countr_zero(static_cast<unsigned>(~equal & 0xf));
+		}
+	}
+	return findWordNotPortable(words, i, count, value);
+}
+
+CSOPESY_TARGET("avx2")
+void fillWordsAvx2(ull* words, size_t count, ull value) {
+	const __m256i fill = _mm256_set1_epi64x(static_cast<ll>(value));
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(words + i), fill);
+	}
+	fillWordsPortable(words + i, count - i, value);
+}
+
+#endif
+
+const BitmapKernels PORTABLE_BITMAP_KERNELS = { "portable", countSetPortable, findWordNotPortable, fillWordsPortable };
+#if CSOPESY_X86
+const BitmapKernels SSE_BITMAP_KERNELS = { "sse", countSetSse, findWordNotSse, fillWordsSse };
+const BitmapKernels AVX2_BITMAP_KERNELS = { "avx2", countSetAvx2, findWordNotAvx2, fillWordsAvx2 };
+#endif
+
+bool cpuHasAvx2() {
+#if !CSOPESY_X86
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+	__cpuidex(info, 7, 0);
+	return osSavesYmm && (info[1] & (1 << 5));
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool cpuHasSsse3() {
+#if !CSOPESY_X86
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+// Every kernel table this CPU can run, best first.
+vector<const BitmapKernels*> supportedBitmapKernels() {
+	vector<const BitmapKernels*> supported;
+#if CSOPESY_X86
+	if (cpuHasAvx2()) {
+		supported.push_back(&AVX2_BITMAP_KERNELS);
+	}
+	if (cpuHasSsse3()) {
+		supported.push_back(&SSE_BITMAP_KERNELS);
+	}
+#endif
+	supported.push_back(&PORTABLE_BITMAP_KERNELS);
+	return supported;
+}
+
+// Picked once from CPUID. CSOPESY_SIMD=portable|sse|avx2 forces a (supported) table, for comparisons.
+const BitmapKernels& activeBitmapKernels() {
+	static const BitmapKernels* active = [] {
+		vector<const BitmapKernels*> supported = supportedBitmapKernels();
+		if (const char* forced = getenv("CSOPESY_SIMD")) {
+			for (const BitmapKernels* kernels : supported) {
+				if (string(kernels->name) == forced) {
+					return kernels;
+				}
+			}
+		}
+		return supported.front();
+	}();
+	return *active;
+}
+
+// One bit per unit of flat memory, 1 = in use. Bits past size() in the last word are kept set,
+// so searches never hand out units that do not exist.
+class OccupancyBitmap {
+private:
+	vector<ull> words;
+	ll bits = 0;
+	const BitmapKernels* kernels;
+
+	ll paddingBits() const {
+		return static_cast<ll>(words.size()) * 64 - bits;
+	}
+
+	// Lowest offset in a word where count free (zero) bits start, or -1. Each step doubles the run
+	// length the surviving bits stand for, so this takes log2(count) shifts.
+	static int freeRunInWord(ull used, ll count) {
+		ull starts = ~used;
+		ll covered = 1;
+		while (covered < count && starts != 0) {
+			ll shift = min(covered, count - covered);
+			starts &= starts >> shift;
+			covered += shift;
+		}
+		return starts == 0 ? -1 : countr_zero(starts);
+	}
+
+	void writeRange(ll first, ll last, bool used) {
+		if (first > last) {
+			return;
+		}
+		size_t firstWord = static_cast<size_t>(first / 64);
+		size_t lastWord = static_cast<size_t>(last / 64);
+		ull firstMask = ~0ULL << (first % 64);
+		ull lastMask = ~0ULL >> (63 - last % 64);
+		if (firstWord == lastWord) {
+			ull mask = firstMask & lastMask;
+			words[firstWord] = used ? words[firstWord] | mask : words[firstWord] & ~mask;
+			return;
+		}
+		words[firstWord] = used ? words[firstWord] | firstMask : words[firstWord] & ~firstMask;
+		kernels->fillWords(words.data() + firstWord + 1, lastWord - firstWord - 1, used ? ~0ULL : 0);
+		words[lastWord] = used ? words[lastWord] | lastMask : words[lastWord] & ~lastMask;
+	}
+
+public:
+	OccupancyBitmap(const BitmapKernels& kernels = activeBitmapKernels()) : kernels(&kernels) {}
+
+	// Resizes to units bits, all free.
+	void reset(ll units) {
+		bits = units;
+		words.assign(static_cast<size_t>((units + 63) / 64), 0);
+		if (units % 64 != 0) {
+			words.back() = ~0ULL << (units % 64);
+		}
+	}
+
+	void clear() {
+		words.clear();
+		bits = 0;
+	}
+
+	ll size() const {
+		return bits;
+	}
+
+	const char* kernelName() const {
+		return kernels->name;
+	}
+
+	bool isUsed(ll unit) const {
+		return (words[static_cast<size_t>(unit / 64)] >> (unit % 64)) & 1;
+	}
+
+	// Marks [first, last] in use / free; both ends inclusive like the flat memory map.
+	void setRange(ll first, ll last) {
+		writeRange(first, last, true);
+	}
+
+	void clearRange(ll first, ll last) {
+		writeRange(first, last, false);
+	}
+
+	ll countUsed() const {
+		return kernels->countSet(words.data(), words.size()) - paddingBits();
+	}
+
+	// First-fit: start of the lowest run of count free units, or -1. Whole words that are full (or,
+	// inside a run, empty) are skipped by the kernels; only mixed words are looked at bit by bit.
+	ll findFreeRun(ll count) const {
+		if (count <= 0 || count > bits) {
+			return count == 0 ? 0 : -1;
+		}
+		size_t total = words.size();
+		ll run = 0;
+		ll runStart = 0;
+		size_t w = 0;
+		while (w < total) {
+			ull used = words[w];
+			if (used == ~0ULL) {
+				run = 0;
+				w = kernels->findWordNot(words.data(), w, total, ~0ULL);
+				continue;
+			}
+			if (used == 0) {
+				if (run == 0) {
+					runStart = static_cast<ll>(w) * 64;
+				}
+				size_t next = kernels->findWordNot(words.data(), w, total, 0);
+				run += static_cast<ll>(next - w) * 64;
+				if (run >= count) {
+					return runStart;
+				}
+				w = next;
+				continue;
+			}
+			ll base = static_cast<ll>(w) * 64;
+			ll low = countr_zero(used);
+			if (run + low >= count) {
+				return run > 0 ? runStart : base;
+			}
+			if (count <= 64) {
+				int inner = freeRunInWord(used, count);
+				if (inner >= 0) {
+					return base + inner;
+				}
+			}
+			run = countl_zero(used);
+			runStart = base + 64 - run;
+			w++;
+		}
+		return -1;
+	}
+
+	ll longestFreeRun() const {
+		size_t total = words.size();
+		ll best = 0;
+		ll run = 0;
+		size_t w = 0;
+		while (w < total) {
+			ull used = words[w];
+			if (used == ~0ULL) {
+				run = 0;
+				w = kernels->findWordNot(words.data(), w, total, ~0ULL);
+				continue;
+			}
+			if (used == 0) {
+				size_t next = kernels->findWordNot(words.data(), w, total, 0);
+				run += static_cast<ll>(next - w) * 64;
+				best = max(best, run);
+				w = next;
+				continue;
+			}
+			int pos = 0;
+			while (pos < 64) {
+				int freeBits = min(countr_zero(used >> pos), 64 - pos);
+				run += freeBits;
+				best = max(best, run);
+				pos += freeBits;
+				if (pos >= 64) {
+					break;
+				}
+				run = 0;
+				pos += countr_one(used >> pos);
+			}
+			w++;
+		}
+		return best;
+	}
+};
@@ -0,0 +1,494 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// Snapshot of a Scheduler plus every process it knows about. Processes are stored once and
+// the queue, eviction order and memory maps refer to them by index into `processes`.
+// Times inside ScreenState are stored relative to the capture, so a restore in another run
+// keeps waits and ages intact.
+struct SchedulerCheckpoint {
+	SchedulerConfig config;
+	ll elapsedTicks = 0;
+	ll idleCpuTicks = 0;
+	ll pagesIn = 0;
+	ll pagesOut = 0;
+	ll dispatches = 0;
+	ll evictions = 0;
+	ll finishedProcesses = 0;
+	ll nextProcessId = 0;
+	vector<ScreenState> processes;
+	// Processes that were on a core come first; they resume at the head of the queue.
+	vector<int> readyQueue;
+	vector<int> oldest;
+	// Frames as (start, end); paging keeps the free list in allocation order.
+	vector<pair<int, int>> freeFrames;
+	vector<pair<int, vector<pair<int, int>>>> frameMap;
+	vector<tuple<int, int, int>> flatMap;
+	vector<string> backingStore;
+	// Contents of simulated RAM and of every swapped-out process image (version 2).
+	string ram;
+	vector<pair<string, string>> swapImages;
+};
+
+const char CHECKPOINT_MAGIC[4] = { 'C', 'S', 'C', 'K' };
+// Bump when the layout below changes; older files are rejected rather than misread.
+// Version 2 added RAM contents and swap images, version 3 frame-sizes. Since version 4 the
+// config is stored as config-file text, so new keys no longer change the layout. Version 5 added
+// each process's priority.
+const unsigned int CHECKPOINT_VERSION = 5;
+const unsigned int CHECKPOINT_BYTE_ORDER = 0x01020304;
+
+class CheckpointEncoder {
+public:
+	string data;
+
+	template <typename T>
+	void put(const T& value) {
+		static_assert(is_trivially_copyable_v<T>);
+		data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void putString(const string& text) {
+		put(static_cast<unsigned int>(text.size()));
+		data.append(text);
+	}
+
+	void putFrames(const vector<pair<int, int>>& frames) {
+		put(static_cast<unsigned int>(frames.size()));
+		for (const auto& [start, end] : frames) {
+			put(start);
+			put(end);
+		}
+	}
+};
+
+class CheckpointDecoder {
+private:
+	string_view data;
+	size_t pos = 0;
+
+public:
+	bool failed = false;
+
+	CheckpointDecoder(string_view data) : data(data) {}
+
+	template <typename T>
+	T get() {
+		static_assert(is_trivially_copyable_v<T>);
+		T value{};
+		if (failed || data.size() - pos < sizeof(T)) {
+			failed = true;
+			return value;
+		}
+		memcpy(&value, data.data() + pos, sizeof(T));
+		pos += sizeof(T);
+		return value;
+	}
+
+	string getString() {
+		unsigned int size = get<unsigned int>();
+		if (failed || data.size() - pos < size) {
+			failed = true;
+			return {};
+		}
+		string text(data.substr(pos, size));
+		pos += size;
+		return text;
+	}
+
+	vector<pair<int, int>> getFrames() {
+		unsigned int count = get<unsigned int>();
+		vector<pair<int, int>> frames;
+		for (unsigned int i = 0; i < count && !failed; i++) {
+			int start = get<int>();
+			int end = get<int>();
+			frames.emplace_back(start, end);
+		}
+		return frames;
+	}
+
+	bool atEnd() const {
+		return pos == data.size();
+	}
+};
+
+ull checkpointChecksum(string_view data) {
+	ull hash = 1469598103934665603ULL;
+	for (unsigned char c : data) {
+		hash = (hash ^ c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+string encodeCheckpoint(const SchedulerCheckpoint& checkpoint) {
+	CheckpointEncoder out;
+	out.putString(formatConfig(checkpoint.config));
+
+	out.put(checkpoint.elapsedTicks);
+	out.put(checkpoint.idleCpuTicks);
+	out.put(checkpoint.pagesIn);
+	out.put(checkpoint.pagesOut);
+	out.put(checkpoint.dispatches);
+	out.put(checkpoint.evictions);
+	out.put(checkpoint.finishedProcesses);
+	out.put(checkpoint.nextProcessId);
+
+	out.put(static_cast<unsigned int>(checkpoint.processes.size()));
+	for (const auto& state : checkpoint.processes) {
+		out.putString(state.processName);
+		out.put(state.currentLine);
+		out.put(state.totalLine);
+		out.put(state.timestamp);
+		out.put(state.finished);
+		out.put(state.initialized);
+		out.put(state.coreId);
+		out.put(state.memory);
+		out.put(state.memoryAllocated);
+		out.put(state.allocatedMemory);
+		out.put(state.createdAt);
+		out.put(state.firstRunAt);
+		out.put(state.finishedAt);
+		out.put(state.enqueuedAt);
+		out.put(state.firstEnqueuedAt);
+		out.put(state.dispatched);
+		out.put(state.priority);
+		out.put(static_cast<unsigned int>(state.buffer.size()));
+		for (const auto& entry : state.buffer) {
+			out.putString(entry.text);
+			out.put(entry.color);
+		}
+	}
+
+	auto putIndexes = [&out](const vector<int>& indexes) {
+		out.put(static_cast<unsigned int>(indexes.size()));
+		for (int index : indexes) {
+			out.put(index);
+		}
+	};
+	putIndexes(checkpoint.readyQueue);
+	putIndexes(checkpoint.oldest);
+	out.putFrames(checkpoint.freeFrames);
+	out.put(static_cast<unsigned int>(checkpoint.frameMap.size()));
+	for (const auto& [index, frames] : checkpoint.frameMap) {
+		out.put(index);
+		out.putFrames(frames);
+	}
+	out.put(static_cast<unsigned int>(checkpoint.flatMap.size()));
+	for (const auto& [index, start, end] : checkpoint.flatMap) {
+		out.put(index);
+		out.put(start);
+		out.put(end);
+	}
+	out.put(static_cast<unsigned int>(checkpoint.backingStore.size()));
+	for (const auto& name : checkpoint.backingStore) {
+		out.putString(name);
+	}
+	out.putString(checkpoint.ram);
+	out.put(static_cast<unsigned int>(checkpoint.swapImages.size()));
+	for (const auto& [name, image] : checkpoint.swapImages) {
+		out.putString(name);
+		out.putString(image);
+	}
+
+	CheckpointEncoder file;
+	file.data.append(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	file.put(CHECKPOINT_VERSION);
+	file.put(CHECKPOINT_BYTE_ORDER);
+	file.put(static_cast<ull>(out.data.size()));
+	file.put(checkpointChecksum(out.data));
+	file.data.append(out.data);
+	return file.data;
+}
+
+bool decodeCheckpoint(string_view data, SchedulerCheckpoint& checkpoint, string& error) {
+	CheckpointDecoder header(data);
+	if (data.size() < sizeof(CHECKPOINT_MAGIC) || memcmp(data.data(), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+		error = "not a checkpoint file";
+		return false;
+	}
+	header.get<unsigned int>();
+	unsigned int version = header.get<unsigned int>();
+	unsigned int byteOrder = header.get<unsigned int>();
+	ull payloadSize = header.get<ull>();
+	ull checksum = header.get<ull>();
+	size_t headerSize = sizeof(CHECKPOINT_MAGIC) + 2 * sizeof(unsigned int) + 2 * sizeof(ull);
+	if (header.failed) {
+		error = "truncated header";
+		return false;
+	}
+	if (version != CHECKPOINT_VERSION) {
+		error = "unsupported checkpoint version " + to_string(version) + " (expected " + to_string(CHECKPOINT_VERSION) + ")";
+		return false;
+	}
+	if (byteOrder != CHECKPOINT_BYTE_ORDER) {
+		error = "checkpoint was written on a machine with a different byte order";
+		return false;
+	}
+	string_view payload = data.substr(headerSize);
+	if (payload.size() != payloadSize || checkpointChecksum(payload) != checksum) {
+		error = "checkpoint is truncated or corrupted";
+		return false;
+	}
+
+	CheckpointDecoder in(payload);
+	string configText = in.getString();
+	vector<string> configErrors;
+	parseConfigLines(configText, "checkpoint config", checkpoint.config, configErrors);
+	if (!configErrors.empty()) {
+		error = configErrors.front();
+		return false;
+	}
+
+	checkpoint.elapsedTicks = in.get<ll>();
+	checkpoint.idleCpuTicks = in.get<ll>();
+	checkpoint.pagesIn = in.get<ll>();
+	checkpoint.pagesOut = in.get<ll>();
+	checkpoint.dispatches = in.get<ll>();
+	checkpoint.evictions = in.get<ll>();
+	checkpoint.finishedProcesses = in.get<ll>();
+	checkpoint.nextProcessId = in.get<ll>();
+
+	unsigned int processCount = in.get<unsigned int>();
+	for (unsigned int i = 0; i < processCount && !in.failed; i++) {
+		ScreenState state;
+		state.processName = in.getString();
+		state.currentLine = in.get<int>();
+		state.totalLine = in.get<int>();
+		state.timestamp = in.get<ll>();
+		state.finished = in.get<bool>();
+		state.initialized = in.get<bool>();
+		state.coreId = in.get<int>();
+		state.memory = in.get<int>();
+		state.memoryAllocated = in.get<bool>();
+		state.allocatedMemory = in.get<int>();
+		state.createdAt = in.get<ll>();
+		state.firstRunAt = in.get<ll>();
+		state.finishedAt = in.get<ll>();
+		state.enqueuedAt = in.get<ll>();
+		state.firstEnqueuedAt = in.get<ll>();
+		state.dispatched = in.get<bool>();
+		state.priority = in.get<ll>();
+		unsigned int lines = in.get<unsigned int>();
+		for (unsigned int j = 0; j < lines && !in.failed; j++) {
+			BufferEntry entry;
+			entry.text = in.getString();
+			entry.color = in.get<WORD>();
+			state.buffer.push_back(entry);
+		}
+		checkpoint.processes.push_back(move(state));
+	}
+
+	// Indexes must name a saved process and frames must lie in the saved memory, since the restore
+	// uses both unchecked; the checksum only catches accidental damage.
+	bool outOfRange = false;
+	auto checkIndex = [&in, &outOfRange, processCount](int index) {
+		if (index < 0 || static_cast<unsigned int>(index) >= processCount) {
+			in.failed = outOfRange = true;
+		}
+	};
+	ll memorySize = checkpoint.config.maxOverallMem;
+	auto checkRange = [&in, &outOfRange, memorySize](int start, int end) {
+		if (start < 0 || end < start || end >= memorySize) {
+			in.failed = outOfRange = true;
+		}
+	};
+	auto getIndexes = [&in, &checkIndex](vector<int>& indexes) {
+		unsigned int count = in.get<unsigned int>();
+		for (unsigned int i = 0; i < count && !in.failed; i++) {
+			int index = in.get<int>();
+			checkIndex(index);
+			indexes.push_back(index);
+		}
+	};
+	auto getFrames = [&in, &checkRange]() {
+		vector<pair<int, int>> frames = in.getFrames();
+		for (const auto& [start, end] : frames) {
+			checkRange(start, end);
+		}
+		return frames;
+	};
+	getIndexes(checkpoint.readyQueue);
+	getIndexes(checkpoint.oldest);
+	checkpoint.freeFrames = getFrames();
+	unsigned int mapped = in.get<unsigned int>();
+	for (unsigned int i = 0; i < mapped && !in.failed; i++) {
+		int index = in.get<int>();
+		checkIndex(index);
+		checkpoint.frameMap.emplace_back(index, getFrames());
+	}
+	unsigned int flatMapped = in.get<unsigned int>();
+	for (unsigned int i = 0; i < flatMapped && !in.failed; i++) {
+		int index = in.get<int>();
+		int start = in.get<int>();
+		int end = in.get<int>();
+		checkIndex(index);
+		checkRange(start, end);
+		checkpoint.flatMap.emplace_back(index, start, end);
+	}
+	unsigned int stored = in.get<unsigned int>();
+	for (unsigned int i = 0; i < stored && !in.failed; i++) {
+		checkpoint.backingStore.push_back(in.getString());
+	}
+	checkpoint.ram = in.getString();
+	unsigned int images = in.get<unsigned int>();
+	for (unsigned int i = 0; i < images && !in.failed; i++) {
+		string name = in.getString();
+		checkpoint.swapImages.emplace_back(name, in.getString());
+	}
+	if (outOfRange) {
+		error = "checkpoint refers to a process or memory range that is not in it";
+		return false;
+	}
+	if (in.failed || !in.atEnd()) {
+		error = "checkpoint payload does not match version " + to_string(CHECKPOINT_VERSION);
+		return false;
+	}
+	return true;
+}
+
+bool readCheckpointFile(const string& path, SchedulerCheckpoint& checkpoint, string& error) {
+	ifstream file(path, ios::binary);
+	if (!file.is_open()) {
+		error = "could not open " + path;
+		return false;
+	}
+	string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	return decodeCheckpoint(contents, checkpoint, error);
+}
+
+// Writes to a temporary file and renames it over the target, so a crash mid-write leaves the
+// previous checkpoint intact.
+bool writeCheckpointFile(const string& path, const SchedulerCheckpoint& checkpoint, ll& bytes) {
+	string data = encodeCheckpoint(checkpoint);
+	string temporary = path + ".tmp";
+	{
+		ofstream file(temporary, ios::binary | ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+		file.write(data.data(), data.size());
+		if (!file) {
+			return false;
+		}
+	}
+	error_code ec;
+	filesystem::rename(temporary, path, ec);
+	bytes = static_cast<ll>(data.size());
+	return !ec;
+}
+
+// Encodes and writes checkpoints off the console thread. capture() is the only part that runs
+// against the live scheduler; with an interval set the writer also checkpoints periodically.
+class CheckpointWriter {
+private:
+	jthread worker;
+	mutex writerMutex;
+	condition_variable_any wake;
+	deque<pair<string, SchedulerCheckpoint>> pending;
+	function<SchedulerCheckpoint()> capture;
+	string periodicPath;
+	chrono::milliseconds interval{ 0 };
+	atomic<ll> written = 0;
+	atomic<ll> failures = 0;
+	atomic<ll> lastBytes = 0;
+	atomic<ll> lastWriteNs = 0;
+
+	void writeLoop(stop_token token) {
+		auto nextPeriodic = chrono::steady_clock::now() + interval;
+		while (true) {
+			pair<string, SchedulerCheckpoint> job;
+			bool periodic = false;
+			{
+				unique_lock<mutex> lock(writerMutex);
+				auto ready = [this] { return !pending.empty(); };
+				if (interval.count() > 0) {
+					wake.wait_until(lock, token, nextPeriodic, ready);
+				}
+				else {
+					wake.wait(lock, token, ready);
+				}
+				if (!pending.empty()) {
+					job = move(pending.front());
+					pending.pop_front();
+				}
+				else if (token.stop_requested()) {
+					return;
+				}
+				else if (interval.count() > 0 && chrono::steady_clock::now() >= nextPeriodic) {
+					periodic = true;
+					nextPeriodic = chrono::steady_clock::now() + interval;
+				}
+				else {
+					continue;
+				}
+			}
+			if (periodic) {
+				job = { periodicPath, capture() };
+			}
+			ll startedAt = nowNs();
+			ll bytes = 0;
+			if (writeCheckpointFile(job.first, job.second, bytes)) {
+				written++;
+				lastBytes = bytes;
+				lastWriteNs = nowNs() - startedAt;
+			}
+			else {
+				failures++;
+			}
+		}
+	}
+
+public:
+	~CheckpointWriter() {
+		stop();
+	}
+
+	void start(function<SchedulerCheckpoint()> captureState) {
+		if (worker.joinable()) {
+			return;
+		}
+		capture = captureState;
+		worker = jthread([this](stop_token token) { writeLoop(token); });
+	}
+
+	bool isPeriodic() {
+		return interval.count() > 0;
+	}
+
+	// Queued checkpoints are still written before the thread exits.
+	void stop() {
+		worker = jthread();
+	}
+
+	void save(const string& path, SchedulerCheckpoint checkpoint) {
+		lock_guard<mutex> lock(writerMutex);
+		pending.emplace_back(path, move(checkpoint));
+		wake.notify_one();
+	}
+
+	// Restarts the writer so the new interval takes effect; 0 turns periodic checkpoints off.
+	// start() must have been called first so there is something to capture with.
+	void setPeriodic(const string& path, ll intervalMs) {
+		stop();
+		periodicPath = path;
+		interval = chrono::milliseconds(intervalMs);
+		worker = jthread([this](stop_token token) { writeLoop(token); });
+	}
+
+	ll getWritten() {
+		return written;
+	}
+
+	ll getFailures() {
+		return failures;
+	}
+
+	ll getLastBytes() {
+		return lastBytes;
+	}
+
+	ll getLastWriteNs() {
+		return lastWriteNs;
+	}
+};
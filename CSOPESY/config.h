@@ -0,0 +1,490 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// Defaults are used for any key the file leaves out.
+struct SchedulerConfig {
+	ll numCpu = 4;
+	string scheduler = "rr";
+	ll quantumCycles = 5;
+	ll batchProcessFrequency = 1;
+	// scheduler-test creates batchProcessSize processes every batchProcessFrequency ticks, after
+	// waiting batchProcessDelayMs; archiveFinished moves finished processes into the summary archive.
+	ll batchProcessSize = 1;
+	ll batchProcessDelayMs = 400;
+	string archiveFinished = "off";
+	// How scheduler-test's processes arrive; "fixed" is the batch-process-* schedule above. The rest
+	// are open-loop generators at arrivalRate per 1000 ticks (see ArrivalSettings in arrivals.h).
+	string arrivalProcess = "fixed";
+	ll arrivalRate = 1000;
+	ll arrivalOnTicks = 100;
+	ll arrivalOffTicks = 400;
+	ll arrivalPeriodTicks = 10000;
+	ll arrivalAmplitude = 80;
+	string arrivalTrace;
+	ll arrivalPriorities = 1;
+	ll arrivalSeed = 1;
+	ll minIns = 1000;
+	ll maxIns = 2000;
+	ll delayPerExec = 0;
+	ll maxOverallMem = 16384;
+	ll memPerFrame = 16;
+	ll minMemPerProc = 4096;
+	ll maxMemPerProc = 4096;
+	// "auto" keeps the old rule (flat when max-overall-mem == mem-per-frame) but is reported.
+	string allocator = "auto";
+	bool allocatorInferred = false;
+	// Extra paging frame sizes, e.g. "64,1024"; mem-per-frame is always the smallest class.
+	string frameSizes;
+	// frameSizes parsed and merged with mem-per-frame, ascending. Filled in by validateConfig.
+	vector<ll> frameClasses;
+	// Flat mode: compact when the largest free block is below this percentage of all free memory,
+	// moving at most compactionBudget bytes per tick (0 disables compaction).
+	ll compactionThreshold = 50;
+	ll compactionBudget = 256;
+	// FCFS admission: whether smaller processes may take memory ahead of one that does not fit,
+	// how often the oldest waiter may be overtaken before they must wait too, and how many
+	// failed allocations all cores together may attempt per tick.
+	string admissionBackfill = "on";
+	ll admissionMaxBypass = 8;
+	ll admissionRetriesPerTick = 4;
+	// Percentage of scheduler-test processes forked (copy-on-write) from the last one created fresh.
+	ll forkPercent = 0;
+	// Paging only: cores and memory split evenly into numaNodes nodes. An instruction run on a core
+	// of another node than the process's memory stalls remoteAccessPenalty ticks; a core looks
+	// numaDispatchWindow entries into the ready queue for a process local to it.
+	ll numaNodes = 1;
+	ll remoteAccessPenalty = 1;
+	ll numaDispatchWindow = 4;
+	// OS threads that run the simulated cores; 0 picks the smaller of num-cpu and the host's cores.
+	ll coreThreads = 0;
+};
+
+struct ConfigField {
+	const char* key;
+	ll SchedulerConfig::* number;
+	string SchedulerConfig::* text;
+	ll minValue;
+	ll maxValue;
+	bool powerOfTwo;
+	vector<string> choices;
+};
+
+// Keys the scheduler keeps in int fields stop here so a value the schema accepts cannot wrap.
+const ll CONFIG_INT_MAX = numeric_limits<int>::max();
+
+const vector<ConfigField>& configSchema() {
+	static const vector<ConfigField> schema = {
+		{ "num-cpu", &SchedulerConfig::numCpu, nullptr, 1, 1024, false, {} },
+		{ "scheduler", nullptr, &SchedulerConfig::scheduler, 0, 0, false, { "rr", "fcfs" } },
+		{ "quantum-cycles", &SchedulerConfig::quantumCycles, nullptr, 1, CONFIG_INT_MAX, false, {} },
+		{ "batch-process-freq", &SchedulerConfig::batchProcessFrequency, nullptr, 1, 1LL << 32, false, {} },
+		{ "batch-process-size", &SchedulerConfig::batchProcessSize, nullptr, 1, 1000000, false, {} },
+		{ "batch-process-delay-ms", &SchedulerConfig::batchProcessDelayMs, nullptr, 0, 60000, false, {} },
+		{ "archive-finished", nullptr, &SchedulerConfig::archiveFinished, 0, 0, false, { "on", "off" } },
+		{ "arrival-process", nullptr, &SchedulerConfig::arrivalProcess, 0, 0, false, { "fixed", "poisson", "bursty", "diurnal", "trace" } },
+		{ "arrival-rate", &SchedulerConfig::arrivalRate, nullptr, 1, 10000000, false, {} },
+		{ "arrival-on-ticks", &SchedulerConfig::arrivalOnTicks, nullptr, 1, 1LL << 32, false, {} },
+		{ "arrival-off-ticks", &SchedulerConfig::arrivalOffTicks, nullptr, 0, 1LL << 32, false, {} },
+		{ "arrival-period-ticks", &SchedulerConfig::arrivalPeriodTicks, nullptr, 2, 1LL << 32, false, {} },
+		{ "arrival-amplitude", &SchedulerConfig::arrivalAmplitude, nullptr, 0, 100, false, {} },
+		{ "arrival-trace", nullptr, &SchedulerConfig::arrivalTrace, 0, 0, false, {} },
+		{ "arrival-priorities", &SchedulerConfig::arrivalPriorities, nullptr, 1, 1000, false, {} },
+		{ "arrival-seed", &SchedulerConfig::arrivalSeed, nullptr, 0, 1LL << 62, false, {} },
+		{ "min-ins", &SchedulerConfig::minIns, nullptr, 1, CONFIG_INT_MAX, false, {} },
+		{ "max-ins", &SchedulerConfig::maxIns, nullptr, 1, CONFIG_INT_MAX, false, {} },
+		{ "delay-per-exec", &SchedulerConfig::delayPerExec, nullptr, 0, CONFIG_INT_MAX, false, {} },
+		{ "max-overall-mem", &SchedulerConfig::maxOverallMem, nullptr, 1, 1LL << 30, true, {} },
+		{ "mem-per-frame", &SchedulerConfig::memPerFrame, nullptr, 1, 1LL << 30, true, {} },
+		{ "min-mem-per-proc", &SchedulerConfig::minMemPerProc, nullptr, 1, 1LL << 30, false, {} },
+		{ "max-mem-per-proc", &SchedulerConfig::maxMemPerProc, nullptr, 1, 1LL << 30, false, {} },
+		{ "allocator", nullptr, &SchedulerConfig::allocator, 0, 0, false, { "auto", "paging", "flat" } },
+		{ "frame-sizes", nullptr, &SchedulerConfig::frameSizes, 0, 0, false, {} },
+		{ "compaction-threshold", &SchedulerConfig::compactionThreshold, nullptr, 0, 100, false, {} },
+		{ "compaction-budget", &SchedulerConfig::compactionBudget, nullptr, 0, 1LL << 30, false, {} },
+		{ "admission-backfill", nullptr, &SchedulerConfig::admissionBackfill, 0, 0, false, { "on", "off" } },
+		{ "admission-max-bypass", &SchedulerConfig::admissionMaxBypass, nullptr, 0, 1LL << 31, false, {} },
+		{ "admission-retries-per-tick", &SchedulerConfig::admissionRetriesPerTick, nullptr, 1, 1LL << 31, false, {} },
+		{ "fork-percent", &SchedulerConfig::forkPercent, nullptr, 0, 100, false, {} },
+		{ "numa-nodes", &SchedulerConfig::numaNodes, nullptr, 1, 64, false, {} },
+		{ "remote-access-penalty", &SchedulerConfig::remoteAccessPenalty, nullptr, 0, 1LL << 20, false, {} },
+		{ "numa-dispatch-window", &SchedulerConfig::numaDispatchWindow, nullptr, 0, 1LL << 20, false, {} },
+		{ "core-threads", &SchedulerConfig::coreThreads, nullptr, 0, 1024, false, {} },
+	};
+	return schema;
+}
+
+string_view trimConfigText(string_view text) {
+	size_t first = text.find_first_not_of(" \t\r\n");
+	if (first == string_view::npos) {
+		return {};
+	}
+	size_t last = text.find_last_not_of(" \t\r\n");
+	return text.substr(first, last - first + 1);
+}
+
+string_view unquoteConfigValue(string_view value) {
+	if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front()) {
+		return value.substr(1, value.size() - 2);
+	}
+	return value;
+}
+
+// Sets one key after type and range checks. Keys may use '-' or '_'; "bench-" keys belong to the benchmark presets.
+void setConfigValue(SchedulerConfig& config, string_view rawKey, string_view rawValue, const string& where, vector<string>& errors) {
+	string key(rawKey);
+	for (char& c : key) {
+		c = c == '_' ? '-' : static_cast<char>(tolower(static_cast<unsigned char>(c)));
+	}
+	if (key.rfind("bench-", 0) == 0) {
+		return;
+	}
+	string_view value = unquoteConfigValue(trimConfigText(rawValue));
+	const auto& schema = configSchema();
+	auto field = find_if(schema.begin(), schema.end(), [&key](const ConfigField& f) { return key == f.key; });
+	if (field == schema.end()) {
+		errors.push_back(where + ": unknown key '" + key + "'");
+		return;
+	}
+	if (field->text != nullptr) {
+		string text(value);
+		if (!field->choices.empty() && find(field->choices.begin(), field->choices.end(), text) == field->choices.end()) {
+			string allowed;
+			for (const auto& choice : field->choices) {
+				allowed += (allowed.empty() ? "" : ", ") + choice;
+			}
+			errors.push_back(where + ": " + key + " must be one of " + allowed + " (got '" + text + "')");
+			return;
+		}
+		config.*(field->text) = text;
+		return;
+	}
+	ll number = 0;
+	auto [end, ec] = from_chars(value.data(), value.data() + value.size(), number);
+	if (value.empty() || ec != errc() || end != value.data() + value.size()) {
+		errors.push_back(where + ": " + key + " expects an integer (got '" + string(value) + "')");
+		return;
+	}
+	if (number < field->minValue || number > field->maxValue) {
+		errors.push_back(where + ": " + key + " must be between " + to_string(field->minValue) + " and " + to_string(field->maxValue) + " (got " + to_string(number) + ")");
+		return;
+	}
+	if (field->powerOfTwo && !has_single_bit(static_cast<unsigned long long>(number))) {
+		errors.push_back(where + ": " + key + " must be a power of two (got " + to_string(number) + ")");
+		return;
+	}
+	config.*(field->number) = number;
+}
+
+// Writes every schema key as "key value" lines that parseConfigLines reads back.
+string formatConfig(const SchedulerConfig& config) {
+	string text;
+	for (const auto& field : configSchema()) {
+		text += field.key;
+		text += ' ';
+		if (field.text != nullptr) {
+			text += "\"" + config.*(field.text) + "\"";
+		}
+		else {
+			text += to_string(config.*(field.number));
+		}
+		text += '\n';
+	}
+	return text;
+}
+
+// Flat JSON object: {"num-cpu": 4, "scheduler": "rr", ...}. Nested values are rejected.
+void parseConfigJson(string_view text, const string& source, SchedulerConfig& config, vector<string>& errors) {
+	size_t pos = 0;
+	auto where = [&]() {
+		return source + ":" + to_string(count(text.begin(), text.begin() + min(pos, text.size()), '\n') + 1);
+	};
+	auto skipSpace = [&]() {
+		while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) {
+			pos++;
+		}
+	};
+	auto readString = [&](string_view& out) {
+		size_t close = text.find('"', pos + 1);
+		if (close == string_view::npos) {
+			return false;
+		}
+		out = text.substr(pos + 1, close - pos - 1);
+		pos = close + 1;
+		return true;
+	};
+
+	skipSpace();
+	pos++;
+	while (true) {
+		skipSpace();
+		if (pos < text.size() && text[pos] == '}') {
+			return;
+		}
+		string_view key;
+		if (pos >= text.size() || text[pos] != '"' || !readString(key)) {
+			errors.push_back(where() + ": expected a quoted key");
+			return;
+		}
+		skipSpace();
+		if (pos >= text.size() || text[pos] != ':') {
+			errors.push_back(where() + ": expected ':' after \"" + string(key) + "\"");
+			return;
+		}
+		pos++;
+		skipSpace();
+		string location = where();
+		string_view value;
+		if (pos < text.size() && text[pos] == '"') {
+			if (!readString(value)) {
+				errors.push_back(location + ": unterminated string");
+				return;
+			}
+		}
+		else if (pos >= text.size()) {
+			errors.push_back(location + ": expected a value for \"" + string(key) + "\"");
+			return;
+		}
+		else {
+			size_t stop = text[pos] == '[' ? text.find(']', pos) : text.find_first_of(",}\n", pos);
+			if (stop != string_view::npos && text[pos] == '[') {
+				stop++;
+			}
+			if (stop == string_view::npos || text[pos] == '{') {
+				errors.push_back(location + ": unsupported value for \"" + string(key) + "\"");
+				return;
+			}
+			value = trimConfigText(text.substr(pos, stop - pos));
+			pos = stop;
+		}
+		setConfigValue(config, key, value, location, errors);
+		skipSpace();
+		if (pos < text.size() && text[pos] == ',') {
+			pos++;
+		}
+		else if (pos >= text.size() || text[pos] != '}') {
+			errors.push_back(where() + ": expected ',' or '}'");
+			return;
+		}
+	}
+}
+
+// One setting per line as "key value", "key = value" (TOML) or "key: value". Values may be quoted;
+// '#' starts a comment and [section] headers are ignored.
+void parseConfigLines(string_view text, const string& source, SchedulerConfig& config, vector<string>& errors) {
+	size_t lineNumber = 0;
+	while (!text.empty()) {
+		size_t newline = text.find('\n');
+		string_view line = text.substr(0, newline);
+		text = newline == string_view::npos ? string_view() : text.substr(newline + 1);
+		lineNumber++;
+
+		bool quoted = false;
+		for (size_t i = 0; i < line.size(); i++) {
+			if (line[i] == '"') {
+				quoted = !quoted;
+			}
+			else if (line[i] == '#' && !quoted) {
+				line = line.substr(0, i);
+				break;
+			}
+		}
+		line = trimConfigText(line);
+		if (line.empty() || line.front() == '[') {
+			continue;
+		}
+		size_t split = line.find_first_of(" \t=:");
+		string where = source + ":" + to_string(lineNumber);
+		if (split == string_view::npos) {
+			errors.push_back(where + ": missing value for '" + string(line) + "'");
+			continue;
+		}
+		string_view key = line.substr(0, split);
+		string_view value = trimConfigText(line.substr(split));
+		if (!value.empty() && (value.front() == '=' || value.front() == ':')) {
+			value = trimConfigText(value.substr(1));
+		}
+		if (value.empty()) {
+			errors.push_back(where + ": missing value for '" + string(key) + "'");
+			continue;
+		}
+		setConfigValue(config, key, value, where, errors);
+	}
+}
+
+// Checks that involve more than one key, and resolves allocator "auto".
+void validateConfig(SchedulerConfig& config, vector<string>& errors) {
+	if (config.minIns > config.maxIns) {
+		errors.push_back("min-ins (" + to_string(config.minIns) + ") must not exceed max-ins (" + to_string(config.maxIns) + ")");
+	}
+	if (config.minMemPerProc > config.maxMemPerProc) {
+		errors.push_back("min-mem-per-proc (" + to_string(config.minMemPerProc) + ") must not exceed max-mem-per-proc (" + to_string(config.maxMemPerProc) + ")");
+	}
+	if (config.maxMemPerProc > config.maxOverallMem) {
+		errors.push_back("max-mem-per-proc (" + to_string(config.maxMemPerProc) + ") must not exceed max-overall-mem (" + to_string(config.maxOverallMem) + ")");
+	}
+	if (config.memPerFrame > config.maxOverallMem) {
+		errors.push_back("mem-per-frame (" + to_string(config.memPerFrame) + ") must not exceed max-overall-mem (" + to_string(config.maxOverallMem) + ")");
+	}
+	if (config.arrivalProcess == "trace" && config.arrivalTrace.empty()) {
+		errors.push_back("arrival-process trace needs arrival-trace (a CSV file of tick,instructions,memory[,priority])");
+	}
+	if (config.allocator == "auto") {
+		config.allocator = config.maxOverallMem == config.memPerFrame ? "flat" : "paging";
+		config.allocatorInferred = true;
+	}
+
+	config.frameClasses = { config.memPerFrame };
+	string list = config.frameSizes;
+	for (char& c : list) {
+		if (c == ',' || c == '/' || c == '[' || c == ']') {
+			c = ' ';
+		}
+	}
+	istringstream sizes(list);
+	string entry;
+	while (sizes >> entry) {
+		ll size = 0;
+		auto [end, ec] = from_chars(entry.data(), entry.data() + entry.size(), size);
+		if (ec != errc() || end != entry.data() + entry.size() || size <= 0 || !has_single_bit(static_cast<ull>(size))) {
+			errors.push_back("frame-sizes: '" + entry + "' is not a power of two");
+			continue;
+		}
+		if (size < config.memPerFrame || size > config.maxOverallMem) {
+			errors.push_back("frame-sizes: " + entry + " must be between mem-per-frame (" + to_string(config.memPerFrame) + ") and max-overall-mem (" + to_string(config.maxOverallMem) + ")");
+			continue;
+		}
+		config.frameClasses.push_back(size);
+	}
+	sort(config.frameClasses.begin(), config.frameClasses.end());
+	config.frameClasses.erase(unique(config.frameClasses.begin(), config.frameClasses.end()), config.frameClasses.end());
+	if (config.frameClasses.size() > 1 && config.allocator == "flat") {
+		errors.push_back("frame-sizes only applies to the paging allocator");
+	}
+	if (config.numaNodes > 1) {
+		if (config.allocator != "paging") {
+			errors.push_back("numa-nodes above 1 needs the paging allocator");
+		}
+		if (config.numaNodes > config.numCpu) {
+			errors.push_back("numa-nodes (" + to_string(config.numaNodes) + ") must not exceed num-cpu (" + to_string(config.numCpu) + ")");
+		}
+		ll largest = config.frameClasses.back();
+		if (config.maxOverallMem % (config.numaNodes * largest) != 0) {
+			errors.push_back("max-overall-mem (" + to_string(config.maxOverallMem) + ") must split into numa-nodes (" + to_string(config.numaNodes)
+				+ ") parts that are whole multiples of the largest frame size (" + to_string(largest) + ")");
+		}
+	}
+}
+
+// Parses the file (JSON when it starts with '{', line-based otherwise), then applies "key=value"
+// overrides, then validates. Returns false with every problem found in errors.
+bool readConfigFile(const string& path, SchedulerConfig& config, vector<string>& errors, const vector<string>& overrides = {}) {
+	ifstream file(path, ios::binary);
+	if (!file.is_open()) {
+		errors.push_back("could not open " + path);
+		return false;
+	}
+	string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	string_view text = trimConfigText(contents);
+	if (!text.empty() && text.front() == '{') {
+		parseConfigJson(text, path, config, errors);
+	}
+	else {
+		parseConfigLines(contents, path, config, errors);
+	}
+	for (const auto& entry : overrides) {
+		size_t equals = entry.find('=');
+		if (equals == string::npos) {
+			errors.push_back("override '" + entry + "': expected key=value");
+			continue;
+		}
+		setConfigValue(config, string_view(entry).substr(0, equals), string_view(entry).substr(equals + 1), "override", errors);
+	}
+	if (errors.empty()) {
+		validateConfig(config, errors);
+	}
+	return errors.empty();
+}
+
+// Watches one config file and calls onChange after it is rewritten. Uses inotify on Linux
+// and falls back to polling the modification time everywhere else. onChange gets the watcher's
+// stop token so that it can give up waiting when stop() is joining it.
+class ConfigWatcher {
+private:
+	jthread worker;
+	string path;
+	function<void(stop_token)> onChange;
+
+	void pollLoop(stop_token token) {
+		error_code ec;
+		auto lastWrite = filesystem::last_write_time(path, ec);
+		while (!token.stop_requested()) {
+			this_thread::sleep_for(chrono::milliseconds(500));
+			auto current = filesystem::last_write_time(path, ec);
+			if (!ec && current != lastWrite) {
+				lastWrite = current;
+				onChange(token);
+			}
+		}
+	}
+
+	void watchLoop(stop_token token) {
+#ifdef __linux__
+		// Editors often replace the file instead of writing in place, so watch the directory.
+		filesystem::path target = filesystem::absolute(path);
+		string dir = target.parent_path().string();
+		string name = target.filename().string();
+		int fd = inotify_init1(IN_NONBLOCK);
+		if (fd >= 0 && inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0) {
+			alignas(inotify_event) char events[4096];
+			while (!token.stop_requested()) {
+				pollfd pfd = { fd, POLLIN, 0 };
+				if (poll(&pfd, 1, 200) <= 0) {
+					continue;
+				}
+				bool changed = false;
+				ssize_t length;
+				while ((length = read(fd, events, sizeof(events))) > 0) {
+					for (char* ptr = events; ptr < events + length;) {
+						inotify_event* event = reinterpret_cast<inotify_event*>(ptr);
+						if (event->len > 0 && name == event->name) {
+							changed = true;
+						}
+						ptr += sizeof(inotify_event) + event->len;
+					}
+				}
+				if (changed) {
+					onChange(token);
+				}
+			}
+			close(fd);
+			return;
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+		pollLoop(token);
+	}
+
+public:
+	void start(const string& file, function<void(stop_token)> callback) {
+		stop();
+		path = file;
+		onChange = callback;
+		worker = jthread([this](stop_token token) { watchLoop(token); });
+	}
+
+	void stop() {
+		worker = jthread();
+	}
+
+	bool isRunning() {
+		return worker.joinable();
+	}
+
+	string getPath() {
+		return path;
+	}
+};
@@ -1,9 +1,9 @@
+#include "platform.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
 #include <string>
 #include <set>
-#include <windows.h>
 #include <sstream>
 #include <ctime>
 #include <cstdio>
@@ -18,33 +18,86 @@
 #include <fstream>
 #include <filesystem>
 #include <chrono>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <charconv>
+#include <string_view>
+#include <unordered_map>
+#include <tuple>
+#include <condition_variable>
+#include <coroutine>
+#include <random>
+#include <numbers>
+#include <limits>
+#include "stats.h"
+#include "metrics.h"
 #include "screen.h"
+#include "pool.h"
+#include "trace.h"
+#include "workerpool.h"
+#include "proclog.h"
+#include "config.h"
+#include "physmem.h"
+#include "bitmap.h"
+#include "checkpoint.h"
+#include "arrivals.h"
 #include "scheduler.h"
+#include "archive.h"
+#include "sweep.h"
 CONST ll divide = 1000000;
 using namespace std;
 typedef long long ll;
 
 volatile ll mainCtr = 0;
-mutex ctrMutex;
+atomic<bool> cpuRunning = true;
+atomic<ll> totalTicks = 0;
+ll tickMicros = 100000;
 
 void runCPU() {
-	while (true) {
-		unique_lock<mutex> lock(ctrMutex);
-		this_thread::sleep_for(chrono::milliseconds(100));
-		mainCtr++;
-		mainCtr = mainCtr % divide;
-		lock.unlock();
+	while (cpuRunning) {
+		this_thread::sleep_for(chrono::microseconds(tickMicros));
+		// Counted first, so whoever the tick wakes already sees it in totalTicks.
+		totalTicks++;
+		TickClock::instance().advance(divide);
 	}
 }
 
+struct HeadlessOptions {
+	string configPath = "config.txt";
+	string scriptPath;
+	string outputPath;
+	ll durationTicks = 0;
+	vector<string> overrides;
+	string restorePath;
+};
+
 class MainConsole : public abstract_screen {
 private:
 	string currentView = "MainMenu";
 	bool continue_program = true;
-	map<string, shared_ptr<Screen>> screenList;
+	PooledMap<string, shared_ptr<Screen>> screenList;
 	Scheduler scheduler;
+	MetricsRegistry metrics;
+	MetricsExporter metricsExporter{ metrics };
+	ConfigWatcher configWatcher;
+	// Held while a console or script command runs. config-watch reloads take it too, so they never
+	// interleave with initialize, set or a checkpoint load.
+	timed_mutex commandMutex;
+	CheckpointWriter checkpointWriter;
+	// Guards screenList: scheduler-test adds and archives processes while the console reads it.
+	mutex screenListMutex;
+	ProcessArchive archive;
+	static const ll SCREEN_LIST_PAGE = 50;
+	// Set up by scheduler-test on the console thread (so trace errors are shown), then owned by the test thread.
+	ArrivalGenerator arrivalGenerator;
+	ArrivalLog arrivalLog;
 	atomic<bool> scheduleBool = false;
+	thread testThread;
 	int schedulerCtr = 0;
+	string configPath = "config.txt";
+	vector<string> configOverrides;
 
 	void commandNotRecognize(string command_to_check) {
 		write("Unknown command: " + command_to_check);
@@ -59,7 +112,7 @@ private:
 	}
 
 	bool mainMenuCommand(vector<string> seperatedCommand, string command_to_check) {
-		const set<string> commands = { "initialize", "screen", "scheduler-test", "scheduler-stop", "report-util", "clear", "exit", "vmstat", "process-smi"};
+		const set<string> commands = { "initialize", "screen", "scheduler-test", "scheduler-stop", "report-util", "clear", "exit", "vmstat", "process-smi", "stats", "metrics", "metrics-export", "trace-start", "trace-stop", "log-start", "log-stop", "set", "reconfigure", "config-watch", "checkpoint"};
 
 		if (!commands.count(seperatedCommand[0])) {
 			commandNotRecognize(command_to_check);
@@ -74,7 +127,8 @@ private:
 			return false;
 		}
 
-		if (seperatedCommand[0] != "initialize" && !scheduler.isInitialized()) {
+		bool restoring = seperatedCommand[0] == "checkpoint" && seperatedCommand.size() == 3 && seperatedCommand[1] == "load";
+		if (seperatedCommand[0] != "initialize" && !restoring && !scheduler.isInitialized()) {
 			write("Please initialize the configuration first.");
 			return true;
 		}
@@ -84,7 +138,18 @@ private:
 				invalidCommand(command_to_check);
 				return true;
 			}
-			scheduler.getConfig();
+			vector<string> messages;
+			if (!scheduler.getConfig(configPath, messages, configOverrides)) {
+				for (const auto& error : messages) {
+					write("Error: " + error);
+				}
+				write("Configuration not initialized.");
+				return true;
+			}
+			for (const auto& notice : messages) {
+				write("Note: " + notice);
+			}
+			registerMetrics();
 			write("Configuration initialized.");
 		}
 
@@ -94,14 +159,45 @@ private:
 				invalidCommand(command_to_check);
 				return true;
 			}
-			lock_guard<mutex> lock(scheduler.queueMutex);
+			lock_guard<StatMutex> lock(scheduler.queueMutex);
+			lock_guard<StatMutex> memoryLock(scheduler.memoryMutex);
 			write(string(50, '-'));
 			write("Virtual Memory Statistics (vmstat)");
 			write(string(50, '-'));
 			write("Total Memory: " + to_string(scheduler.getMaxMem()));
 			write("Used Memory: " + to_string(scheduler.getUsedMem()));
 			write("Free Memory: " + to_string(scheduler.getFreeMem()));
+			if (scheduler.getAllocationType() == "paging") {
+				write("Frame Sizes: " + scheduler.getFrameSizes());
+				write("Frames In Use: " + to_string(scheduler.getFramesInUse()));
+			}
+			write("Internal Fragmentation: " + to_string(scheduler.getInternalFragmentation()));
+			write("External Fragmentation: " + to_string(scheduler.getExternalFragmentation()));
+			write("Largest Free Block: " + to_string(scheduler.getLargestFreeBlock()));
+			if (scheduler.getNumaNodes() > 1) {
+				for (int node = 0; node < scheduler.getNumaNodes(); node++) {
+					ll nodeTotal = scheduler.getMaxMem() / scheduler.getNumaNodes();
+					std::stringstream util;
+					util << std::fixed << std::setprecision(2) << scheduler.getNodeUtilization(node);
+					write("Node " + to_string(node) + ": cores " + scheduler.getNodeCores(node) + ", memory " + to_string(nodeTotal - scheduler.getNodeFreeBytes(node))
+						+ "/" + to_string(nodeTotal) + ", utilization " + util.str() + "%");
+				}
+				write("Node-affine dispatches: " + to_string(scheduler.getAffineDispatches()) + ", remote dispatches: " + to_string(scheduler.getRemoteDispatches())
+					+ ", cross-node migrations: " + to_string(scheduler.getNodeMigrations()));
+				write("Remote allocations: " + to_string(scheduler.getRemoteAllocations()) + ", remote stall ticks: " + to_string(scheduler.getRemoteStallTicks()));
+			}
+			if (scheduler.getAllocationType() == "flat") {
+				write(string("Occupancy bitmap kernels: ") + activeBitmapKernels().name);
+				write("Compaction: threshold " + to_string(scheduler.getCompactionThreshold()) + "%, budget " + to_string(scheduler.getCompactionBudget()) + " bytes/tick");
+				write("Blocks relocated: " + to_string(scheduler.getCompactionRelocations()) + " (" + to_string(scheduler.getCompactionBytes()) + " bytes, " + to_string(scheduler.getCompactionPasses()) + " full passes)");
+			}
 			write("");
+			write("Cores: " + to_string(scheduler.getNumCpu()) + ", core threads: " + to_string(scheduler.getCoreThreads())
+				+ ", core resumes: " + to_string(scheduler.getCoreThreadResumes()));
+			write("Process and queue pools: " + to_string(PoolArena::instance().getSlabBytes() / 1024) + " KB in slabs");
+			if (arrivalLog.getArrivals() > 0) {
+				write(arrivalLog.summary());
+			}
 			ll currMainCtr = mainCtr;
 			ll idleTicks = scheduler.getIdleTicks();
 			write("Idle CPU Ticks: " + to_string(idleTicks));
@@ -110,13 +206,257 @@ private:
 			write("");
 			write("Num Paged in: " + to_string(scheduler.getPagesIn()));
 			write("Num Paged out: " + to_string(scheduler.getPagesOut()));
+			write("Bytes swapped in: " + to_string(scheduler.getBytesSwappedIn()));
+			write("Bytes swapped out: " + to_string(scheduler.getBytesSwappedOut()));
+			if (scheduler.getForks() > 0) {
+				write("Forks: " + to_string(scheduler.getForks()) + ", copy-on-write faults: " + to_string(scheduler.getCowFaults()) + " (" + to_string(scheduler.getCowBytesCopied()) + " bytes copied)");
+				write("Shared Frames: " + to_string(scheduler.getSharedFrameCount()) + " (" + to_string(scheduler.getSharedBytesSaved()) + " bytes saved)");
+			}
+			if (scheduler.getSchedulerType() == "fcfs") {
+				write("");
+				write("Waiting for memory: " + to_string(scheduler.getMemoryWaitQueueLength()));
+				write("Admitted after a free: " + to_string(scheduler.getAdmittedFromWait()));
+				write("Backfilled: " + to_string(scheduler.getBackfills()) + ", held for the oldest waiter: " + to_string(scheduler.getStarvationHolds()));
+				write("Failed allocation attempts: " + to_string(scheduler.getFailedAllocations()));
+			}
+		}
+		else if (seperatedCommand[0] == "stats") {
+			if (seperatedCommand.size() > 2 || (seperatedCommand.size() == 2 && seperatedCommand[1] != "reset")) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+#if CSOPESY_STATS
+			if (seperatedCommand.size() == 2) {
+				StatsRegistry::instance().reset();
+				write("Latency statistics reset.");
+				return true;
+			}
+			write(string(50, '-'));
+			write("Latency Statistics (stats), values in microseconds");
+			write(string(50, '-'));
+			stringstream header;
+			header << left << setw(22) << "path" << right << setw(10) << "count" << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "p999" << setw(10) << "max";
+			write(header.str());
+			for (int id = 0; id < STAT_COUNT; id++) {
+				HistogramSnapshot snapshot = StatsRegistry::instance().merged(static_cast<StatId>(id));
+				stringstream row;
+				row << left << setw(22) << statName(id) << right << setw(10) << snapshot.total << fixed << setprecision(1)
+					<< setw(10) << snapshot.percentile(50) / 1000.0
+					<< setw(10) << snapshot.percentile(99) / 1000.0
+					<< setw(10) << snapshot.percentile(99.9) / 1000.0
+					<< setw(10) << snapshot.maxValue / 1000.0;
+				write(row.str());
+			}
+			write(string(50, '-'));
+#else
+			write("Latency statistics are disabled in this build (define CSOPESY_STATS=1).");
+#endif
+		}
+		else if (seperatedCommand[0] == "metrics") {
+			if (!(seperatedCommand.size() == 1)) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			stringstream body(metrics.toPrometheus());
+			string line;
+			while (getline(body, line)) {
+				write(line);
+			}
+		}
+		else if (seperatedCommand[0] == "metrics-export") {
+			if (seperatedCommand.size() < 2 || seperatedCommand.size() > 3) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			if (seperatedCommand[1] == "stop" && seperatedCommand.size() == 2) {
+				metricsExporter.stop();
+				write("Metrics export stopped.");
+			}
+			else if (seperatedCommand[1] == "start") {
+				int intervalMs = 1000;
+				if (seperatedCommand.size() == 3) {
+					try {
+						intervalMs = stoi(seperatedCommand[2]);
+					}
+					catch (...) {
+						invalidCommand(command_to_check);
+						return true;
+					}
+				}
+				filesystem::path currentPath = filesystem::current_path();
+				string jsonPath = (currentPath / "csopesy-metrics.jsonl").string();
+				string socketPath = (currentPath / "csopesy-metrics.sock").string();
+				if (metricsExporter.start(jsonPath, socketPath, intervalMs)) {
+					write("Metrics exported to " + jsonPath + " every " + to_string(intervalMs) + " ms, Prometheus endpoint at " + socketPath);
+				}
+				else {
+					write("Metrics exported to " + jsonPath + " every " + to_string(intervalMs) + " ms (could not open " + socketPath + ")");
+				}
+			}
+			else {
+				invalidCommand(command_to_check);
+			}
+		}
+		else if (seperatedCommand[0] == "set") {
+			if (!(seperatedCommand.size() == 3)) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			SchedulerConfig next = scheduler.currentConfig();
+			vector<string> errors;
+			setConfigValue(next, seperatedCommand[1], seperatedCommand[2], "set", errors);
+			if (errors.empty()) {
+				validateConfig(next, errors);
+			}
+			applyRuntimeConfig(next, errors);
+		}
+		else if (seperatedCommand[0] == "reconfigure") {
+			if (seperatedCommand.size() > 2) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			reconfigureFrom(seperatedCommand.size() == 2 ? seperatedCommand[1] : configPath);
+		}
+		else if (seperatedCommand[0] == "config-watch") {
+			if (!(seperatedCommand.size() == 2)) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			if (seperatedCommand[1] == "on") {
+				configWatcher.start(configPath, [this](stop_token token) {
+					// The console holds commandMutex while it runs "config-watch off", which joins this thread.
+					unique_lock<timed_mutex> lock(commandMutex, defer_lock);
+					while (!lock.try_lock_for(chrono::milliseconds(50))) {
+						if (token.stop_requested()) {
+							return;
+						}
+					}
+					reconfigureFrom(configPath);
+				});
+				write("Watching " + configPath + " for changes.");
+			}
+			else if (seperatedCommand[1] == "off") {
+				configWatcher.stop();
+				write("Stopped watching " + configPath + ".");
+			}
+			else {
+				invalidCommand(command_to_check);
+			}
+		}
+		else if (seperatedCommand[0] == "checkpoint") {
+			if (seperatedCommand.size() == 3 && seperatedCommand[1] == "save") {
+				SchedulerCheckpoint checkpoint = captureCheckpoint();
+				size_t processes = checkpoint.processes.size();
+				checkpointWriter.start([this] { return captureCheckpoint(); });
+				checkpointWriter.save(seperatedCommand[2], move(checkpoint));
+				write("Checkpoint of " + to_string(processes) + " processes is being written to " + seperatedCommand[2] + ".");
+			}
+			else if (restoring) {
+				vector<string> errors;
+				if (!restoreFrom(seperatedCommand[2], errors)) {
+					for (const auto& error : errors) {
+						write("Error: " + error);
+					}
+					write("Checkpoint not restored.");
+				}
+				else {
+					write("Restored " + to_string(screenList.size()) + " processes from " + seperatedCommand[2] + ".");
+				}
+			}
+			else if (seperatedCommand.size() == 3 && seperatedCommand[1] == "auto" && seperatedCommand[2] == "off") {
+				checkpointWriter.setPeriodic("", 0);
+				write("Periodic checkpoints stopped.");
+			}
+			else if (seperatedCommand.size() == 4 && seperatedCommand[1] == "auto") {
+				ll intervalMs = 0;
+				try {
+					intervalMs = stoll(seperatedCommand[3]);
+				}
+				catch (const exception&) {
+				}
+				if (intervalMs <= 0) {
+					invalidCommand(command_to_check);
+					return true;
+				}
+				checkpointWriter.start([this] { return captureCheckpoint(); });
+				checkpointWriter.setPeriodic(seperatedCommand[2], intervalMs);
+				write("Writing a checkpoint to " + seperatedCommand[2] + " every " + to_string(intervalMs) + " ms.");
+			}
+			else if (seperatedCommand.size() == 2 && seperatedCommand[1] == "status") {
+				write("Checkpoints written: " + to_string(checkpointWriter.getWritten()) + ", failed: " + to_string(checkpointWriter.getFailures()));
+				write("Last checkpoint: " + to_string(checkpointWriter.getLastBytes()) + " bytes in " + to_string(checkpointWriter.getLastWriteNs() / 1000000) + " ms");
+				write(string("Periodic checkpoints: ") + (checkpointWriter.isPeriodic() ? "on" : "off"));
+			}
+			else {
+				invalidCommand(command_to_check);
+			}
+		}
+		else if (seperatedCommand[0] == "trace-start") {
+			if (!(seperatedCommand.size() == 1)) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			if (Tracer::instance().isEnabled()) {
+				write("Tracing is already running.");
+				return true;
+			}
+			Tracer::instance().start();
+			write("Tracing started.");
+		}
+		else if (seperatedCommand[0] == "trace-stop") {
+			if (seperatedCommand.size() > 2) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			if (!Tracer::instance().isEnabled()) {
+				write("Tracing is not running.");
+				return true;
+			}
+			string outputFileName = seperatedCommand.size() == 2 ? seperatedCommand[1] : (filesystem::current_path() / "csopesy-trace.json").string();
+			ll eventCount = 0;
+			ll dropped = 0;
+			if (Tracer::instance().stop(outputFileName, eventCount, dropped)) {
+				write("Trace with " + to_string(eventCount) + " events written to " + outputFileName + " (" + to_string(dropped) + " dropped)");
+			}
+			else {
+				write("Could not open " + outputFileName + " for writing.");
+			}
+		}
+		else if (seperatedCommand[0] == "log-start") {
+			if (seperatedCommand.size() < 2 || seperatedCommand.size() > 3 || (seperatedCommand[1] != "shared" && seperatedCommand[1] != "per-process")) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			ProcessLogMode mode = seperatedCommand[1] == "shared" ? PROCESS_LOG_SHARED : PROCESS_LOG_PER_PROCESS;
+			string target = seperatedCommand.size() == 3 ? seperatedCommand[2] : (filesystem::current_path() / (mode == PROCESS_LOG_SHARED ? "process-log.txt" : "process-logs")).string();
+			string error;
+			if (!ProcessLog::instance().start(mode, target, error)) {
+				write("Error: " + error);
+				return true;
+			}
+			write(string("Logging every PRINT ") + (mode == PROCESS_LOG_SHARED ? "to " : "to one file per process in ") + target);
+		}
+		else if (seperatedCommand[0] == "log-stop") {
+			if (!(seperatedCommand.size() == 1)) {
+				invalidCommand(command_to_check);
+				return true;
+			}
+			ProcessLog& log = ProcessLog::instance();
+			if (!log.isEnabled()) {
+				write("Process logging is not running.");
+				return true;
+			}
+			log.stop();
+			write(to_string(log.getLinesWritten()) + " lines (" + to_string(log.getBytesWritten()) + " bytes) in " + to_string(log.getBatchesWritten())
+				+ " batches written to " + log.getPath() + (log.getWriteFailures() > 0 ? ", " + to_string(log.getWriteFailures()) + " writes failed" : ""));
 		}
 		else if (seperatedCommand[0] == "process-smi") {
 			if (!(seperatedCommand.size() == 1)) {
 				invalidCommand(command_to_check);
 				return true;
 			}
-			lock_guard<mutex> lock(scheduler.queueMutex);
+			lock_guard<StatMutex> lock(scheduler.queueMutex);
+			lock_guard<StatMutex> memoryLock(scheduler.memoryMutex);
 			write(string(50, '-'));
 			write(" | PROCESS-SMI V01.00 Driver Version: 01.00 | ");
 			write(string(50, '-'));
@@ -126,13 +466,17 @@ private:
 			ss << std::fixed << std::setprecision(2)
 				<< (static_cast<double>(scheduler.getUsedMem()) * 100.0 / scheduler.getMaxMem());
 			write("Memory-Util: " + ss.str() + "%");
+			if (scheduler.getSharedFrameCount() > 0) {
+				write("Shared Frames: " + to_string(scheduler.getSharedFrameCount()) + " (" + to_string(scheduler.getSharedBytesSaved()) + " bytes saved by forks)");
+			}
 			write("");
 			write(string(50, '='));
-			write("Running processes and memory usage:");
+			write("Running processes and memory usage (private / shared):");
 			write(string(50, '-'));
 			for (const auto& [id, screenPtr] : scheduler.runningScreens) {
 				if (screenPtr != nullptr) {
-					write(screenPtr->getProcessName() + " " + to_string(screenPtr->allocatedMemory));
+					auto [privateBytes, sharedBytes] = scheduler.getResidentSplit(screenPtr);
+					write(screenPtr->getProcessName() + " " + to_string(privateBytes) + " / " + to_string(sharedBytes));
 				}
 			}
 			write(string(50, '-'));
@@ -140,82 +484,58 @@ private:
 		
 
 		else if (seperatedCommand[0] == "screen") {
-			if (seperatedCommand.size() < 2 || seperatedCommand.size() > 3) {
-				invalidCommand(command_to_check);
+			if (seperatedCommand.size() >= 2 && seperatedCommand[1] == "-ls") {
+				listScreens(seperatedCommand, command_to_check);
 				return true;
 			}
-
-			if (seperatedCommand.size() == 2) {
-				if (!(seperatedCommand[1] == "-ls")) {
-					invalidCommand(command_to_check);
-					return true;
-				}
-				vector<Screen> processingScreens;
-				vector<Screen> finishedScreens;
-				{
-					lock_guard<mutex> lock(scheduler.queueMutex);
-					write("CPU utilization: " + scheduler.getCpuUtilization());
-					write("Cores used: " + to_string(scheduler.getCoresUsed()));
-					write("Cores available: " + to_string(scheduler.getCoresAvail()));
-
-					for (const auto& [_, sc] : screenList) {
-						if (sc->isFinished()) {
-							finishedScreens.push_back(*sc); // Copy the Screen object
-							cout << endl;
-						}
-					}
-					for (const auto& [id, screenPtr] : scheduler.runningScreens) {
-						if (screenPtr != nullptr) {
-							processingScreens.push_back(*screenPtr); // Copy the Screen object
-						}
-					}
-				}
-				write("");
-				write("--------------------------------------");
-				write("Running processes:");
-
-				for (auto sc : processingScreens) {
-					write(sc.listProcess());
-				}
-				write("\nFinished processes:");
-				for (auto sc : finishedScreens) {
-					write(sc.listProcess());
-				}
-				write("--------------------------------------");
+			if (seperatedCommand.size() < 3 || seperatedCommand.size() > 4 || (seperatedCommand.size() == 4 && seperatedCommand[1] != "-f")) {
+				invalidCommand(command_to_check);
+				return true;
 			}
-
-			else if (seperatedCommand[1] == "-r") {
-				if (!screenList.count(seperatedCommand[2])) {
+			if (seperatedCommand[1] == "-r") {
+				shared_ptr<Screen> sc = findScreen(seperatedCommand[2]);
+				if (sc == nullptr) {
 					screenNotFound(seperatedCommand[2]);
 					return true;
 				}
-				currentView = screenList[seperatedCommand[2]]->getProcessName();
-				if (screenList[seperatedCommand[2]]->isFinished()) {
+				currentView = sc->getProcessName();
+				if (sc->isFinished()) {
 					write("This Process is already finished.");
 					currentView = "MainMenu";
 					return true;
 				}
-				if (screenList[seperatedCommand[2]]->isInitialized()) {
-					screenList[seperatedCommand[2]]->redraw();
+				if (sc->isInitialized()) {
+					sc->redraw();
 					processCommand("process-smi");
-					screenList[seperatedCommand[2]]->add("root:\\> process-smi");
+					sc->add("root:\\> process-smi");
 				}
 				else {
-					screenList[seperatedCommand[2]]->openScreen();
-					screenList[seperatedCommand[2]]->initialize();
+					sc->openScreen();
+					sc->initialize();
 				}
 			}
+			else if (seperatedCommand[1] == "-f") {
+				// screen -f <parent> <child>: child continues parent's program, sharing its frames copy-on-write.
+				if (seperatedCommand.size() != 4) {
+					invalidCommand(command_to_check);
+					return true;
+				}
+				forkScreen(seperatedCommand[2], seperatedCommand[3]);
+			}
 			else if (seperatedCommand[1] == "-s") {
-				if (screenList.count(seperatedCommand[2])) {
+				if (findScreen(seperatedCommand[2]) != nullptr) {
 					write("This Process is already in use.");
 					return true;
 				}
-				auto sc = make_shared<Screen>(seperatedCommand[2], scheduler.getMinIns(), scheduler.getMaxIns(), scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc());
-				screenList[seperatedCommand[2]] = sc;
-				screenList[seperatedCommand[2]]->openScreen();
-				screenList[seperatedCommand[2]]->initialize();
-				currentView = screenList[seperatedCommand[2]]->getProcessName();
-				lock_guard<mutex> lock(scheduler.queueMutex);
+				auto sc = makeScreen(seperatedCommand[2], scheduler.getMinIns(), scheduler.getMaxIns(), scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc());
+				{
+					lock_guard<mutex> lock(screenListMutex);
+					screenList[seperatedCommand[2]] = sc;
+				}
+				sc->openScreen();
+				sc->initialize();
+				currentView = sc->getProcessName();
+				lock_guard<StatMutex> lock(scheduler.queueMutex);
 				scheduler.pushQueue(sc);
 			}
 			else {
@@ -227,7 +547,7 @@ private:
 				invalidCommand(command_to_check);
 				return true;
 			}
-			system("cls");
+			clearConsole();
 			this->buffer.clear();
 			print_header();
 		}
@@ -240,9 +560,23 @@ private:
 				write("Scheduler is already running.");
 			}
 			else {
+				if (testThread.joinable()) {
+					testThread.join();
+				}
+				ArrivalSettings arrivals = scheduler.getArrivalSettings();
+				bool openLoop = arrivals.process != "fixed";
+				if (openLoop) {
+					string error;
+					if (!arrivalGenerator.start(arrivals, scheduler.getMaxMem(), error)) {
+						write("Error: " + error);
+						return true;
+					}
+					if (arrivals.process == "trace") {
+						write("Replaying " + to_string(arrivalGenerator.getTraceSize()) + " arrivals from " + arrivals.tracePath + ".");
+					}
+				}
 				scheduleBool = true;
-				thread testThread(&MainConsole::schedulerTest, this);
-				testThread.detach();
+				testThread = thread(&MainConsole::schedulerTest, this, openLoop);
 				write("Scheduler Test started.");
 			}
 		}
@@ -251,7 +585,7 @@ private:
 				invalidCommand(command_to_check);
 				return true;
 			}
-			scheduleBool = false;
+			stopSchedulerTest();
 			write("Scheduler Test stopped.");
 		}
 		else if (seperatedCommand[0] == "report-util") {
@@ -262,21 +596,23 @@ private:
 			filesystem::path currentPath = filesystem::current_path();
 			string outputFileName = (currentPath / "csopesy-log.txt").string();
 			ofstream outFile(outputFileName);
-			vector<Screen> processingScreens;
-			vector<Screen> finishedScreens;
+			archiveFinished();
+			vector<shared_ptr<Screen>> processingScreens;
+			vector<shared_ptr<Screen>> finishedScreens;
 			{
-				lock_guard<mutex> lock(scheduler.queueMutex);
+				lock_guard<StatMutex> lock(scheduler.queueMutex);
 				outFile << "CPU utilization: " << scheduler.getCpuUtilization() << endl;
 				outFile << "Cores used: " << scheduler.getCoresUsed() << endl;
 				outFile << "Cores available: " << scheduler.getCoresAvail() << endl;
+				lock_guard<mutex> listLock(screenListMutex);
 				for (const auto& [_, sc] : screenList) {
 					if (sc->isFinished()) {
-						finishedScreens.push_back(*sc); // Copy the Screen object
+						finishedScreens.push_back(sc);
 					}
 				}
 				for (const auto& [id, screenPtr] : scheduler.runningScreens) {
 					if (screenPtr != nullptr) {
-						processingScreens.push_back(*screenPtr); // Copy the Screen object
+						processingScreens.push_back(screenPtr);
 					}
 				}
 			}
@@ -284,13 +620,16 @@ private:
 			outFile << endl;
 			outFile << "--------------------------------------" << endl;
 			outFile << "Running processes:" << endl;
-			for (auto sc : processingScreens) {
-				outFile << sc.listProcess() << endl;
+			for (const auto& sc : processingScreens) {
+				outFile << sc->listProcess() << endl;
 			}
 			outFile << endl
 				<< "Finished processes:" << endl;
-			for (auto sc : finishedScreens) {
-				outFile << sc.listProcess() << endl;
+			for (const auto& sc : finishedScreens) {
+				outFile << sc->listProcess() << endl;
+			}
+			if (archive.size() > 0) {
+				outFile << endl << archive.summary() << endl;
 			}
 			outFile << "--------------------------------------";
 			outFile.close();
@@ -300,32 +639,371 @@ private:
 		return true;
 	}	
 
-	void schedulerTest() {
-		ll freq = scheduler.getBatchProcessFrequency();
+	void reconfigureFrom(const string& path) {
+		SchedulerConfig next;
+		vector<string> errors;
+		readConfigFile(path, next, errors, configOverrides);
+		applyRuntimeConfig(next, errors);
+	}
+
+	// Hands a validated config to the running scheduler and reports what changed; errors from
+	// reading or validating it leave the configuration as it was.
+	void applyRuntimeConfig(const SchedulerConfig& next, const vector<string>& errors) {
+		if (!errors.empty()) {
+			scheduler.recordRejectedConfig();
+			for (const auto& error : errors) {
+				write("Error: " + error);
+			}
+			write("Configuration unchanged.");
+			return;
+		}
+		vector<string> applied;
+		vector<string> rejected;
+		bool ok = scheduler.reconfigure(next, applied, rejected);
+		for (const auto& change : applied) {
+			write("Applied " + change);
+		}
+		for (const auto& reason : rejected) {
+			write("Rejected " + reason);
+		}
+		if (!ok) {
+			write("Configuration unchanged.");
+		}
+		else if (applied.empty()) {
+			write("No runtime-changeable settings differ from the running configuration.");
+		}
+	}
+
+	void registerMetrics() {
+		metrics.clear();
+		scheduler.registerMetrics(metrics);
+		metrics.addCounter("csopesy_checkpoints_written_total", "Checkpoints written to disk.", [this] { return (double)checkpointWriter.getWritten(); });
+		metrics.addCounter("csopesy_checkpoint_failures_total", "Checkpoints that could not be written.", [this] { return (double)checkpointWriter.getFailures(); });
+		metrics.addGauge("csopesy_checkpoint_last_bytes", "Size of the last checkpoint written.", [this] { return (double)checkpointWriter.getLastBytes(); });
+	}
+
+	SchedulerCheckpoint captureCheckpoint() {
+		vector<shared_ptr<Screen>> registry;
+		ll nextProcessId;
+		{
+			lock_guard<mutex> lock(screenListMutex);
+			for (const auto& [_, sc] : screenList) {
+				registry.push_back(sc);
+			}
+			nextProcessId = schedulerCtr;
+		}
+		SchedulerCheckpoint checkpoint = scheduler.captureCheckpoint(registry);
+		checkpoint.nextProcessId = nextProcessId;
+		return checkpoint;
+	}
+
+	// Stops scheduler-test, since its process names and queue belong to the state being replaced.
+	bool restoreFrom(const string& path, vector<string>& errors) {
+		SchedulerCheckpoint checkpoint;
+		string error;
+		if (!readCheckpointFile(path, checkpoint, error)) {
+			errors.push_back(path + ": " + error);
+			return false;
+		}
+		stopSchedulerTest();
+		vector<shared_ptr<Screen>> registry;
+		if (!scheduler.restoreCheckpoint(checkpoint, configOverrides, registry, errors)) {
+			return false;
+		}
+		{
+			lock_guard<mutex> lock(screenListMutex);
+			screenList.clear();
+			archive.clear();
+			arrivalLog.clear();
+			for (const auto& sc : registry) {
+				screenList[sc->getProcessName()] = sc;
+			}
+			schedulerCtr = static_cast<int>(checkpoint.nextProcessId);
+		}
+		registerMetrics();
+		return true;
+	}
+
+	void stopSchedulerTest() {
+		scheduleBool = false;
+		if (testThread.joinable()) {
+			testThread.join();
+		}
+	}
+
+	// Creates child from parent and queues it. Writes why if it cannot share the parent's memory.
+	void forkScreen(const string& parentName, const string& childName) {
+		shared_ptr<Screen> parent = findScreen(parentName);
+		if (parent == nullptr) {
+			screenNotFound(parentName);
+			return;
+		}
+		if (findScreen(childName) != nullptr) {
+			write("This Process is already in use.");
+			return;
+		}
+		if (parent->isFinished()) {
+			write("This Process is already finished.");
+			return;
+		}
+		auto child = makeScreen(parent->forkState(childName));
+		{
+			lock_guard<mutex> lock(screenListMutex);
+			screenList[childName] = child;
+		}
+		if (scheduler.forkMemory(parent, child)) {
+			write("Forked " + parentName + " into " + childName + "; memory is shared until written.");
+		}
+		else {
+			write("Forked " + parentName + " into " + childName + "; " + parentName + " has no shared memory to give, so " + childName + " gets its own.");
+		}
+		lock_guard<StatMutex> lock(scheduler.queueMutex);
+		scheduler.pushQueue(child);
+	}
+
+	// Creates count scheduler-test processes with one pass over the process list and one over the
+	// ready queue. previous is the last process created fresh, which forks are taken from.
+	void createBatch(ll count, shared_ptr<Screen>& previous) {
+		vector<shared_ptr<Screen>> batch;
+		vector<pair<shared_ptr<Screen>, shared_ptr<Screen>>> forks;
+		batch.reserve(count);
+		{
+			lock_guard<mutex> listLock(screenListMutex);
+			for (ll i = 0; i < count; i++) {
+				string processName = nextProcessName();
+				bool fork = previous != nullptr && !previous->isFinished() && rand() % 100 < scheduler.getForkPercent();
+				auto sc = fork ? makeScreen(previous->forkState(processName))
+					: makeScreen(processName, scheduler.getMinIns(), scheduler.getMaxIns(), scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc());
+				screenList[processName] = sc;
+				if (fork) {
+					forks.emplace_back(previous, sc);
+				}
+				else {
+					previous = sc;
+				}
+				batch.push_back(sc);
+			}
+		}
+		for (const auto& [parent, child] : forks) {
+			scheduler.forkMemory(parent, child);
+		}
+		lock_guard<StatMutex> lock(scheduler.queueMutex);
+		for (const auto& sc : batch) {
+			scheduler.pushQueue(sc);
+		}
+	}
+
+	// Creates one process per arrival, with the arrival's instructions, memory and priority.
+	void createArrivals(const vector<Arrival>& arrivals) {
+		vector<shared_ptr<Screen>> batch;
+		batch.reserve(arrivals.size());
+		{
+			lock_guard<mutex> listLock(screenListMutex);
+			for (const auto& arrival : arrivals) {
+				ScreenState state;
+				state.processName = nextProcessName();
+				state.totalLine = static_cast<int>(arrival.instructions);
+				state.memory = static_cast<int>(arrival.memory);
+				state.priority = arrival.priority;
+				state.timestamp = static_cast<ll>(time(nullptr));
+				state.createdAt = nowNs();
+				auto sc = makeScreen(state);
+				screenList[state.processName] = sc;
+				batch.push_back(sc);
+			}
+		}
+		lock_guard<StatMutex> lock(scheduler.queueMutex);
+		for (const auto& sc : batch) {
+			scheduler.pushQueue(sc);
+		}
+	}
+
+	// The first unused "p<n>" name. Caller holds screenListMutex.
+	string nextProcessName() {
+		while (true) {
+			string processName = "p" + to_string(schedulerCtr);
+			if (!screenList.count(processName)) {
+				return processName;
+			}
+			schedulerCtr++;
+		}
+	}
+
+	// Moves processes the cores reported finished from the process list into the archive. A name
+	// that now belongs to another process (after a restore) is left alone.
+	void archiveFinished() {
+		vector<shared_ptr<Screen>> finished;
+		scheduler.takeFinished(finished);
+		if (finished.empty()) {
+			return;
+		}
+		lock_guard<mutex> lock(screenListMutex);
+		for (const auto& sc : finished) {
+			auto it = screenList.find(sc->getProcessName());
+			if (it != screenList.end() && it->second == sc) {
+				archive.add(*sc);
+				screenList.erase(it);
+			}
+		}
+	}
+
+	// screen -ls [running|finished|archived] [-p page] [-n name-filter]: one page of matching
+	// processes, running first, then finished, then the most recently archived.
+	void listScreens(const vector<string>& args, const string& command) {
+		string category = "all";
+		ll page = 1;
+		string filter;
+		for (size_t i = 2; i < args.size(); i++) {
+			if (args[i] == "running" || args[i] == "finished" || args[i] == "archived") {
+				category = args[i];
+			}
+			else if (args[i] == "-p" && i + 1 < args.size()) {
+				try {
+					page = stoll(args[++i]);
+				}
+				catch (...) {
+					page = 0;
+				}
+				if (page < 1) {
+					invalidCommand(command);
+					return;
+				}
+			}
+			else if (args[i] == "-n" && i + 1 < args.size()) {
+				filter = args[++i];
+			}
+			else {
+				invalidCommand(command);
+				return;
+			}
+		}
+		archiveFinished();
+
+		// Only the requested page is copied out, so listing stays cheap with millions of processes.
+		ll first = (page - 1) * SCREEN_LIST_PAGE;
+		ll index = 0;
+		auto take = [&](vector<shared_ptr<Screen>>& out, const shared_ptr<Screen>& sc) {
+			if (!filter.empty() && sc->getProcessName().find(filter) == string::npos) {
+				return;
+			}
+			if (index >= first && index < first + SCREEN_LIST_PAGE) {
+				out.push_back(sc);
+			}
+			index++;
+		};
+		vector<shared_ptr<Screen>> processingScreens;
+		vector<shared_ptr<Screen>> finishedScreens;
+		vector<ArchivedProcess> archivedScreens;
+		{
+			lock_guard<StatMutex> lock(scheduler.queueMutex);
+			write("CPU utilization: " + scheduler.getCpuUtilization());
+			write("Cores used: " + to_string(scheduler.getCoresUsed()));
+			write("Cores available: " + to_string(scheduler.getCoresAvail()));
+			if (category == "all" || category == "running") {
+				for (const auto& [id, screenPtr] : scheduler.runningScreens) {
+					if (screenPtr != nullptr) {
+						take(processingScreens, screenPtr);
+					}
+				}
+			}
+			if (category == "all" || category == "finished") {
+				lock_guard<mutex> listLock(screenListMutex);
+				for (const auto& [_, sc] : screenList) {
+					if (sc->isFinished()) {
+						take(finishedScreens, sc);
+					}
+				}
+			}
+		}
+		if (category == "all" || category == "archived") {
+			for (auto& entry : archive.recentMatching(filter)) {
+				if (index >= first && index < first + SCREEN_LIST_PAGE) {
+					archivedScreens.push_back(move(entry));
+				}
+				index++;
+			}
+		}
+
+		write("");
+		write("--------------------------------------");
+		if (category == "all" || category == "running") {
+			write("Running processes:");
+			for (const auto& sc : processingScreens) {
+				write(sc->listProcess());
+			}
+		}
+		if (category == "all" || category == "finished") {
+			write("\nFinished processes:");
+			for (const auto& sc : finishedScreens) {
+				write(sc->listProcess());
+			}
+		}
+		if (archive.size() > 0 && (category == "all" || category == "archived")) {
+			write("\nArchived processes (last " + to_string(ProcessArchive::RECENT_LIMIT) + " kept):");
+			for (const auto& entry : archivedScreens) {
+				write(entry.listing);
+			}
+		}
+		write("--------------------------------------");
+		ll pages = max(1LL, (index + SCREEN_LIST_PAGE - 1) / SCREEN_LIST_PAGE);
+		ll shownFrom = min(first + 1, index);
+		ll shownTo = min(first + SCREEN_LIST_PAGE, index);
+		write("Showing " + to_string(shownFrom) + "-" + to_string(shownTo) + " of " + to_string(index) + " (page " + to_string(page) + " of " + to_string(pages) + ")");
+		if (archive.size() > 0) {
+			write(archive.summary());
+		}
+	}
+
+	shared_ptr<Screen> findScreen(const string& name) {
+		lock_guard<mutex> lock(screenListMutex);
+		auto it = screenList.find(name);
+		return it == screenList.end() ? nullptr : it->second;
+	}
+
+	// Open-loop scheduler-test: each tick queues everything the generator says has arrived by then,
+	// however far behind that leaves the scheduler. A replayed trace ends the test when it runs out.
+	void runArrivals() {
+		ll startTick = totalTicks;
+		ll seen = -1;
+		vector<Arrival> batch;
+		while (scheduleBool) {
+			TickClock::instance().waitPast(seen);
+			batch.clear();
+			arrivalGenerator.due(static_cast<double>(totalTicks - startTick), scheduler.getMinIns(), scheduler.getMaxIns(), scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc(), batch);
+			if (!batch.empty()) {
+				createArrivals(batch);
+				arrivalLog.record(batch, totalTicks - startTick);
+			}
+			archiveFinished();
+			if (arrivalGenerator.exhausted()) {
+				scheduleBool = false;
+			}
+		}
+	}
+
+	void schedulerTest(bool openLoop) {
+		if (openLoop) {
+			runArrivals();
+			return;
+		}
 		ll ctr = 1;
-		int prevCtr = -1;
+		ll prevCtr = -1;
+		shared_ptr<Screen> previous;
 		while (scheduleBool) {
-			if (ctr >= freq) {
+			if (ctr >= scheduler.getBatchProcessFrequency()) {
 				ctr = 1;
-				string processName;
-				while (true) {
-					processName = "p" + to_string(schedulerCtr);
-					if (!screenList.count(processName)) {
-						break;
-					}
-					schedulerCtr++;
+				ll delayMs = scheduler.getBatchProcessDelayMs();
+				this_thread::sleep_for(chrono::milliseconds(delayMs));
+				createBatch(scheduler.getBatchProcessSize(), previous);
+				archiveFinished();
+				// Without the delay, batch-process-freq 1 still means one batch per tick.
+				if (delayMs == 0) {
+					TickClock::instance().waitPast(prevCtr);
 				}
-				this_thread::sleep_for(chrono::milliseconds(400));
-				auto sc = make_shared<Screen>(processName, scheduler.getMinIns(), scheduler.getMaxIns(),scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc());
-				screenList[processName] = sc;
-				lock_guard<mutex> lock(scheduler.queueMutex);
-				scheduler.pushQueue(sc);
 			}
 			else {
-				if (prevCtr != mainCtr) {
-					ctr++;
-					prevCtr = mainCtr;
-				}
+				TickClock::instance().waitPast(prevCtr);
+				ctr++;
 			}
 		}
 	}
@@ -350,7 +1028,14 @@ private:
 			return mainMenuCommand(seperatedCommand, command_to_check);
 		}
 		else {
-			if (screenList[currentView]->screenCommand(seperatedCommand, command_to_check)) {
+			shared_ptr<Screen> sc = findScreen(currentView);
+			if (sc == nullptr) {
+				// Finished and archived while it was on screen.
+				currentView = "MainMenu";
+				this->redraw();
+				write("That process has finished and was archived.");
+			}
+			else if (sc->screenCommand(seperatedCommand, command_to_check)) {
 				currentView = "MainMenu";
 				this->redraw();
 			}
@@ -374,7 +1059,233 @@ private:
 		write("Type 'exit' to quit, 'clear' to clear the screen", 14);
 	}
 
+	static ll percentileOf(vector<ll>& values, double p) {
+		if (values.empty()) {
+			return 0;
+		}
+		sort(values.begin(), values.end());
+		size_t idx = static_cast<size_t>(ceil(p / 100.0 * values.size()));
+		return values[min(values.size() - 1, idx == 0 ? 0 : idx - 1)];
+	}
+
+	static double meanOf(const vector<ll>& values) {
+		if (values.empty()) {
+			return 0;
+		}
+		double sum = 0;
+		for (ll value : values) {
+			sum += value;
+		}
+		return sum / values.size();
+	}
+
+	struct LatencySummary {
+		double mean = 0;
+		ll p50 = 0;
+		ll p99 = 0;
+	};
+
+	// Exact over values while nothing is archived; otherwise values join the archive's histogram
+	// and sums, and the percentiles carry the histogram's bucket error.
+	static LatencySummary summarize(vector<ll>& values, HistogramSnapshot& archived, ll archivedSum, ll archivedCount) {
+		LatencySummary summary;
+		if (archivedCount == 0) {
+			summary.mean = meanOf(values);
+			summary.p50 = percentileOf(values, 50);
+			summary.p99 = percentileOf(values, 99);
+			return summary;
+		}
+		double sum = static_cast<double>(archivedSum);
+		for (ll value : values) {
+			ull sample = static_cast<ull>(max(value, 0LL));
+			archived.counts[LatencyHistogram::bucketOf(sample)]++;
+			archived.total++;
+			archived.maxValue = max(archived.maxValue, sample);
+			sum += value;
+		}
+		summary.mean = sum / (archivedCount + values.size());
+		summary.p50 = static_cast<ll>(archived.percentile(50));
+		summary.p99 = static_cast<ll>(archived.percentile(99));
+		return summary;
+	}
+
+	// Blocks until the tick counter has advanced by `ticks` since `fromTick`.
+	static void waitTicks(ll fromTick, ll ticks) {
+		while (totalTicks - fromTick < ticks) {
+			this_thread::sleep_for(chrono::microseconds(max(tickMicros / 4, 100LL)));
+		}
+	}
+
+	// Runs one script line: either a console command or "wait <n>" which sleeps for n ticks.
+	bool runScriptLine(const string& line) {
+		stringstream stream(line);
+		string first;
+		stream >> first;
+		if (first.empty() || first[0] == '#') {
+			return true;
+		}
+		if (first == "wait") {
+			ll ticks = 0;
+			stream >> ticks;
+			waitTicks(totalTicks, ticks);
+			return true;
+		}
+		add("root:\\> " + line);
+		lock_guard<timed_mutex> lock(commandMutex);
+		return processCommand(line);
+	}
+
+	void writeSummary(const HeadlessOptions& options, ll ticks, double wallSeconds) {
+		vector<ll> turnaround;
+		vector<ll> response;
+		ll created;
+		{
+			lock_guard<mutex> lock(screenListMutex);
+			created = screenList.size();
+			for (const auto& [_, sc] : screenList) {
+				if (sc->firstRunAt != 0) {
+					response.push_back((sc->firstRunAt - sc->createdAt) / 1000);
+				}
+				if (sc->isFinished() && sc->finishedAt != 0) {
+					turnaround.push_back((sc->finishedAt - sc->createdAt) / 1000);
+				}
+			}
+		}
+		ll turnaroundSum, turnaroundCount, responseSum, responseCount;
+		archive.totals(turnaroundSum, turnaroundCount, responseSum, responseCount);
+		HistogramSnapshot archivedTurnaround;
+		HistogramSnapshot archivedResponse;
+		archive.histograms(archivedTurnaround, archivedResponse);
+		created += turnaroundCount;
+		ll finished = turnaround.size() + turnaroundCount;
+		LatencySummary turnaroundSummary = summarize(turnaround, archivedTurnaround, turnaroundSum, turnaroundCount);
+		LatencySummary responseSummary = summarize(response, archivedResponse, responseSum, responseCount);
+		ll arrivals = arrivalLog.getArrivals();
+		ll idleTicks = scheduler.isInitialized() ? scheduler.getIdleTicks() : 0;
+		double perKiloTick = ticks > 0 ? finished * 1000.0 / ticks : 0;
+		double perSecond = wallSeconds > 0 ? finished / wallSeconds : 0;
+
+		cout << fixed << setprecision(2);
+		cout << "Ticks: " << ticks << " (" << wallSeconds << " s)" << endl;
+		cout << "Processes created: " << created << ", finished: " << finished << endl;
+		cout << "Throughput: " << perKiloTick << " processes per 1000 ticks, " << perSecond << " per second" << endl;
+		cout << "Turnaround (us): mean " << turnaroundSummary.mean << ", p50 " << turnaroundSummary.p50 << ", p99 " << turnaroundSummary.p99 << endl;
+		cout << "Response (us): mean " << responseSummary.mean << ", p50 " << responseSummary.p50 << ", p99 " << responseSummary.p99 << endl;
+		if (arrivals > 0) {
+			cout << arrivalLog.summary() << endl;
+		}
+		if (scheduler.isInitialized()) {
+			cout << "Idle CPU ticks: " << idleTicks << ", pages in: " << scheduler.getPagesIn() << ", pages out: " << scheduler.getPagesOut() << endl;
+		}
+
+		if (options.outputPath.empty()) {
+			return;
+		}
+		ofstream outFile(options.outputPath);
+		if (!outFile.is_open()) {
+			cerr << "Could not open " << options.outputPath << " for writing." << endl;
+			return;
+		}
+		outFile << fixed << setprecision(3);
+		outFile << "{" << endl;
+		outFile << "  \"config\": \"" << options.configPath << "\"," << endl;
+		outFile << "  \"overrides\": [";
+		for (size_t i = 0; i < options.overrides.size(); i++) {
+			outFile << (i ? ", " : "") << "\"" << options.overrides[i] << "\"";
+		}
+		outFile << "]," << endl;
+		outFile << "  \"script\": \"" << options.scriptPath << "\"," << endl;
+		outFile << "  \"ticks\": " << ticks << "," << endl;
+		outFile << "  \"wall_seconds\": " << wallSeconds << "," << endl;
+		outFile << "  \"processes_created\": " << created << "," << endl;
+		outFile << "  \"processes_finished\": " << finished << "," << endl;
+		outFile << "  \"throughput_per_1000_ticks\": " << perKiloTick << "," << endl;
+		outFile << "  \"throughput_per_second\": " << perSecond << "," << endl;
+		outFile << "  \"turnaround_us\": {\"mean\": " << turnaroundSummary.mean << ", \"p50\": " << turnaroundSummary.p50 << ", \"p99\": " << turnaroundSummary.p99 << "}," << endl;
+		outFile << "  \"response_us\": {\"mean\": " << responseSummary.mean << ", \"p50\": " << responseSummary.p50 << ", \"p99\": " << responseSummary.p99 << "}," << endl;
+		outFile << "  \"processes_archived\": " << turnaroundCount << "," << endl;
+		outFile << "  \"arrivals\": " << arrivals << "," << endl;
+		outFile << "  \"arrivals_late\": " << arrivalLog.getLate() << "," << endl;
+		outFile << "  \"arrival_lag_ticks\": {\"mean\": " << arrivalLog.getMeanLag() << ", \"p99\": " << arrivalLog.getLagPercentile(99) << ", \"max\": " << arrivalLog.getMaxLag() << "}," << endl;
+		outFile << "  \"idle_cpu_ticks\": " << idleTicks << "," << endl;
+		outFile << "  \"pages_in\": " << (scheduler.isInitialized() ? scheduler.getPagesIn() : 0) << "," << endl;
+		outFile << "  \"pages_out\": " << (scheduler.isInitialized() ? scheduler.getPagesOut() : 0) << endl;
+		outFile << "}" << endl;
+	}
+
 public:
+	~MainConsole() {
+		configWatcher.stop();
+		checkpointWriter.stop();
+		stopSchedulerTest();
+	}
+
+	// Non-interactive entry point: restores the checkpoint if one was given, runs the script (or
+	// initialize + scheduler-test when there is none), keeps going until the duration has elapsed,
+	// then stops every thread and prints a summary.
+	int runHeadless(const HeadlessOptions& options) {
+		rendering = false;
+		configPath = options.configPath;
+		configOverrides = options.overrides;
+		SchedulerConfig config;
+		vector<string> errors;
+		if (!options.restorePath.empty()) {
+			if (!restoreFrom(options.restorePath, errors)) {
+				for (const auto& error : errors) {
+					cerr << "Restore error: " << error << endl;
+				}
+				return 2;
+			}
+		}
+		else if (!readConfigFile(configPath, config, errors, configOverrides)) {
+			for (const auto& error : errors) {
+				cerr << "Config error: " << error << endl;
+			}
+			return 2;
+		}
+		ll startTick = totalTicks;
+		ll startNs = nowNs();
+
+		vector<string> lines;
+		if (options.scriptPath.empty()) {
+			if (options.restorePath.empty()) {
+				lines = { "initialize", "scheduler-test" };
+			}
+			else {
+				lines = { "scheduler-test" };
+			}
+		}
+		else {
+			ifstream script(options.scriptPath);
+			if (!script.is_open()) {
+				cerr << "Could not open script " << options.scriptPath << endl;
+				return 1;
+			}
+			string line;
+			while (getline(script, line)) {
+				lines.push_back(line);
+			}
+		}
+		for (const auto& line : lines) {
+			if (!runScriptLine(line)) {
+				break;
+			}
+		}
+		if (!scheduler.isInitialized()) {
+			cerr << "The script never initialized the scheduler; add \"initialize\" or \"checkpoint load <file>\" to " << options.scriptPath << endl;
+			return 2;
+		}
+		if (options.durationTicks > 0) {
+			waitTicks(startTick, options.durationTicks);
+		}
+
+		configWatcher.stop();
+		stopSchedulerTest();
+		scheduler.stop();
+		writeSummary(options, totalTicks - startTick, (nowNs() - startNs) / 1e9);
+		return 0;
+	}
+
 	void run() {
 		string user_input;
 
@@ -382,22 +1293,133 @@ public:
 		print_header();
 		while (continue_program) {
 			cout << "root:\\> ";
-			getline(cin, user_input);
-			if (currentView != "MainMenu") {
-				screenList[currentView]->add("root:\\> " + user_input);
+			if (!getline(cin, user_input)) {
+				break;
+			}
+			shared_ptr<Screen> viewed = currentView != "MainMenu" ? findScreen(currentView) : nullptr;
+			if (viewed != nullptr) {
+				viewed->add("root:\\> " + user_input);
 			}
 			else {
 				add("root:\\> " + user_input);
 			}
+			lock_guard<timed_mutex> lock(commandMutex);
 			continue_program = processCommand(user_input);
 		}
 	}
 };
 
-signed main() {
+// Accepts "100000", "100000ticks", "500ms" or "2s"; time-based values are converted with the tick period.
+ll parseDuration(const string& text) {
+	size_t unitAt = text.find_first_not_of("0123456789");
+	ll value = stoll(text.substr(0, unitAt));
+	string unit = unitAt == string::npos ? "ticks" : text.substr(unitAt);
+	if (unit == "ticks") {
+		return value;
+	}
+	if (unit == "ms") {
+		return value * 1000 / tickMicros;
+	}
+	if (unit == "s") {
+		return value * 1000000 / tickMicros;
+	}
+	throw invalid_argument("unknown duration unit " + unit);
+}
+
+void printUsage() {
+	cerr << "Usage: csopesy [--config file] [--script file] [--duration N[ticks|ms|s]] [--tick-us N] [--out results.json] [--set key=value]... [--restore checkpoint]" << endl;
+	cerr << "       csopesy --sweep spec.txt [--samples N] [--seed N] [--jobs N] [--config file] [--set key=value]... [--duration N] [--tick-us N] [--out results.csv|json]" << endl;
+	cerr << "With no arguments the interactive console starts." << endl;
+}
+
+signed main(int argc, char* argv[]) {
+	HeadlessOptions options;
+	SweepOptions sweep;
+	string durationText;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (i + 1 >= argc) {
+			printUsage();
+			return 1;
+		}
+		try {
+			if (arg == "--config") {
+				options.configPath = argv[++i];
+			}
+			else if (arg == "--script") {
+				options.scriptPath = argv[++i];
+			}
+			else if (arg == "--duration") {
+				durationText = argv[++i];
+			}
+			else if (arg == "--out") {
+				options.outputPath = argv[++i];
+			}
+			else if (arg == "--restore") {
+				options.restorePath = argv[++i];
+			}
+			else if (arg == "--set") {
+				options.overrides.push_back(argv[++i]);
+			}
+			else if (arg == "--tick-us") {
+				tickMicros = max(1LL, stoll(argv[++i]));
+			}
+			else if (arg == "--sweep") {
+				sweep.specPath = argv[++i];
+			}
+			else if (arg == "--jobs") {
+				sweep.jobs = max(0, stoi(argv[++i]));
+			}
+			else if (arg == "--samples") {
+				sweep.samples = max(0LL, stoll(argv[++i]));
+			}
+			else if (arg == "--seed") {
+				sweep.seed = stoll(argv[++i]);
+			}
+			else {
+				printUsage();
+				return 1;
+			}
+		}
+		catch (const exception&) {
+			printUsage();
+			return 1;
+		}
+	}
+	if (!durationText.empty()) {
+		try {
+			options.durationTicks = parseDuration(durationText);
+		}
+		catch (const exception&) {
+			printUsage();
+			return 1;
+		}
+	}
+
+	// Sweeps run their simulators on clocks of their own, so the console's clock is not started.
+	if (!sweep.specPath.empty()) {
+		sweep.configPath = options.configPath;
+		sweep.outputPath = options.outputPath;
+		sweep.overrides = options.overrides;
+		sweep.tickMicros = tickMicros;
+		if (options.durationTicks > 0) {
+			sweep.durationTicks = options.durationTicks;
+		}
+		return runSweep(sweep);
+	}
+
 	thread cpuThread(runCPU);
-	cpuThread.detach();
-	MainConsole console;
-	console.run();
-	return 0;
+	int status = 0;
+	{
+		MainConsole console;
+		if (argc > 1) {
+			status = console.runHeadless(options);
+		}
+		else {
+			console.run();
+		}
+	}
+	cpuRunning = false;
+	cpuThread.join();
+	return status;
 }
\ No newline at end of file
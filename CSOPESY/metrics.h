@@ -0,0 +1,245 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+#ifdef _WIN32
+typedef SOCKET socket_t;
+const socket_t INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+void closeSocketHandle(socket_t s) { closesocket(s); }
+#else
+typedef int socket_t;
+const socket_t INVALID_SOCKET_HANDLE = -1;
+void closeSocketHandle(socket_t s) { close(s); }
+#endif
+
+enum MetricType { METRIC_COUNTER, METRIC_GAUGE };
+
+struct Metric {
+	string name;
+	string help;
+	MetricType type;
+	function<double()> read;
+};
+
+class MetricsRegistry {
+private:
+	mutex registryMutex;
+	vector<Metric> metrics;
+	vector<function<void()>> collectors;
+
+public:
+	// Collectors run before every sample so that related gauges are refreshed together.
+	void addCollector(function<void()> collect) {
+		lock_guard<mutex> lock(registryMutex);
+		collectors.push_back(collect);
+	}
+
+	void addCounter(const string& name, const string& help, function<double()> read) {
+		lock_guard<mutex> lock(registryMutex);
+		metrics.push_back({ name, help, METRIC_COUNTER, read });
+	}
+
+	void addGauge(const string& name, const string& help, function<double()> read) {
+		lock_guard<mutex> lock(registryMutex);
+		metrics.push_back({ name, help, METRIC_GAUGE, read });
+	}
+
+	void clear() {
+		lock_guard<mutex> lock(registryMutex);
+		metrics.clear();
+		collectors.clear();
+	}
+
+	vector<pair<Metric, double>> sample() {
+		lock_guard<mutex> lock(registryMutex);
+		for (auto& collect : collectors) {
+			collect();
+		}
+		vector<pair<Metric, double>> values;
+		for (auto& metric : metrics) {
+			values.push_back({ metric, metric.read() });
+		}
+		return values;
+	}
+
+	static string formatValue(double value) {
+		ostringstream oss;
+		if (value == floor(value) && fabs(value) < 1e15) {
+			oss << static_cast<ll>(value);
+		}
+		else {
+			oss << setprecision(6) << value;
+		}
+		return oss.str();
+	}
+
+	string toPrometheus() {
+		ostringstream oss;
+		for (auto& [metric, value] : sample()) {
+			oss << "# HELP " << metric.name << " " << metric.help << "\n";
+			oss << "# TYPE " << metric.name << " " << (metric.type == METRIC_COUNTER ? "counter" : "gauge") << "\n";
+			oss << metric.name << " " << formatValue(value) << "\n";
+		}
+		return oss.str();
+	}
+
+	string toJsonLine() {
+		ostringstream oss;
+		ll unixMs = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+		oss << "{\"timestamp_ms\":" << unixMs;
+		for (auto& [metric, value] : sample()) {
+			oss << ",\"" << metric.name << "\":" << formatValue(value);
+		}
+		oss << "}";
+		return oss.str();
+	}
+};
+
+// Samples the registry on its own thread: appends a JSON line to a file every interval
+// and answers scrapes on a local Unix socket with the Prometheus text format.
+class MetricsExporter {
+private:
+	MetricsRegistry& registry;
+	thread worker;
+	atomic<bool> running = false;
+	string jsonPath;
+	string socketPath;
+	int intervalMs = 1000;
+	socket_t listener = INVALID_SOCKET_HANDLE;
+
+	bool openListener() {
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+			return false;
+		}
+#endif
+		error_code ec;
+		filesystem::remove(socketPath, ec);
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener == INVALID_SOCKET_HANDLE) {
+			return false;
+		}
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+		if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 8) != 0) {
+			closeSocketHandle(listener);
+			listener = INVALID_SOCKET_HANDLE;
+			return false;
+		}
+		return true;
+	}
+
+	void closeListener() {
+		if (listener != INVALID_SOCKET_HANDLE) {
+			closeSocketHandle(listener);
+			listener = INVALID_SOCKET_HANDLE;
+			error_code ec;
+			filesystem::remove(socketPath, ec);
+		}
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	// Waits up to timeoutMs for a scrape; returns early if one was served.
+	void serveOnce(int timeoutMs) {
+		if (listener == INVALID_SOCKET_HANDLE) {
+			this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+			return;
+		}
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		FD_SET(listener, &readSet);
+		timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+		if (select(static_cast<int>(listener) + 1, &readSet, nullptr, nullptr, &timeout) <= 0) {
+			return;
+		}
+		socket_t client = accept(listener, nullptr, nullptr);
+		if (client == INVALID_SOCKET_HANDLE) {
+			return;
+		}
+		// Drain whatever request line the scraper sent; the body is the same for every path.
+		fd_set clientSet;
+		FD_ZERO(&clientSet);
+		FD_SET(client, &clientSet);
+		timeval requestTimeout = { 0, 100000 };
+		if (select(static_cast<int>(client) + 1, &clientSet, nullptr, nullptr, &requestTimeout) > 0) {
+			char request[1024];
+			recv(client, request, sizeof(request), 0);
+		}
+		string body = registry.toPrometheus();
+		string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+		size_t sent = 0;
+		while (sent < response.size()) {
+			int n = send(client, response.c_str() + sent, static_cast<int>(response.size() - sent), 0);
+			if (n <= 0) {
+				break;
+			}
+			sent += n;
+		}
+		closeSocketHandle(client);
+	}
+
+	void loop() {
+		ofstream jsonFile(jsonPath, ios::app);
+		auto nextExport = chrono::steady_clock::now();
+		while (running) {
+			auto now = chrono::steady_clock::now();
+			if (now >= nextExport) {
+				if (jsonFile.is_open()) {
+					jsonFile << registry.toJsonLine() << "\n";
+					jsonFile.flush();
+				}
+				nextExport = now + chrono::milliseconds(intervalMs);
+			}
+			ll waitMs = chrono::duration_cast<chrono::milliseconds>(nextExport - chrono::steady_clock::now()).count();
+			serveOnce(static_cast<int>(clamp(waitMs, 1LL, 200LL)));
+		}
+		jsonFile.close();
+	}
+
+public:
+	MetricsExporter(MetricsRegistry& registry) : registry(registry) {}
+
+	~MetricsExporter() {
+		stop();
+	}
+
+	bool isRunning() {
+		return running;
+	}
+
+	string getJsonPath() {
+		return jsonPath;
+	}
+
+	string getSocketPath() {
+		return socketPath;
+	}
+
+	// Returns false if the socket could not be opened; the JSON-lines export still runs in that case.
+	bool start(const string& json, const string& sock, int interval) {
+		stop();
+		jsonPath = json;
+		socketPath = sock;
+		intervalMs = max(interval, 1);
+		bool listening = openListener();
+		running = true;
+		worker = thread(&MetricsExporter::loop, this);
+		return listening;
+	}
+
+	void stop() {
+		if (!running) {
+			return;
+		}
+		running = false;
+		if (worker.joinable()) {
+			worker.join();
+		}
+		closeListener();
+	}
+};
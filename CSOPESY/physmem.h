@@ -0,0 +1,155 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// Simulated RAM: one anonymous mapping of max-overall-mem bytes. Frame and flat offsets index
+// straight into it, so allocating, touching and swapping a process moves real bytes.
+class PhysicalMemory {
+private:
+	char* base = nullptr;
+	size_t length = 0;
+
+public:
+	~PhysicalMemory() {
+		release();
+	}
+
+	bool allocate(size_t bytes) {
+		release();
+		if (bytes == 0) {
+			return true;
+		}
+#ifdef _WIN32
+		void* mapped = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (mapped == nullptr) {
+			return false;
+		}
+#else
+		void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped == MAP_FAILED) {
+			return false;
+		}
+#endif
+		base = static_cast<char*>(mapped);
+		length = bytes;
+		return true;
+	}
+
+	void release() {
+		if (base == nullptr) {
+			return;
+		}
+#ifdef _WIN32
+		VirtualFree(base, 0, MEM_RELEASE);
+#else
+		munmap(base, length);
+#endif
+		base = nullptr;
+		length = 0;
+	}
+
+	char* at(ll offset) {
+		return base + offset;
+	}
+
+	size_t size() const {
+		return length;
+	}
+};
+
+// Binary swap space next to backing_store.txt. Each evicted process gets one slot holding its
+// memory image; slots freed by page-in are reused by later page-outs of the same or smaller size.
+class SwapFile {
+private:
+	string path;
+	fstream file;
+	unordered_map<string, pair<ll, ll>> slots;
+	multimap<ll, ll> freeSlots;
+	ll fileEnd = 0;
+
+	ll reserve(ll bytes) {
+		auto fit = freeSlots.lower_bound(bytes);
+		if (fit != freeSlots.end()) {
+			ll offset = fit->second;
+			ll spare = fit->first - bytes;
+			freeSlots.erase(fit);
+			if (spare > 0) {
+				freeSlots.emplace(spare, offset + bytes);
+			}
+			return offset;
+		}
+		ll offset = fileEnd;
+		fileEnd += bytes;
+		return offset;
+	}
+
+public:
+	void open(const string& swapPath) {
+		path = swapPath;
+		file.close();
+		file.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+		slots.clear();
+		freeSlots.clear();
+		fileEnd = 0;
+	}
+
+	bool contains(const string& name) const {
+		return slots.count(name) > 0;
+	}
+
+	void put(const string& name, const char* data, ll bytes) {
+		discard(name);
+		ll offset = reserve(bytes);
+		file.clear();
+		file.seekp(offset);
+		file.write(data, bytes);
+		file.flush();
+		slots[name] = { offset, bytes };
+	}
+
+	// Reads the image back and frees its slot. Returns the number of bytes read.
+	ll take(const string& name, string& data) {
+		auto slot = slots.find(name);
+		if (slot == slots.end()) {
+			return 0;
+		}
+		auto [offset, bytes] = slot->second;
+		data.resize(bytes);
+		file.clear();
+		file.seekg(offset);
+		file.read(data.data(), bytes);
+		slots.erase(slot);
+		freeSlots.emplace(bytes, offset);
+		return bytes;
+	}
+
+	void discard(const string& name) {
+		auto slot = slots.find(name);
+		if (slot != slots.end()) {
+			freeSlots.emplace(slot->second.second, slot->second.first);
+			slots.erase(slot);
+		}
+	}
+
+	// Copies every stored image, for checkpoints.
+	vector<pair<string, string>> images() {
+		vector<pair<string, string>> result;
+		for (const auto& [name, slot] : slots) {
+			string data(slot.second, '\0');
+			file.clear();
+			file.seekg(slot.first);
+			file.read(data.data(), slot.second);
+			result.emplace_back(name, move(data));
+		}
+		return result;
+	}
+
+	ll usedBytes() const {
+		ll used = 0;
+		for (const auto& [name, slot] : slots) {
+			used += slot.second;
+		}
+		return used;
+	}
+};
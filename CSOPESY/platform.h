@@ -0,0 +1,70 @@
+#pragma once
+
+// Everything OS-specific lives here so the simulator also builds with g++/clang on Linux.
+// On Windows this is just the usual system headers.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+#pragma comment(lib, "Ws2_32.lib")
+
+void clearConsole() {
+	system("cls");
+}
+
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/select.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+#define CONST const
+#define STD_OUTPUT_HANDLE 1
+typedef unsigned short WORD;
+typedef int HANDLE;
+
+HANDLE GetStdHandle(int handle) {
+	return handle;
+}
+
+// Maps the Windows console attribute (low nibble: foreground colour) onto an ANSI escape.
+bool SetConsoleTextAttribute(HANDLE handle, WORD color) {
+	if (!isatty(handle)) {
+		return true;
+	}
+	static const int ansi[8] = { 30, 34, 32, 36, 31, 35, 33, 37 };
+	int fg = color & 0x0F;
+	if (fg == 7) {
+		fputs("\033[0m", stdout);
+	}
+	else {
+		printf("\033[%d;%dm", (fg & 0x08) ? 1 : 0, ansi[fg & 0x07]);
+	}
+	return true;
+}
+
+int ctime_s(char* buffer, size_t size, const time_t* time) {
+	return ctime_r(time, buffer) == nullptr || size < 26;
+}
+
+int localtime_s(struct tm* result, const time_t* time) {
+	return localtime_r(time, result) == nullptr;
+}
+
+void clearConsole() {
+	if (isatty(STDOUT_FILENO)) {
+		fputs("\033[2J\033[H", stdout);
+		fflush(stdout);
+	}
+}
+#endif
@@ -0,0 +1,242 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// Free blocks held by one thread for one size class.
+struct PoolCache {
+	void* head = nullptr;
+	size_t count = 0;
+};
+
+// Blocks of one size carved out of 64 KB slabs. Threads take and return blocks in batches of
+// BATCH through their own PoolCache, so the lock is taken once per batch rather than per block.
+// Slabs are never given back; once a run has reached its peak, allocation never reaches malloc.
+class BlockPool {
+private:
+	size_t blockSize;
+	mutex poolMutex;
+	void* shared = nullptr;
+	size_t sharedCount = 0;
+	atomic<ll> slabBytes = 0;
+
+	static void*& nextOf(void* block) {
+		return *static_cast<void**>(block);
+	}
+
+	// Caller holds poolMutex.
+	void addSlab() {
+		char* slab = static_cast<char*>(::operator new(SLAB_BYTES, align_val_t(SLAB_ALIGNMENT)));
+		size_t blocks = SLAB_BYTES / blockSize;
+		for (size_t i = 0; i < blocks; i++) {
+			void* block = slab + i * blockSize;
+			nextOf(block) = shared;
+			shared = block;
+		}
+		sharedCount += blocks;
+		slabBytes += SLAB_BYTES;
+	}
+
+public:
+	static const size_t SLAB_BYTES = 1 << 16;
+	static const size_t SLAB_ALIGNMENT = 64;
+	static const size_t BATCH = 32;
+
+	explicit BlockPool(size_t size) : blockSize(size) {}
+
+	ll getSlabBytes() { return slabBytes; }
+
+	// Moves up to BATCH blocks into an empty cache.
+	void refill(PoolCache& cache) {
+		lock_guard<mutex> lock(poolMutex);
+		if (shared == nullptr) {
+			addSlab();
+		}
+		while (shared != nullptr && cache.count < BATCH) {
+			void* block = shared;
+			shared = nextOf(block);
+			sharedCount--;
+			nextOf(block) = cache.head;
+			cache.head = block;
+			cache.count++;
+		}
+	}
+
+	// Hands every block beyond keep back to the shared list.
+	void spill(PoolCache& cache, size_t keep) {
+		lock_guard<mutex> lock(poolMutex);
+		while (cache.count > keep) {
+			void* block = cache.head;
+			cache.head = nextOf(block);
+			cache.count--;
+			nextOf(block) = shared;
+			shared = block;
+			sharedCount++;
+		}
+	}
+
+	void release(void* block) {
+		lock_guard<mutex> lock(poolMutex);
+		nextOf(block) = shared;
+		shared = block;
+		sharedCount++;
+	}
+};
+
+// Size-classed BlockPools for everything up to MAX_POOLED bytes: 16-byte steps up to 256, then
+// powers of two. Larger requests go to operator new. Built once and never destroyed, so blocks
+// freed by static destructors or exiting threads still have somewhere to go.
+class PoolArena {
+private:
+	static const int CLASS_COUNT = 20;
+	BlockPool* pools[CLASS_COUNT];
+
+	struct ThreadCaches {
+		PoolCache caches[CLASS_COUNT];
+		~ThreadCaches() {
+			PoolArena& arena = PoolArena::instance();
+			for (int i = 0; i < CLASS_COUNT; i++) {
+				arena.pools[i]->spill(caches[i], 0);
+			}
+			gone() = true;
+		}
+	};
+
+	// Set once this thread's caches have been handed back; later frees go straight to the pool.
+	static bool& gone() {
+		thread_local bool flag = false;
+		return flag;
+	}
+
+	static ThreadCaches& local() {
+		thread_local ThreadCaches caches;
+		return caches;
+	}
+
+	static int classOf(size_t bytes) {
+		if (bytes <= 256) {
+			return static_cast<int>((max<size_t>(bytes, 1) + 15) / 16) - 1;
+		}
+		return 15 + static_cast<int>(bit_width(bit_ceil(bytes) >> 8)) - 1;
+	}
+
+	PoolArena() {
+		for (int i = 0; i < CLASS_COUNT; i++) {
+			pools[i] = new BlockPool(i < 16 ? (i + 1) * 16 : size_t(256) << (i - 15));
+		}
+	}
+
+public:
+	static const size_t MAX_POOLED = 4096;
+	// A block of n * sizeof(T) bytes is aligned to alignof(T) up to this, since sizeof(T) is a
+	// multiple of alignof(T) and so is every class size it lands in. Types that need more are not pooled.
+	static const size_t ALIGNMENT = BlockPool::SLAB_ALIGNMENT;
+
+	static PoolArena& instance() {
+		static PoolArena* arena = new PoolArena();
+		return *arena;
+	}
+
+	void* allocate(size_t bytes) {
+		if (bytes > MAX_POOLED) {
+			return ::operator new(bytes);
+		}
+		int sizeClass = classOf(bytes);
+		if (gone()) {
+			PoolCache single;
+			pools[sizeClass]->refill(single);
+			void* block = single.head;
+			single.head = *static_cast<void**>(block);
+			single.count--;
+			pools[sizeClass]->spill(single, 0);
+			return block;
+		}
+		PoolCache& cache = local().caches[sizeClass];
+		if (cache.head == nullptr) {
+			pools[sizeClass]->refill(cache);
+		}
+		void* block = cache.head;
+		cache.head = *static_cast<void**>(block);
+		cache.count--;
+		return block;
+	}
+
+	void deallocate(void* block, size_t bytes) {
+		if (bytes > MAX_POOLED) {
+			::operator delete(block);
+			return;
+		}
+		int sizeClass = classOf(bytes);
+		if (gone()) {
+			pools[sizeClass]->release(block);
+			return;
+		}
+		PoolCache& cache = local().caches[sizeClass];
+		*static_cast<void**>(block) = cache.head;
+		cache.head = block;
+		cache.count++;
+		if (cache.count > 2 * BlockPool::BATCH) {
+			pools[sizeClass]->spill(cache, BlockPool::BATCH);
+		}
+	}
+
+	ll getSlabBytes() {
+		ll total = 0;
+		for (BlockPool* pool : pools) {
+			total += pool->getSlabBytes();
+		}
+		return total;
+	}
+};
+
+// Standard allocator over PoolArena, for containers and allocate_shared. All instances share the
+// arena, so any one can free what another allocated.
+template <class T>
+class PoolAllocator {
+public:
+	using value_type = T;
+
+	PoolAllocator() noexcept = default;
+	template <class U>
+	PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+	T* allocate(size_t n) {
+		if constexpr (alignof(T) > PoolArena::ALIGNMENT) {
+			return allocator<T>().allocate(n);
+		}
+		else {
+			return static_cast<T*>(PoolArena::instance().allocate(n * sizeof(T)));
+		}
+	}
+
+	void deallocate(T* block, size_t n) noexcept {
+		if constexpr (alignof(T) > PoolArena::ALIGNMENT) {
+			allocator<T>().deallocate(block, n);
+		}
+		else {
+			PoolArena::instance().deallocate(block, n * sizeof(T));
+		}
+	}
+
+	template <class U>
+	bool operator==(const PoolAllocator<U>&) const noexcept {
+		return true;
+	}
+};
+
+template <class T>
+using PooledVector = vector<T, PoolAllocator<T>>;
+template <class T>
+using PooledDeque = deque<T, PoolAllocator<T>>;
+template <class T>
+using PooledSet = set<T, less<T>, PoolAllocator<T>>;
+template <class K, class V>
+using PooledMap = map<K, V, less<K>, PoolAllocator<pair<const K, V>>>;
+template <class K, class V>
+using PooledMultimap = multimap<K, V, less<K>, PoolAllocator<pair<const K, V>>>;
+
+// A process and its shared_ptr control block live in one pooled block.
+template <class... Args>
+shared_ptr<Screen> makeScreen(Args&&... args) {
+	return allocate_shared<Screen>(PoolAllocator<Screen>(), forward<Args>(args)...);
+}
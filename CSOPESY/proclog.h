@@ -0,0 +1,305 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+enum ProcessLogMode {
+	PROCESS_LOG_OFF,
+	PROCESS_LOG_SHARED,
+	PROCESS_LOG_PER_PROCESS
+};
+
+const char* processLogModeName(ProcessLogMode mode) {
+	switch (mode) {
+	case PROCESS_LOG_OFF: return "off";
+	case PROCESS_LOG_SHARED: return "shared";
+	case PROCESS_LOG_PER_PROCESS: return "per-process";
+	}
+	return "unknown";
+}
+
+// "(YYYY-mm-dd HH:MM:SS) " for the current second. The text is rebuilt only when the second
+// changes, so a core printing thousands of lines a second calls localtime_s once.
+class TimestampCache {
+private:
+	time_t cachedSecond = -1;
+	char text[32] = {};
+	size_t length = 0;
+
+public:
+	string_view get(time_t now) {
+		if (now != cachedSecond) {
+			struct tm parts;
+			localtime_s(&parts, &now);
+			length = strftime(text, sizeof(text), "(%Y-%m-%d %H:%M:%S) ", &parts);
+			cachedSecond = now;
+		}
+		return string_view(text, length);
+	}
+};
+
+// Lines written by one thread since its last flush. Only the owner appends; the mutex is there
+// so that flushAll() can take the batch of a core that has gone idle, and is uncontended otherwise.
+struct ProcessLogBuffer {
+	mutex bufferMutex;
+	string shared;
+	unordered_map<string, string> perProcess;
+	size_t bytes = 0;
+	ll lines = 0;
+	TimestampCache clock;
+};
+
+class ProcessLog {
+private:
+	atomic<int> mode = PROCESS_LOG_OFF;
+	// Guards the buffer list, the output files and everything below it.
+	mutex logMutex;
+	vector<unique_ptr<ProcessLogBuffer>> buffers;
+	string path;
+	ofstream sharedFile;
+	set<string> startedFiles;
+	thread flusher;
+	mutex flusherMutex;
+	condition_variable flusherWake;
+	bool flushing = false;
+	atomic<ll> linesWritten = 0;
+	atomic<ll> bytesWritten = 0;
+	atomic<ll> batchesWritten = 0;
+	atomic<ll> writeFailures = 0;
+
+	ProcessLogBuffer& local() {
+		thread_local ProcessLogBuffer* mine = nullptr;
+		if (mine == nullptr) {
+			auto buffer = make_unique<ProcessLogBuffer>();
+			mine = buffer.get();
+			lock_guard<mutex> lock(logMutex);
+			buffers.push_back(move(buffer));
+		}
+		return *mine;
+	}
+
+	static void appendLine(string& out, string_view timestamp, int core, const string& process, string_view statement, bool withProcess) {
+		char number[16];
+		if (withProcess) {
+			out += process;
+			out += " | ";
+		}
+		out += timestamp;
+		out += "| Core: ";
+		auto end = to_chars(number, number + sizeof(number), core).ptr;
+		out.append(number, end - number);
+		out += " | \"";
+		out += statement;
+		out += "\"\n";
+	}
+
+	// Moves a buffer's pending lines out so the file writes happen without holding its lock.
+	static void takeBatch(ProcessLogBuffer& buffer, string& shared, unordered_map<string, string>& perProcess, ll& lines) {
+		lock_guard<mutex> lock(buffer.bufferMutex);
+		shared.swap(buffer.shared);
+		perProcess.swap(buffer.perProcess);
+		lines = buffer.lines;
+		buffer.bytes = 0;
+		buffer.lines = 0;
+	}
+
+	// Caller holds logMutex.
+	void writeBatch(string& shared, unordered_map<string, string>& perProcess, ll lines) {
+		ll bytes = shared.size();
+		if (!shared.empty() && sharedFile.is_open()) {
+			sharedFile.write(shared.data(), shared.size());
+			if (!sharedFile) {
+				writeFailures++;
+				sharedFile.clear();
+			}
+		}
+		for (auto& [process, text] : perProcess) {
+			filesystem::path filePath = filesystem::path(path) / (process + ".txt");
+			ofstream outFile(filePath, ios::app | ios::binary);
+			if (!outFile.is_open()) {
+				writeFailures++;
+				continue;
+			}
+			if (startedFiles.insert(process).second) {
+				outFile << "Process name: " << process << "\nLogs:\n\n";
+			}
+			outFile.write(text.data(), text.size());
+			bytes += text.size();
+		}
+		shared.clear();
+		perProcess.clear();
+		if (lines > 0) {
+			linesWritten += lines;
+			bytesWritten += bytes;
+			batchesWritten++;
+		}
+	}
+
+	void discardPending() {
+		lock_guard<mutex> lock(logMutex);
+		for (auto& buffer : buffers) {
+			lock_guard<mutex> bufferLock(buffer->bufferMutex);
+			buffer->shared.clear();
+			buffer->perProcess.clear();
+			buffer->bytes = 0;
+			buffer->lines = 0;
+		}
+	}
+
+	void flushLoop() {
+		unique_lock<mutex> lock(flusherMutex);
+		while (flushing) {
+			flusherWake.wait_for(lock, chrono::milliseconds(100));
+			lock.unlock();
+			flushAll();
+			lock.lock();
+		}
+	}
+
+public:
+	// A thread flushes its own buffer once this much is pending; idle cores are flushed by the background thread.
+	static const size_t BATCH_BYTES = 1 << 16;
+
+	static ProcessLog& instance() {
+		static ProcessLog log;
+		return log;
+	}
+
+	~ProcessLog() {
+		stop();
+	}
+
+	bool isEnabled() {
+		return mode.load(memory_order_relaxed) != PROCESS_LOG_OFF;
+	}
+
+	ProcessLogMode getMode() {
+		return static_cast<ProcessLogMode>(mode.load(memory_order_relaxed));
+	}
+
+	string getPath() {
+		lock_guard<mutex> lock(logMutex);
+		return path;
+	}
+
+	ll getLinesWritten() { return linesWritten; }
+	ll getBytesWritten() { return bytesWritten; }
+	ll getBatchesWritten() { return batchesWritten; }
+	ll getWriteFailures() { return writeFailures; }
+
+	// Shared mode appends every process's lines to the file at target, each prefixed with the
+	// process name; per-process mode appends to <target>/<process>.txt like the old prototype did.
+	bool start(ProcessLogMode newMode, const string& target, string& error) {
+		if (isEnabled()) {
+			error = "Process logging is already on.";
+			return false;
+		}
+		if (newMode == PROCESS_LOG_OFF) {
+			error = "Pick shared or per-process.";
+			return false;
+		}
+		{
+			lock_guard<mutex> lock(logMutex);
+			path = target;
+			startedFiles.clear();
+			if (newMode == PROCESS_LOG_SHARED) {
+				sharedFile.open(target, ios::app | ios::binary);
+				if (!sharedFile.is_open()) {
+					error = "Could not open " + target + " for writing.";
+					return false;
+				}
+			}
+			else {
+				error_code ec;
+				filesystem::create_directories(target, ec);
+				if (!filesystem::is_directory(target, ec)) {
+					error = "Could not create directory " + target + ".";
+					return false;
+				}
+			}
+		}
+		// Drop whatever a core appended while logging was being switched off last time.
+		discardPending();
+		linesWritten = 0;
+		bytesWritten = 0;
+		batchesWritten = 0;
+		writeFailures = 0;
+		mode = newMode;
+		{
+			lock_guard<mutex> lock(flusherMutex);
+			flushing = true;
+		}
+		flusher = thread(&ProcessLog::flushLoop, this);
+		return true;
+	}
+
+	void stop() {
+		if (!isEnabled()) {
+			return;
+		}
+		mode = PROCESS_LOG_OFF;
+		{
+			lock_guard<mutex> lock(flusherMutex);
+			flushing = false;
+		}
+		flusherWake.notify_all();
+		if (flusher.joinable()) {
+			flusher.join();
+		}
+		flushAll();
+		lock_guard<mutex> lock(logMutex);
+		sharedFile.close();
+	}
+
+	// Called by a core for every executed PRINT. Only formats into the calling thread's buffer;
+	// the file is touched once per BATCH_BYTES of output.
+	void write(int core, const string& process, string_view statement) {
+		ProcessLogMode current = getMode();
+		if (current == PROCESS_LOG_OFF) {
+			return;
+		}
+		ProcessLogBuffer& buffer = local();
+		bool full;
+		{
+			lock_guard<mutex> lock(buffer.bufferMutex);
+			string_view timestamp = buffer.clock.get(time(nullptr));
+			string& out = current == PROCESS_LOG_SHARED ? buffer.shared : buffer.perProcess[process];
+			size_t before = out.size();
+			appendLine(out, timestamp, core, process, statement, current == PROCESS_LOG_SHARED);
+			buffer.bytes += out.size() - before;
+			buffer.lines++;
+			full = buffer.bytes >= BATCH_BYTES;
+		}
+		if (full) {
+			string shared;
+			unordered_map<string, string> perProcess;
+			ll lines = 0;
+			takeBatch(buffer, shared, perProcess, lines);
+			lock_guard<mutex> lock(logMutex);
+			writeBatch(shared, perProcess, lines);
+		}
+	}
+
+	void flushAll() {
+		lock_guard<mutex> lock(logMutex);
+		string shared;
+		unordered_map<string, string> perProcess;
+		for (auto& buffer : buffers) {
+			ll lines = 0;
+			takeBatch(*buffer, shared, perProcess, lines);
+			writeBatch(shared, perProcess, lines);
+		}
+		if (sharedFile.is_open()) {
+			sharedFile.flush();
+		}
+	}
+};
+
+void logInstruction(const shared_ptr<Screen>& screen) {
+	ProcessLog& log = ProcessLog::instance();
+	if (log.isEnabled()) {
+		thread_local string statement;
+		statement.assign("Hello world from ").append(screen->getProcessName()).append("!");
+		log.write(Tracer::currentCore(), screen->getProcessName(), statement);
+	}
+}
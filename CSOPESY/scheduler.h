@@ -3,7 +3,6 @@
 using namespace std;
 typedef long long ll;
 
-extern volatile ll mainCtr;
 
 ll safeCeil(int numerator, int denominator) {
 	return (numerator + (denominator - 1)) / denominator;
@@ -15,112 +14,997 @@ struct MemoryFrame {
 	bool free;
 };
 
+// A paging process's frames; pooled, as a list is built on every allocation.
+typedef PooledVector<MemoryFrame> FrameList;
+
+// A paging frame mapped by more than one process after a fork.
+struct SharedFrame {
+	ll size;
+	int refs;
+};
+
+// One core's flags and counters. Each core has its own cache line, so cores updating theirs never
+// invalidate one another's; totals are summed when read.
+struct alignas(64) CoreStats {
+	// 1 while the core has a process.
+	atomic<int> used = 0;
+	// Cleared when the core's process is evicted from under it, so the core stops running it.
+	atomic<bool> running = false;
+	atomic<ll> dispatches = 0;
+	atomic<ll> finished = 0;
+	atomic<ll> pagesIn = 0;
+	atomic<ll> pagesOut = 0;
+};
+
+// CoreStats for every core that can exist, allocated once so a core's block never moves while
+// others read it. Work done outside any core (the console, benchmarks) and the totals a checkpoint
+// restored go to a shared slot after the last core.
+class CoreStatsTable {
+private:
+	unique_ptr<CoreStats[]> slots;
+	// One past the highest core that has had a slot, so sums skip the ones never used.
+	atomic<int> highWater = 0;
+
+public:
+	static const int MAX_CORES = 1024;
+
+	CoreStatsTable() : slots(make_unique<CoreStats[]>(MAX_CORES + 1)) {}
+
+	CoreStats& operator[](int core) {
+		if (core < 0 || core >= MAX_CORES) {
+			return slots[MAX_CORES];
+		}
+		if (core >= highWater.load(memory_order_relaxed)) {
+			int seen = highWater.load(memory_order_relaxed);
+			while (seen <= core && !highWater.compare_exchange_weak(seen, core + 1)) {
+			}
+		}
+		return slots[core];
+	}
+
+	// The calling thread's core, or the shared slot.
+	CoreStats& local() {
+		return (*this)[Tracer::currentCore()];
+	}
+
+	CoreStats& shared() {
+		return slots[MAX_CORES];
+	}
+
+	template <class T>
+	ll sum(atomic<T> CoreStats::* field) {
+		ll total = (slots[MAX_CORES].*field).load(memory_order_relaxed);
+		int cores = highWater.load(memory_order_acquire);
+		for (int i = 0; i < cores; i++) {
+			total += (slots[i].*field).load(memory_order_relaxed);
+		}
+		return total;
+	}
+
+	// Takes every core off its process, as when the memory layout is rebuilt.
+	void clearRunning() {
+		for (int i = 0; i <= MAX_CORES; i++) {
+			slots[i].used = 0;
+			slots[i].running = false;
+		}
+	}
+
+	void resetCounters() {
+		for (int i = 0; i <= MAX_CORES; i++) {
+			slots[i].dispatches = 0;
+			slots[i].finished = 0;
+			slots[i].pagesIn = 0;
+			slots[i].pagesOut = 0;
+		}
+	}
+};
+
+// An FCFS process parked until enough memory is freed for it.
+struct MemoryWaiter {
+	shared_ptr<Screen> screen;
+	ll arrival;
+	ll bypassed;
+};
+
 
 class Scheduler {
 private:
-	int numCpu;
+	atomic<int> numCpu = 0;
 	string scheduler;
-	int quantumCycles;
-	ll batchProcessFrequency;
-	int minIns;
-	int maxIns;
-	int delayPerExec;
+	atomic<int> quantumCycles = 0;
+	atomic<ll> batchProcessFrequency = 0;
+	atomic<ll> batchProcessSize = 1;
+	atomic<ll> batchProcessDelayMs = 400;
+	atomic<bool> archiveFinished = false;
+	// Read by scheduler-test when it starts. Guarded by queueMutex.
+	ArrivalSettings arrivals;
+	// Finished processes waiting for the console to archive them (archive-finished on). Guarded by queueMutex.
+	PooledDeque<shared_ptr<Screen>> finishedQueue;
+	atomic<int> minIns = 0;
+	atomic<int> maxIns = 0;
+	atomic<int> delayPerExec = 0;
 	ll maxOverallMem;
 	ll memPerFrame;
-	ll minMemPerProc;
-	ll maxMemPerProc;
+	atomic<ll> minMemPerProc = 0;
+	atomic<ll> maxMemPerProc = 0;
 	bool initialized = false;
-	deque<shared_ptr<Screen>> readyQueue;
-	deque<MemoryFrame> memoryFrames;
-	map<int, int> coresUsed;
+	PooledDeque<shared_ptr<Screen>> readyQueue;
+	// Free paging frames by size class, as start offsets. A frame is aligned to its own size, so
+	// when all pieces of a larger frame are free again they merge back into it (buddy-style).
+	PooledMap<ll, PooledSet<int>> freeFrames;
+	vector<ll> frameSizes;
+	string frameSizeList;
+	ll freeFrameBytes = 0;
+	ll framesInUse = 0;
+	// Frames shared copy-on-write by forked processes, by start offset. A frame missing here is
+	// private to the one process that maps it.
+	map<int, SharedFrame> sharedFrames;
 	atomic<int> qq = 0;
 	vector<shared_ptr<Screen>> procInMem;
-	map<shared_ptr<Screen>, vector<MemoryFrame>> memoryMap;
-	map<shared_ptr<Screen>, pair<ll, ll>> flatMemoryMap;
+	PooledMap<shared_ptr<Screen>, FrameList> memoryMap;
+	PooledMap<shared_ptr<Screen>, pair<ll, ll>> flatMemoryMap;
 	string allocation_type = "paging";
-	deque<shared_ptr<Screen>> oldest;
-	map<int, atomic<bool>> current_process_task;
-	vector<bool> flatMemoryArray;
+	PooledDeque<shared_ptr<Screen>> oldest;
+	CoreStatsTable coreStats;
+	OccupancyBitmap flatMemoryBitmap;
 	atomic<int> idleCPUTicks=0;
-	atomic<int> pagesIn = 0;
-	atomic<int> pagesOut = 0;
+	atomic<ll> evictions = 0;
+	atomic<ll> snapshotCoresUsed = 0;
+	atomic<ll> snapshotReadyQueue = 0;
+	atomic<ll> snapshotUsedMem = 0;
+	atomic<ll> snapshotFreeMem = 0;
+	atomic<ll> snapshotFragmentation = 0;
+	atomic<ll> snapshotInternalFragmentation = 0;
+	atomic<ll> snapshotFramesInUse = 0;
+	atomic<ll> snapshotProcsInMem = 0;
+	atomic<ll> elapsedTicks = 0;
+	atomic<ll> configGeneration = 0;
+	atomic<ll> configRejected = 0;
+	atomic<ll> generationStartTick = 0;
+	atomic<ll> generationStartFinished = 0;
+	PhysicalMemory ram;
+	SwapFile swap;
+	atomic<ll> bytesSwappedIn = 0;
+	atomic<ll> bytesSwappedOut = 0;
+	atomic<ll> compactionThreshold = 50;
+	atomic<ll> compactionBudget = 256;
+	atomic<bool> compactionRequested = false;
+	atomic<ll> compactionRelocations = 0;
+	atomic<ll> compactionBytes = 0;
+	atomic<ll> compactionPasses = 0;
+	atomic<ll> compactionNs = 0;
+	atomic<ll> snapshotLargestFree = 0;
+	// Keyed by requested memory, so backfilling can try the smallest first. Guarded by queueMutex.
+	PooledMultimap<ll, MemoryWaiter> memoryWaitQueue;
+	ll waiterArrivals = 0;
+	// Bumped on every free; waiters are only retried when it has moved since the last full scan.
+	atomic<ll> freeGeneration = 0;
+	ll admissionGeneration = 0;
+	ll admissionTick = -1;
+	ll failedThisTick = 0;
+	atomic<bool> admissionBackfill = true;
+	atomic<ll> admissionMaxBypass = 8;
+	atomic<ll> admissionRetriesPerTick = 4;
+	atomic<ll> admittedFromWait = 0;
+	atomic<ll> backfills = 0;
+	atomic<ll> failedAllocations = 0;
+	atomic<ll> starvationHolds = 0;
+	atomic<ll> snapshotWaitQueue = 0;
+	atomic<ll> forks = 0;
+	atomic<ll> cowFaults = 0;
+	atomic<ll> cowBytesCopied = 0;
+	atomic<ll> snapshotSharedFrames = 0;
+	atomic<ll> snapshotSharedBytesSaved = 0;
+	atomic<ll> forkPercent = 0;
+	ll numaNodes = 1;
+	atomic<ll> remoteAccessPenalty = 1;
+	atomic<ll> numaDispatchWindow = 4;
+	ll coreThreads = 0;
+	// Busy-core samples per node, one sample per tick. Guarded by queueMutex.
+	vector<ll> nodeBusyTicks;
+	ll nodeSamples = 0;
+	atomic<ll> affineDispatches = 0;
+	atomic<ll> remoteDispatches = 0;
+	atomic<ll> nodeMigrations = 0;
+	atomic<ll> remoteAllocations = 0;
+	atomic<ll> remoteStallTicks = 0;
+	mutex lifecycleMutex;
+	TickClock& clock;
+	WorkerPool cores;
+	// Process names go to <backingStore>.txt and evicted images to <backingStore>.bin.
+	string backingStore = "backing_store";
+	// Wall-clock time each instruction holds its core.
+	chrono::nanoseconds instructionTime = Screen::INSTRUCTION_TIME;
+	jthread counterThread;
+	jthread compactorThread;
 
 public:
-	mutex queueMutex;
-	mutex memoryMutex;
-	map<int, shared_ptr<Screen>> runningScreens;
-	void getConfig() {
-		ifstream file("config.txt");
-		string line;
-		while (getline(file, line)) {
-			istringstream iss(line);
-			string key;
-			string value;
-			iss >> key >> value;
-			if (key == "num-cpu") {
-				numCpu = stoi(value);
+	StatMutex queueMutex{ STAT_QUEUE_LOCK_WAIT, STAT_QUEUE_LOCK_HOLD };
+	StatMutex memoryMutex{ STAT_MEMORY_LOCK_WAIT, STAT_MEMORY_LOCK_HOLD };
+	PooledMap<int, shared_ptr<Screen>> runningScreens;
+	Scheduler() : Scheduler(TickClock::instance()) {}
+
+	// A scheduler on its own clock, e.g. one of several run side by side in a sweep.
+	explicit Scheduler(TickClock& clock) : clock(clock), cores(clock) {}
+
+	~Scheduler() {
+		stop();
+	}
+
+	// Before initialize; two schedulers in one process must not share a backing store.
+	void setBackingStore(const string& prefix) {
+		backingStore = prefix;
+	}
+
+	// Before initialize. Sweeps shorten it along with their ticks.
+	void setInstructionTime(chrono::nanoseconds time) {
+		instructionTime = time;
+	}
+
+	// Re-running initialize stops the current pool first, so there is only ever one set of core threads.
+	// An invalid file leaves the running configuration untouched; messages then holds the errors.
+	bool getConfig(const string& path, vector<string>& messages, const vector<string>& overrides = {}) {
+		SchedulerConfig config;
+		if (!readConfigFile(path, config, messages, overrides)) {
+			return false;
+		}
+		stop();
+		resetMemoryState();
+		applyConfig(config, messages);
+		configGeneration = 0;
+		generationStartTick = elapsedTicks.load();
+		generationStartFinished = getFinishedProcesses();
+		createBackingStore();
+		start();
+		initialized = true;
+		return true;
+	}
+
+	// Reads a config file and lays out memory without starting any core threads.
+	bool loadConfig(const string& path, vector<string>& messages, const vector<string>& overrides = {}) {
+		SchedulerConfig config;
+		if (!readConfigFile(path, config, messages, overrides)) {
+			return false;
+		}
+		applyConfig(config, messages);
+		return true;
+	}
+
+	void applyConfig(const SchedulerConfig& config, vector<string>& messages) {
+		numCpu = static_cast<int>(config.numCpu);
+		scheduler = config.scheduler;
+		quantumCycles = static_cast<int>(config.quantumCycles);
+		batchProcessFrequency = config.batchProcessFrequency;
+		batchProcessSize = config.batchProcessSize;
+		batchProcessDelayMs = config.batchProcessDelayMs;
+		archiveFinished = config.archiveFinished == "on";
+		arrivals = ArrivalSettings::from(config);
+		minIns = static_cast<int>(config.minIns);
+		maxIns = static_cast<int>(config.maxIns);
+		delayPerExec = static_cast<int>(config.delayPerExec);
+		maxOverallMem = config.maxOverallMem;
+		memPerFrame = config.memPerFrame;
+		minMemPerProc = config.minMemPerProc;
+		maxMemPerProc = config.maxMemPerProc;
+		frameSizeList = config.frameSizes;
+		frameSizes = config.frameClasses;
+		allocation_type = config.allocator;
+		compactionThreshold = config.compactionThreshold;
+		compactionBudget = config.compactionBudget;
+		admissionBackfill = config.admissionBackfill == "on";
+		admissionMaxBypass = config.admissionMaxBypass;
+		admissionRetriesPerTick = config.admissionRetriesPerTick;
+		forkPercent = config.forkPercent;
+		numaNodes = config.numaNodes;
+		remoteAccessPenalty = config.remoteAccessPenalty;
+		numaDispatchWindow = config.numaDispatchWindow;
+		coreThreads = config.coreThreads;
+		nodeBusyTicks.assign(numaNodes, 0);
+		nodeSamples = 0;
+		if (config.allocatorInferred && allocation_type == "flat") {
+			messages.push_back("allocator not set; using flat allocation because max-overall-mem equals mem-per-frame");
+		}
+		if(allocation_type == "flat") {
+			initFlatMemory();
+		}else{
+			initMemory();
+		}	
+		lock_guard<StatMutex> lock(memoryMutex);
+		if (!ram.allocate(maxOverallMem)) {
+			messages.push_back("could not map " + to_string(maxOverallMem) + " bytes of simulated memory");
+		}
+	}
+
+	// The running settings as a config, e.g. to change one key and pass the result to reconfigure.
+	SchedulerConfig currentConfig() {
+		SchedulerConfig config;
+		config.numCpu = numCpu;
+		config.scheduler = scheduler;
+		config.quantumCycles = quantumCycles;
+		config.batchProcessFrequency = batchProcessFrequency;
+		config.batchProcessSize = batchProcessSize;
+		config.batchProcessDelayMs = batchProcessDelayMs;
+		config.archiveFinished = archiveFinished ? "on" : "off";
+		getArrivalSettings().store(config);
+		config.minIns = minIns;
+		config.maxIns = maxIns;
+		config.delayPerExec = delayPerExec;
+		config.maxOverallMem = maxOverallMem;
+		config.memPerFrame = memPerFrame;
+		config.minMemPerProc = minMemPerProc;
+		config.maxMemPerProc = maxMemPerProc;
+		config.allocator = allocation_type;
+		config.frameSizes = frameSizeList;
+		config.compactionThreshold = compactionThreshold;
+		config.compactionBudget = compactionBudget;
+		config.admissionBackfill = admissionBackfill ? "on" : "off";
+		config.admissionMaxBypass = admissionMaxBypass;
+		config.admissionRetriesPerTick = admissionRetriesPerTick;
+		config.forkPercent = forkPercent;
+		config.numaNodes = numaNodes;
+		config.remoteAccessPenalty = remoteAccessPenalty;
+		config.numaDispatchWindow = numaDispatchWindow;
+		config.coreThreads = coreThreads;
+		return config;
+	}
+
+	// Applies the keys that are safe to change under load. Memory layout and scheduler type are
+	// rejected because frames, maps and the core loops are built around them; use initialize instead.
+	// next must already have passed readConfigFile, so every safe key is applied together.
+	bool reconfigure(const SchedulerConfig& next, vector<string>& applied, vector<string>& rejected) {
+		if (next.maxOverallMem != maxOverallMem) {
+			rejected.push_back("max-overall-mem: memory layout changes need initialize");
+		}
+		if (next.memPerFrame != memPerFrame) {
+			rejected.push_back("mem-per-frame: memory layout changes need initialize");
+		}
+		if (next.scheduler != scheduler) {
+			rejected.push_back("scheduler: scheduler type changes need initialize");
+		}
+		if (next.allocator != allocation_type) {
+			rejected.push_back("allocator: allocator changes need initialize");
+		}
+		if (next.frameSizes != frameSizeList) {
+			rejected.push_back("frame-sizes: memory layout changes need initialize");
+		}
+		if (next.numaNodes != numaNodes) {
+			rejected.push_back("numa-nodes: memory layout changes need initialize");
+		}
+		if (next.coreThreads != coreThreads) {
+			rejected.push_back("core-threads: the thread pool is sized at start; run initialize");
+		}
+		// A config counts once however many of its keys were refused.
+		if (!rejected.empty()) {
+			configRejected++;
+		}
+		// Validated against the file's own max-overall-mem, which may be one of the rejected keys above.
+		if (next.maxMemPerProc > maxOverallMem) {
+			if (rejected.empty()) {
+				configRejected++;
+			}
+			rejected.push_back("max-mem-per-proc must not exceed the running max-overall-mem (" + to_string(maxOverallMem) + ")");
+			return false;
+		}
+
+		auto note = [&applied](const string& key, ll before, ll after) {
+			if (before != after) {
+				applied.push_back(key + ": " + to_string(before) + " -> " + to_string(after));
+			}
+		};
+		note("num-cpu", numCpu, next.numCpu);
+		note("quantum-cycles", quantumCycles, next.quantumCycles);
+		note("batch-process-freq", batchProcessFrequency, next.batchProcessFrequency);
+		note("batch-process-size", batchProcessSize, next.batchProcessSize);
+		note("batch-process-delay-ms", batchProcessDelayMs, next.batchProcessDelayMs);
+		if (archiveFinished != (next.archiveFinished == "on")) {
+			applied.push_back("archive-finished: " + string(archiveFinished ? "on" : "off") + " -> " + next.archiveFinished);
+		}
+		ArrivalSettings nextArrivals = ArrivalSettings::from(next);
+		{
+			lock_guard<StatMutex> lock(queueMutex);
+			if (nextArrivals != arrivals) {
+				applied.push_back("arrivals: " + arrivals.describe() + " -> " + nextArrivals.describe() + " (from the next scheduler-test)");
+			}
+		}
+		note("min-ins", minIns, next.minIns);
+		note("max-ins", maxIns, next.maxIns);
+		note("delay-per-exec", delayPerExec, next.delayPerExec);
+		note("min-mem-per-proc", minMemPerProc, next.minMemPerProc);
+		note("max-mem-per-proc", maxMemPerProc, next.maxMemPerProc);
+		note("compaction-threshold", compactionThreshold, next.compactionThreshold);
+		note("compaction-budget", compactionBudget, next.compactionBudget);
+		if (admissionBackfill != (next.admissionBackfill == "on")) {
+			applied.push_back("admission-backfill: " + string(admissionBackfill ? "on" : "off") + " -> " + next.admissionBackfill);
+		}
+		note("admission-max-bypass", admissionMaxBypass, next.admissionMaxBypass);
+		note("admission-retries-per-tick", admissionRetriesPerTick, next.admissionRetriesPerTick);
+		note("fork-percent", forkPercent, next.forkPercent);
+		note("remote-access-penalty", remoteAccessPenalty, next.remoteAccessPenalty);
+		note("numa-dispatch-window", numaDispatchWindow, next.numaDispatchWindow);
+		if (applied.empty()) {
+			return true;
+		}
+
+		// Holding the queue lock means no core dispatches against a half-applied set.
+		{
+			lock_guard<StatMutex> lock(queueMutex);
+			quantumCycles = static_cast<int>(next.quantumCycles);
+			batchProcessFrequency = next.batchProcessFrequency;
+			batchProcessSize = next.batchProcessSize;
+			batchProcessDelayMs = next.batchProcessDelayMs;
+			archiveFinished = next.archiveFinished == "on";
+			arrivals = nextArrivals;
+			minIns = static_cast<int>(next.minIns);
+			maxIns = static_cast<int>(next.maxIns);
+			delayPerExec = static_cast<int>(next.delayPerExec);
+			minMemPerProc = next.minMemPerProc;
+			maxMemPerProc = next.maxMemPerProc;
+			compactionThreshold = next.compactionThreshold;
+			compactionBudget = next.compactionBudget;
+			admissionBackfill = next.admissionBackfill == "on";
+			admissionMaxBypass = next.admissionMaxBypass;
+			admissionRetriesPerTick = next.admissionRetriesPerTick;
+			forkPercent = next.forkPercent;
+			remoteAccessPenalty = next.remoteAccessPenalty;
+			numaDispatchWindow = next.numaDispatchWindow;
+			// Waiters blocked only by the old limits get another look.
+			freeGeneration++;
+		}
+		if (next.numCpu != numCpu) {
+			resizeCores(static_cast<int>(next.numCpu));
+		}
+		generationStartTick = elapsedTicks.load();
+		generationStartFinished = getFinishedProcesses();
+		configGeneration++;
+		return true;
+	}
+
+	void recordRejectedConfig() {
+		configRejected++;
+	}
+
+	// Finished processes per 1000 ticks since the last successful reconfigure.
+	double getGenerationThroughput() {
+		ll ticks = elapsedTicks - generationStartTick;
+		return ticks > 0 ? (getFinishedProcesses() - generationStartFinished) * 1000.0 / ticks : 0;
+	}
+
+	// Copies the scheduler's state. The queue and memory locks are held only while pointers and
+	// frame lists are copied; per-process fields are read afterwards under each process's own lock.
+	// registry is the console's process list, so finished and not-yet-queued processes are kept too.
+	SchedulerCheckpoint captureCheckpoint(const vector<shared_ptr<Screen>>& registry) {
+		SchedulerCheckpoint checkpoint;
+		vector<shared_ptr<Screen>> running;
+		vector<shared_ptr<Screen>> queued;
+		vector<shared_ptr<Screen>> resident;
+		vector<pair<shared_ptr<Screen>, FrameList>> paged;
+		vector<pair<shared_ptr<Screen>, pair<ll, ll>>> flat;
+		{
+			lock_guard<StatMutex> queueLock(queueMutex);
+			lock_guard<StatMutex> memoryLock(memoryMutex);
+			for (const auto& [core, screen] : runningScreens) {
+				running.push_back(screen);
+			}
+			queued.assign(readyQueue.begin(), readyQueue.end());
+			// Waiters hold no memory; on restore they rejoin the ready queue and are admitted again.
+			for (const auto& waiter : waitersByArrival()) {
+				queued.push_back(waiter->screen);
+			}
+			resident.assign(oldest.begin(), oldest.end());
+			paged.assign(memoryMap.begin(), memoryMap.end());
+			flat.assign(flatMemoryMap.begin(), flatMemoryMap.end());
+			for (const auto& [size, starts] : freeFrames) {
+				for (int start : starts) {
+					checkpoint.freeFrames.emplace_back(start, static_cast<int>(start + size - 1));
+				}
+			}
+			checkpoint.ram.assign(ram.at(0), ram.size());
+			checkpoint.swapImages = swap.images();
+		}
+
+		ll capturedAt = nowNs();
+		unordered_map<Screen*, int> indexes;
+		auto indexOf = [&](const shared_ptr<Screen>& screen) {
+			auto [it, inserted] = indexes.try_emplace(screen.get(), static_cast<int>(checkpoint.processes.size()));
+			if (inserted) {
+				ScreenState state = screen->saveState();
+				for (ll* time : { &state.createdAt, &state.firstRunAt, &state.finishedAt, &state.enqueuedAt, &state.firstEnqueuedAt }) {
+					if (*time != 0) {
+						*time -= capturedAt;
+					}
+				}
+				checkpoint.processes.push_back(move(state));
 			}
-			else if (key == "scheduler") {
-				scheduler = value.substr(1, value.size() - 2);
+			return it->second;
+		};
+		for (const auto& screen : registry) {
+			indexOf(screen);
+		}
+		for (const auto& screen : running) {
+			if (!screen->isFinished()) {
+				checkpoint.readyQueue.push_back(indexOf(screen));
 			}
-			else if (key == "quantum-cycles") {
-				quantumCycles = stoull(value);
+		}
+		for (const auto& screen : queued) {
+			checkpoint.readyQueue.push_back(indexOf(screen));
+		}
+		for (const auto& screen : resident) {
+			checkpoint.oldest.push_back(indexOf(screen));
+		}
+		for (const auto& [screen, frames] : paged) {
+			vector<pair<int, int>> ranges;
+			for (const auto& frame : frames) {
+				ranges.emplace_back(frame.start, frame.end);
 			}
-			else if (key == "batch-process-freq") {
-				batchProcessFrequency = stoull(value);
+			checkpoint.frameMap.emplace_back(indexOf(screen), move(ranges));
+		}
+		for (const auto& [screen, range] : flat) {
+			checkpoint.flatMap.emplace_back(indexOf(screen), static_cast<int>(range.first), static_cast<int>(range.second));
+		}
+
+		checkpoint.config = currentConfig();
+		checkpoint.elapsedTicks = elapsedTicks;
+		checkpoint.idleCpuTicks = idleCPUTicks;
+		checkpoint.pagesIn = getPagesIn();
+		checkpoint.pagesOut = getPagesOut();
+		checkpoint.dispatches = coreStats.sum(&CoreStats::dispatches);
+		checkpoint.evictions = evictions;
+		checkpoint.finishedProcesses = getFinishedProcesses();
+
+		ifstream store(backingStore + ".txt");
+		string line;
+		while (getline(store, line)) {
+			checkpoint.backingStore.push_back(line);
+		}
+		return checkpoint;
+	}
+
+	// Replaces the whole scheduler state with a checkpoint and starts the cores again. overrides
+	// may change the scheduling policy or any runtime key, but not the memory layout the maps use.
+	// registry receives every restored process, in checkpoint order.
+	bool restoreCheckpoint(const SchedulerCheckpoint& checkpoint, const vector<string>& overrides, vector<shared_ptr<Screen>>& registry, vector<string>& errors) {
+		SchedulerConfig config = checkpoint.config;
+		for (const auto& entry : overrides) {
+			size_t equals = entry.find('=');
+			if (equals == string::npos) {
+				errors.push_back("override '" + entry + "': expected key=value");
+				continue;
 			}
-			else if (key == "min-ins") {
-				minIns = stoull(value);
+			setConfigValue(config, string_view(entry).substr(0, equals), string_view(entry).substr(equals + 1), "override", errors);
+		}
+		if (config.maxOverallMem != checkpoint.config.maxOverallMem || config.memPerFrame != checkpoint.config.memPerFrame
+			|| config.allocator != checkpoint.config.allocator || config.frameSizes != checkpoint.config.frameSizes
+			|| config.numaNodes != checkpoint.config.numaNodes) {
+			errors.push_back("max-overall-mem, mem-per-frame, frame-sizes, numa-nodes and allocator cannot be overridden when restoring a checkpoint");
+		}
+		if (errors.empty()) {
+			validateConfig(config, errors);
+		}
+		if (!errors.empty()) {
+			return false;
+		}
+
+		stop();
+		resetMemoryState();
+		vector<string> messages;
+		applyConfig(config, messages);
+
+		ll restoredAt = nowNs();
+		registry.clear();
+		for (const auto& saved : checkpoint.processes) {
+			ScreenState state = saved;
+			for (ll* time : { &state.createdAt, &state.firstRunAt, &state.finishedAt, &state.enqueuedAt, &state.firstEnqueuedAt }) {
+				if (*time != 0) {
+					*time += restoredAt;
+				}
 			}
-			else if (key == "max-ins") {
-				maxIns = stoull(value);
+			registry.push_back(makeScreen(state));
+		}
+
+		{
+			lock_guard<StatMutex> queueLock(queueMutex);
+			lock_guard<StatMutex> memoryLock(memoryMutex);
+			if (checkpoint.ram.size() == ram.size()) {
+				memcpy(ram.at(0), checkpoint.ram.data(), ram.size());
 			}
-			else if (key == "delay-per-exec") {
-				delayPerExec = stoull(value);
+			swap.open(backingStore + ".bin");
+			for (const auto& [name, image] : checkpoint.swapImages) {
+				swap.put(name, image.data(), image.size());
 			}
-			else if (key == "max-overall-mem") {
-				maxOverallMem = stoull(value);
+			readyQueue.clear();
+			for (int index : checkpoint.readyQueue) {
+				readyQueue.push_back(registry[index]);
 			}
-			else if (key == "mem-per-frame") {
-				memPerFrame = stoull(value);
+			for (int index : checkpoint.oldest) {
+				oldest.push_back(registry[index]);
 			}
-			else if (key == "min-mem-per-proc") {
-				minMemPerProc = stoull(value);
+			if (allocation_type == "flat") {
+				for (const auto& [index, start, end] : checkpoint.flatMap) {
+					flatMemoryMap[registry[index]] = { start, end };
+					occupyMemoryFlat(start, end);
+				}
 			}
-			else if (key == "max-mem-per-proc") {
-				maxMemPerProc = stoull(value);
+			else {
+				freeFrames.clear();
+				freeFrameBytes = 0;
+				for (const auto& [start, end] : checkpoint.freeFrames) {
+					freeFrames[end - start + 1].insert(start);
+					freeFrameBytes += end - start + 1;
+				}
+				// A frame listed under several processes was shared by a fork.
+				framesInUse = 0;
+				sharedFrames.clear();
+				for (const auto& [index, frames] : checkpoint.frameMap) {
+					auto& mapped = memoryMap[registry[index]];
+					for (const auto& [start, end] : frames) {
+						mapped.push_back({ start, end, false });
+						auto [shared, inserted] = sharedFrames.try_emplace(start, SharedFrame{ end - start + 1, 0 });
+						if (++shared->second.refs == 1) {
+							framesInUse++;
+						}
+					}
+				}
+				erase_if(sharedFrames, [](const auto& entry) { return entry.second.refs == 1; });
+				for (auto& [screen, frames] : memoryMap) {
+					screen->memoryNode = homeNodeOf(frames);
+				}
 			}
 		}
-		file.close();
-		allocation_type = (maxOverallMem == memPerFrame) ? "flat" : "paging";
-		if(allocation_type == "flat") {
-			initFlatMemory();
-		}else{
-			initMemory();
-		}	
-		createBackingStore();
+
+		elapsedTicks = checkpoint.elapsedTicks;
+		idleCPUTicks = static_cast<int>(checkpoint.idleCpuTicks);
+		coreStats.resetCounters();
+		coreStats.shared().pagesIn = checkpoint.pagesIn;
+		coreStats.shared().pagesOut = checkpoint.pagesOut;
+		coreStats.shared().dispatches = checkpoint.dispatches;
+		evictions = checkpoint.evictions;
+		coreStats.shared().finished = checkpoint.finishedProcesses;
+		configGeneration = 0;
+		generationStartTick = elapsedTicks.load();
+		generationStartFinished = getFinishedProcesses();
+
+		ofstream store(backingStore + ".txt", ios::trunc);
+		for (const auto& name : checkpoint.backingStore) {
+			store << name << endl;
+		}
+		store.close();
+
 		start();
 		initialized = true;
+		return true;
 	}
 
 	void createBackingStore() {
-		ofstream file("backing_store.txt");
+		ofstream file(backingStore + ".txt");
 		file.close();
+		lock_guard<StatMutex> lock(memoryMutex);
+		swap.open(backingStore + ".bin");
 	}
 
-	int getCoresUsed() {
-		int totalUsed = 0;
+	// (offset, bytes) slices of simulated RAM that hold a process, in process address order.
+	// Caller holds memoryMutex.
+	PooledVector<pair<ll, ll>> processRanges(const shared_ptr<Screen>& screen) {
+		PooledVector<pair<ll, ll>> ranges;
+		if (allocation_type == "flat") {
+			auto range = flatMemoryMap.find(screen);
+			if (range != flatMemoryMap.end()) {
+				ranges.emplace_back(range->second.first, range->second.second - range->second.first + 1);
+			}
+		}
+		else {
+			auto mapped = memoryMap.find(screen);
+			if (mapped != memoryMap.end()) {
+				for (const auto& frame : mapped->second) {
+					ranges.emplace_back(frame.start, frame.end - frame.start + 1);
+				}
+			}
+		}
+		return ranges;
+	}
+
+	// Copies between a process's address space and RAM, following its frames. Caller holds memoryMutex.
+	void copyProcessMemory(const PooledVector<pair<ll, ll>>& ranges, ll address, char* data, ll bytes, bool toRam) {
+		for (const auto& [offset, length] : ranges) {
+			if (bytes == 0) {
+				break;
+			}
+			if (address >= length) {
+				address -= length;
+				continue;
+			}
+			ll chunk = min(bytes, length - address);
+			char* slice = ram.at(offset + address);
+			if (toRam) {
+				memcpy(slice, data, chunk);
+			}
+			else {
+				memcpy(data, slice, chunk);
+			}
+			data += chunk;
+			bytes -= chunk;
+			address = 0;
+		}
+	}
+
+	// Fills newly allocated memory: the swapped-out image if there is one, otherwise a zeroed image
+	// whose first 8 bytes hold the program counter. Caller holds memoryMutex.
+	void swapIn(const shared_ptr<Screen>& screen) {
+		PooledVector<pair<ll, ll>> ranges = processRanges(screen);
+		string image;
+		ll bytes;
+		{
+			STAT_SCOPE(STAT_SWAP_IN);
+			bytes = swap.take(screen->getProcessName(), image);
+			if (bytes > 0) {
+				copyProcessMemory(ranges, 0, image.data(), bytes, true);
+			}
+		}
+		if (bytes > 0) {
+			bytesSwappedIn += bytes;
+			return;
+		}
+		for (const auto& [offset, length] : ranges) {
+			memset(ram.at(offset), 0, length);
+		}
+		ll counter = screen->getCurrentLine();
+		copyProcessMemory(ranges, 0, reinterpret_cast<char*>(&counter), sizeof(counter), true);
+	}
+
+	// Copies a resident process's image to the swap file before its memory is reused. Caller holds memoryMutex.
+	void swapOut(const shared_ptr<Screen>& screen) {
+		STAT_SCOPE(STAT_SWAP_OUT);
+		PooledVector<pair<ll, ll>> ranges = processRanges(screen);
+		string image;
+		for (const auto& [offset, length] : ranges) {
+			image.append(ram.at(offset), length);
+		}
+		swap.put(screen->getProcessName(), image.data(), image.size());
+		bytesSwappedOut += image.size();
+	}
+
+	// Called after every instruction: stores the program counter and updates one stack slot,
+	// so resident processes keep real, changing data in RAM. The stack is the top quarter of the
+	// process's memory; the rest is its program image, which is only read, so forks keep sharing it.
+	// A write to a frame shared with a fork first copies that frame (see copyOnWrite).
+	void touchMemory(const shared_ptr<Screen>& screen) {
+		unique_lock<StatMutex> lock(memoryMutex);
+		PooledVector<pair<ll, ll>> ranges = processRanges(screen);
+		ll total = 0;
+		for (const auto& range : ranges) {
+			total += range.second;
+		}
+		ll counter = screen->getCurrentLine();
+		if (total < static_cast<ll>(2 * sizeof(counter))) {
+			return;
+		}
+		ll stackBase = total * 3 / 4 / sizeof(counter);
+		ll slot = stackBase + counter % (total / sizeof(counter) - stackBase);
+		if (!sharedFrames.empty() && (isSharedAt(screen, 0) || isSharedAt(screen, slot * sizeof(counter)))) {
+			// A fault may evict other processes, which needs the queue lock, taken first.
+			lock.unlock();
+			lock_guard<StatMutex> queueLock(queueMutex);
+			lock.lock();
+			copyOnWrite(screen, 0, sizeof(counter));
+			copyOnWrite(screen, slot * sizeof(counter), sizeof(counter));
+			ranges = processRanges(screen);
+			if (ranges.empty()) {
+				return;
+			}
+			copyProcessMemory(ranges, 0, reinterpret_cast<char*>(&counter), sizeof(counter), true);
+			copyProcessMemory(ranges, slot * sizeof(counter), reinterpret_cast<char*>(&counter), sizeof(counter), true);
+			return;
+		}
+		copyProcessMemory(ranges, 0, reinterpret_cast<char*>(&counter), sizeof(counter), true);
+		copyProcessMemory(ranges, slot * sizeof(counter), reinterpret_cast<char*>(&counter), sizeof(counter), true);
+	}
+
+	// Whether the frame holding a process address is shared. Caller holds memoryMutex.
+	bool isSharedAt(const shared_ptr<Screen>& screen, ll address) {
+		auto mapped = memoryMap.find(screen);
+		if (mapped == memoryMap.end()) {
+			return false;
+		}
+		for (const auto& frame : mapped->second) {
+			ll length = frame.end - frame.start + 1;
+			if (address < length) {
+				return sharedFrames.count(frame.start) > 0;
+			}
+			address -= length;
+		}
+		return false;
+	}
+
+	// Gives screen its own copy of each shared frame overlapping [address, address + bytes). If no
+	// frame of the same size is free, other residents are evicted as the round robin allocator
+	// would; evicting the last other sharer makes the frame private without a copy.
+	// Caller holds queueMutex and memoryMutex.
+	void copyOnWrite(const shared_ptr<Screen>& screen, ll address, ll bytes) {
+		auto mapped = memoryMap.find(screen);
+		if (mapped == memoryMap.end()) {
+			return;
+		}
+		ll frameAddress = 0;
+		for (auto& frame : mapped->second) {
+			ll length = frame.end - frame.start + 1;
+			bool overlaps = frameAddress < address + bytes && address < frameAddress + length;
+			frameAddress += length;
+			if (!overlaps) {
+				continue;
+			}
+			size_t sizeClass = lower_bound(frameSizes.begin(), frameSizes.end(), length) - frameSizes.begin();
+			MemoryFrame copy;
+			bool copied = false;
+			while (sharedFrames.count(frame.start) > 0) {
+				if (takeFrame(sizeClass, copy, screen->memoryNode) || takeFrame(sizeClass, copy)) {
+					copied = true;
+					break;
+				}
+				if (!evictForFault(screen)) {
+					return;
+				}
+			}
+			if (!copied) {
+				continue;
+			}
+			memcpy(ram.at(copy.start), ram.at(frame.start), length);
+			unshareFrame(frame.start);
+			frame = copy;
+			cowFaults++;
+			cowBytesCopied += length;
+		}
+	}
+
+	// Drops one reference to a shared frame. Caller holds memoryMutex.
+	void unshareFrame(int start) {
+		auto shared = sharedFrames.find(start);
+		if (--shared->second.refs == 1) {
+			sharedFrames.erase(shared);
+		}
+	}
+
+	// Evicts the oldest resident that is not the faulting process, preferring ones not on a core.
+	// Caller holds queueMutex and memoryMutex.
+	bool evictForFault(const shared_ptr<Screen>& faulting) {
+		set<shared_ptr<Screen>> running;
+		for (const auto& [core, screen] : runningScreens) {
+			running.insert(screen);
+		}
+		auto victim = find_if(oldest.begin(), oldest.end(), [&](const auto& screen) { return screen != faulting && !running.count(screen); });
+		if (victim == oldest.end()) {
+			victim = find_if(oldest.begin(), oldest.end(), [&](const auto& screen) { return screen != faulting; });
+		}
+		if (victim == oldest.end()) {
+			return false;
+		}
+		evictResident(*victim);
+		oldest.erase(victim);
+		return true;
+	}
+
+	// Makes child map every frame of parent copy-on-write. Returns false when memory is flat or
+	// the parent is not resident; the child then gets its own memory on first dispatch and is not
+	// counted as a fork.
+	bool forkMemory(const shared_ptr<Screen>& parent, const shared_ptr<Screen>& child) {
+		lock_guard<StatMutex> lock(memoryMutex);
+		if (allocation_type == "flat") {
+			return false;
+		}
+		auto mapped = memoryMap.find(parent);
+		if (mapped == memoryMap.end()) {
+			return false;
+		}
+		FrameList frames = mapped->second;
+		for (const auto& frame : frames) {
+			auto [shared, inserted] = sharedFrames.try_emplace(frame.start, SharedFrame{ frame.end - frame.start + 1, 1 });
+			shared->second.refs++;
+		}
+		memoryMap[child] = move(frames);
+		child->allocatedMemory = parent->allocatedMemory;
+		child->memoryNode = parent->memoryNode;
+		child->memoryAllocated = true;
+		oldest.push_back(child);
+		forks++;
+		return true;
+	}
 
-		for (const auto& [coreId, count] : coresUsed) {
-			totalUsed += count;
+	// (private, shared) resident bytes of one process. Caller holds memoryMutex.
+	pair<ll, ll> getResidentSplit(const shared_ptr<Screen>& screen) {
+		auto mapped = memoryMap.find(screen);
+		if (mapped == memoryMap.end()) {
+			return { screen->allocatedMemory, 0 };
 		}
+		ll privateBytes = 0;
+		ll sharedBytes = 0;
+		for (const auto& frame : mapped->second) {
+			(sharedFrames.count(frame.start) ? sharedBytes : privateBytes) += frame.end - frame.start + 1;
+		}
+		return { privateBytes, sharedBytes };
+	}
+
+	// Memory that forks would have used without sharing. Caller holds memoryMutex.
+	ll getSharedBytesSaved() {
+		ll saved = 0;
+		for (const auto& [start, frame] : sharedFrames) {
+			saved += (frame.refs - 1) * frame.size;
+		}
+		return saved;
+	}
 
-		return totalUsed;
+	ll getSharedFrameCount() {
+		return sharedFrames.size();
+	}
+
+	ll getForks() {
+		return forks;
+	}
+
+	ll getCowFaults() {
+		return cowFaults;
+	}
+
+	ll getCowBytesCopied() {
+		return cowBytesCopied;
+	}
+
+	ll getForkPercent() {
+		return forkPercent;
+	}
+
+	ll getBytesSwappedIn() {
+		return bytesSwappedIn;
+	}
+
+	ll getBytesSwappedOut() {
+		return bytesSwappedOut;
+	}
+
+	int getCoresUsed() {
+		return static_cast<int>(coreStats.sum(&CoreStats::used));
+	}
+
+	int getNumCpu() {
+		return numCpu;
+	}
+
+	string getSchedulerType() {
+		return scheduler;
+	}
+
+	string getAllocationType() {
+		return allocation_type;
+	}
+
+	ll getMemPerFrame() {
+		return memPerFrame;
 	}
 
 	ll getBatchProcessFrequency() {
 		return batchProcessFrequency;
 	}
+
+	ll getBatchProcessSize() {
+		return batchProcessSize;
+	}
+
+	ll getBatchProcessDelayMs() {
+		return batchProcessDelayMs;
+	}
+
+	bool isArchivingFinished() {
+		return archiveFinished;
+	}
+
+	ArrivalSettings getArrivalSettings() {
+		lock_guard<StatMutex> lock(queueMutex);
+		return arrivals;
+	}
+
+	// Moves the processes finished since the last call into out, oldest first.
+	void takeFinished(vector<shared_ptr<Screen>>& out) {
+		lock_guard<StatMutex> lock(queueMutex);
+		out.insert(out.end(), finishedQueue.begin(), finishedQueue.end());
+		finishedQueue.clear();
+	}
 	string getCpuUtilization() {
 		float utilization = (static_cast<float>(getCoresUsed()) / numCpu) * 100;
 
@@ -144,131 +1028,615 @@ public:
 		return minIns;
 	}
 
-	ll getMaxIns() {
-		return maxIns;
+	ll getMaxIns() {
+		return maxIns;
+	}
+
+	ll getDelayPerExec() {
+		return delayPerExec;
+	}
+
+	ll getMaxMem() {
+		return maxOverallMem;
+	};
+	
+	ll getUsedMem() {
+		if (allocation_type == "flat") {
+			return flatMemoryBitmap.countUsed();
+		}
+		return maxOverallMem - getFreeMem();
+	}
+
+	ll getFreeMem() {
+		if (allocation_type == "flat") {
+			return maxOverallMem - getUsedMem();
+		}
+		return freeFrameBytes;
+	}
+
+
+	// Flat mode: free bytes that the largest possible allocation could not use.
+	ll getExternalFragmentation() {
+		if (allocation_type == "flat") {
+			return getFreeMem() - getLargestFreeBlock();
+		}
+		return freeFrameBytes;
+	}
+
+	// Resident flat blocks as (start, end, process), lowest address first. Caller holds memoryMutex.
+	vector<tuple<ll, ll, shared_ptr<Screen>>> flatBlocksByStart() {
+		vector<tuple<ll, ll, shared_ptr<Screen>>> blocks;
+		for (const auto& [screen, range] : flatMemoryMap) {
+			blocks.emplace_back(range.first, range.second, screen);
+		}
+		sort(blocks.begin(), blocks.end(), [](const auto& a, const auto& b) { return get<0>(a) < get<0>(b); });
+		return blocks;
+	}
+
+	// Largest contiguous free run (flat) or largest free frame (paging). Caller holds memoryMutex.
+	ll getLargestFreeBlock() {
+		if (allocation_type != "flat") {
+			for (auto it = freeFrames.rbegin(); it != freeFrames.rend(); ++it) {
+				if (!it->second.empty()) {
+					return it->first;
+				}
+			}
+			return 0;
+		}
+		return flatMemoryBitmap.longestFreeRun();
+	}
+
+	ll getCompactionRelocations() {
+		return compactionRelocations;
+	}
+
+	ll getCompactionBytes() {
+		return compactionBytes;
+	}
+
+	ll getCompactionPasses() {
+		return compactionPasses;
+	}
+
+	ll getCompactionThreshold() {
+		return compactionThreshold;
+	}
+
+	ll getCompactionBudget() {
+		return compactionBudget;
+	}
+
+	// Bytes handed to resident processes beyond what they asked for, from rounding up to frames.
+	ll getInternalFragmentation() {
+		ll wasted = 0;
+		for (const auto& screen : oldest) {
+			wasted += max(0, screen->allocatedMemory - screen->memory);
+		}
+		return wasted;
+	}
+
+	ll getFramesInUse() {
+		return framesInUse;
+	}
+
+	string getFrameSizes() {
+		string list;
+		for (ll size : frameSizes) {
+			list += (list.empty() ? "" : ",") + to_string(size);
+		}
+		return list;
+	}
+
+	ll getPagesIn() {
+		return coreStats.sum(&CoreStats::pagesIn);
+	}
+
+	ll getPagesOut() {
+		return coreStats.sum(&CoreStats::pagesOut);
+	}
+
+	ll getFinishedProcesses() {
+		return coreStats.sum(&CoreStats::finished);
+	}
+
+	// Called from the metrics thread. Only try_lock is used so sampling never stalls a core;
+	// if a lock is busy the previous sample is kept.
+	void refreshMetricSnapshot() {
+		if (queueMutex.try_lock()) {
+			lock_guard<StatMutex> lock(queueMutex, adopt_lock);
+			snapshotCoresUsed = getCoresUsed();
+			snapshotReadyQueue = readyQueue.size();
+			snapshotWaitQueue = memoryWaitQueue.size();
+		}
+		if (memoryMutex.try_lock()) {
+			lock_guard<StatMutex> lock(memoryMutex, adopt_lock);
+			snapshotUsedMem = getUsedMem();
+			snapshotFreeMem = getFreeMem();
+			snapshotFragmentation = getExternalFragmentation();
+			snapshotInternalFragmentation = getInternalFragmentation();
+			snapshotFramesInUse = framesInUse;
+			snapshotProcsInMem = oldest.size();
+			snapshotLargestFree = getLargestFreeBlock();
+			snapshotSharedFrames = sharedFrames.size();
+			snapshotSharedBytesSaved = getSharedBytesSaved();
+		}
+	}
+
+	void registerMetrics(MetricsRegistry& registry) {
+		registry.addCollector([this] { refreshMetricSnapshot(); });
+		registry.addCounter("csopesy_pages_in_total", "Frames paged in.", [this] { return (double)getPagesIn(); });
+		registry.addCounter("csopesy_pages_out_total", "Frames paged out.", [this] { return (double)getPagesOut(); });
+		registry.addCounter("csopesy_idle_cpu_ticks_total", "Ticks with no process running.", [this] { return (double)idleCPUTicks; });
+		registry.addCounter("csopesy_cpu_ticks_total", "Ticks elapsed on the main counter.", [this] { return (double)clock.now(); });
+		registry.addCounter("csopesy_dispatches_total", "Processes dispatched onto a core.", [this] { return (double)coreStats.sum(&CoreStats::dispatches); });
+		registry.addCounter("csopesy_evictions_total", "Processes moved to the backing store.", [this] { return (double)evictions; });
+		registry.addCounter("csopesy_finished_processes_total", "Processes that ran to completion.", [this] { return (double)getFinishedProcesses(); });
+		registry.addGauge("csopesy_cores_total", "Configured cores.", [this] { return (double)numCpu; });
+		registry.addGauge("csopesy_core_threads", "OS threads running the cores.", [this] { return (double)getCoreThreads(); });
+		registry.addCounter("csopesy_core_resumes_total", "Times a core coroutine was resumed by a pool thread.", [this] { return (double)getCoreThreadResumes(); });
+		registry.addGauge("csopesy_pool_slab_bytes", "Bytes reserved by the process and queue node pools.", [] { return (double)PoolArena::instance().getSlabBytes(); });
+		registry.addCounter("csopesy_process_log_lines_total", "PRINT lines written by log-start since it was last started.", [] { return (double)ProcessLog::instance().getLinesWritten(); });
+		registry.addCounter("csopesy_process_log_bytes_total", "Bytes of PRINT output written since log-start.", [] { return (double)ProcessLog::instance().getBytesWritten(); });
+		registry.addGauge("csopesy_cores_used", "Cores currently running a process.", [this] { return (double)snapshotCoresUsed; });
+		registry.addGauge("csopesy_ready_queue_length", "Processes waiting in the ready queue.", [this] { return (double)snapshotReadyQueue; });
+		registry.addGauge("csopesy_memory_total_bytes", "Configured memory.", [this] { return (double)maxOverallMem; });
+		registry.addGauge("csopesy_memory_used_bytes", "Memory allocated to processes.", [this] { return (double)snapshotUsedMem; });
+		registry.addGauge("csopesy_memory_free_bytes", "Memory not allocated to any process.", [this] { return (double)snapshotFreeMem; });
+		registry.addGauge("csopesy_external_fragmentation_bytes", "Free memory counted as external fragmentation.", [this] { return (double)snapshotFragmentation; });
+		registry.addGauge("csopesy_internal_fragmentation_bytes", "Allocated memory beyond what resident processes asked for.", [this] { return (double)snapshotInternalFragmentation; });
+		registry.addGauge("csopesy_frames_in_use", "Paging frames mapped to processes, across all frame sizes.", [this] { return (double)snapshotFramesInUse; });
+		registry.addGauge("csopesy_quantum_cycles", "Current quantum length in cycles.", [this] { return (double)quantumCycles; });
+		registry.addGauge("csopesy_delay_per_exec", "Current delay per instruction in ticks.", [this] { return (double)delayPerExec; });
+		registry.addGauge("csopesy_batch_process_freq", "Current ticks between generated processes.", [this] { return (double)batchProcessFrequency; });
+		registry.addGauge("csopesy_config_generation", "Successful reconfigures since initialize.", [this] { return (double)configGeneration; });
+		registry.addCounter("csopesy_config_rejected_total", "Reconfigure attempts rejected by validation or for keys that need initialize.", [this] { return (double)configRejected; });
+		registry.addGauge("csopesy_generation_throughput_per_1000_ticks", "Finished processes per 1000 ticks since the last reconfigure.", [this] { return getGenerationThroughput(); });
+		registry.addCounter("csopesy_swap_in_bytes_total", "Bytes copied from the swap file into simulated RAM.", [this] { return (double)bytesSwappedIn; });
+		registry.addCounter("csopesy_swap_out_bytes_total", "Bytes copied from simulated RAM to the swap file.", [this] { return (double)bytesSwappedOut; });
+		registry.addGauge("csopesy_processes_in_memory", "Processes with memory allocated.", [this] { return (double)snapshotProcsInMem; });
+		registry.addGauge("csopesy_memory_wait_queue_length", "FCFS processes waiting for memory to be freed.", [this] { return (double)snapshotWaitQueue; });
+		registry.addCounter("csopesy_admission_backfills_total", "Processes given memory ahead of an older waiter.", [this] { return (double)backfills; });
+		registry.addCounter("csopesy_admission_from_wait_total", "Waiting processes admitted after memory was freed.", [this] { return (double)admittedFromWait; });
+		registry.addCounter("csopesy_admission_failed_allocations_total", "FCFS allocation attempts that did not fit.", [this] { return (double)failedAllocations; });
+		registry.addCounter("csopesy_admission_starvation_holds_total", "Processes held back because the oldest waiter reached admission-max-bypass.", [this] { return (double)starvationHolds; });
+		registry.addCounter("csopesy_forks_total", "Processes created as copy-on-write forks.", [this] { return (double)forks; });
+		registry.addCounter("csopesy_cow_faults_total", "Shared frames copied because a process wrote to them.", [this] { return (double)cowFaults; });
+		registry.addCounter("csopesy_cow_copied_bytes_total", "Bytes copied by copy-on-write faults.", [this] { return (double)cowBytesCopied; });
+		registry.addGauge("csopesy_shared_frames", "Frames currently mapped by more than one process.", [this] { return (double)snapshotSharedFrames; });
+		registry.addGauge("csopesy_shared_bytes_saved", "Memory forks would use without sharing.", [this] { return (double)snapshotSharedBytesSaved; });
+		registry.addCounter("csopesy_numa_affine_dispatches_total", "Processes picked past the queue head because their memory is on the core's node.", [this] { return (double)affineDispatches; });
+		registry.addCounter("csopesy_numa_remote_dispatches_total", "Dispatches onto a core of another node than the process's memory.", [this] { return (double)remoteDispatches; });
+		registry.addCounter("csopesy_numa_migrations_total", "Dispatches onto another node than the process last ran on.", [this] { return (double)nodeMigrations; });
+		registry.addCounter("csopesy_numa_remote_allocations_total", "Allocations that spilled off the allocating core's node.", [this] { return (double)remoteAllocations; });
+		registry.addCounter("csopesy_numa_remote_stall_ticks_total", "Ticks cores stalled on remote memory access.", [this] { return (double)remoteStallTicks; });
+		registry.addGauge("csopesy_largest_free_block_bytes", "Largest contiguous free block (flat) or free frame (paging).", [this] { return (double)snapshotLargestFree; });
+		registry.addCounter("csopesy_compaction_relocations_total", "Flat blocks moved by the compactor.", [this] { return (double)compactionRelocations; });
+		registry.addCounter("csopesy_compaction_bytes_total", "Bytes copied by the compactor.", [this] { return (double)compactionBytes; });
+		registry.addCounter("csopesy_compaction_passes_total", "Compaction passes that reached the end of memory.", [this] { return (double)compactionPasses; });
+		registry.addCounter("csopesy_compaction_seconds_total", "Time spent relocating blocks, holding both scheduler locks.", [this] { return compactionNs / 1e9; });
+	}
+
+	bool isInitialized() {
+		return initialized;
+	}
+
+	void initMemory() {
+		// Carve memory into frames of the largest class; smaller frames are split off on demand.
+		lock_guard<StatMutex> lock(memoryMutex);
+		freeFrames.clear();
+		ll largest = frameSizes.back();
+		for (ll start = 0; start + largest <= maxOverallMem; start += largest) {
+			freeFrames[largest].insert(static_cast<int>(start));
+		}
+		freeFrameBytes = maxOverallMem / largest * largest;
+		framesInUse = 0;
+	}
+
+	// Takes one free frame of frameSizes[sizeClass], splitting a larger free frame if needed.
+	// node >= 0 restricts the search to that node's memory. Caller holds memoryMutex.
+	bool takeFrame(size_t sizeClass, MemoryFrame& frame, int node = -1) {
+		ll low = node >= 0 ? node * nodeBytes() : 0;
+		ll high = node >= 0 ? low + nodeBytes() : maxOverallMem;
+		size_t source = sizeClass;
+		PooledSet<int>::iterator found;
+		for (; source < frameSizes.size(); source++) {
+			PooledSet<int>& candidates = freeFrames[frameSizes[source]];
+			found = candidates.lower_bound(static_cast<int>(low));
+			if (found != candidates.end() && *found < high) {
+				break;
+			}
+		}
+		if (source == frameSizes.size()) {
+			return false;
+		}
+		PooledSet<int>& pool = freeFrames[frameSizes[source]];
+		int start = *found;
+		pool.erase(found);
+		for (size_t level = source; level > sizeClass; level--) {
+			ll piece = frameSizes[level - 1];
+			for (ll offset = piece; offset < frameSizes[level]; offset += piece) {
+				freeFrames[piece].insert(static_cast<int>(start + offset));
+			}
+		}
+		ll size = frameSizes[sizeClass];
+		frame = { start, static_cast<int>(start + size - 1), false };
+		freeFrameBytes -= size;
+		framesInUse++;
+		return true;
+	}
+
+	// Returns a frame and merges it with its free siblings into larger frames where possible.
+	// Caller holds memoryMutex.
+	void returnFrame(const MemoryFrame& frame) {
+		ll size = frame.end - frame.start + 1;
+		size_t sizeClass = lower_bound(frameSizes.begin(), frameSizes.end(), size) - frameSizes.begin();
+		int start = frame.start;
+		freeFrameBytes += size;
+		framesInUse--;
+		while (sizeClass + 1 < frameSizes.size()) {
+			ll piece = frameSizes[sizeClass];
+			ll parent = frameSizes[sizeClass + 1];
+			int parentStart = static_cast<int>(start & ~(parent - 1));
+			PooledSet<int>& pool = freeFrames[piece];
+			bool siblingsFree = true;
+			for (ll offset = 0; offset < parent && siblingsFree; offset += piece) {
+				int sibling = static_cast<int>(parentStart + offset);
+				siblingsFree = sibling == start || pool.count(sibling);
+			}
+			if (!siblingsFree) {
+				break;
+			}
+			for (ll offset = 0; offset < parent; offset += piece) {
+				pool.erase(static_cast<int>(parentStart + offset));
+			}
+			start = parentStart;
+			sizeClass++;
+		}
+		freeFrames[frameSizes[sizeClass]].insert(start);
+	}
+
+	// Frames per size class for a process: as many large frames as it fills completely, the rest
+	// in the smallest class. If the small-frame tail adds up to a whole larger frame, use that instead.
+	PooledVector<ll> planFrames(ll bytes) {
+		PooledVector<ll> counts(frameSizes.size(), 0);
+		for (size_t c = frameSizes.size() - 1; c > 0; c--) {
+			counts[c] = bytes / frameSizes[c];
+			bytes -= counts[c] * frameSizes[c];
+		}
+		counts[0] = (bytes + frameSizes[0] - 1) / frameSizes[0];
+		for (size_t c = 0; c + 1 < frameSizes.size(); c++) {
+			ll perParent = frameSizes[c + 1] / frameSizes[c];
+			counts[c + 1] += counts[c] / perParent;
+			counts[c] %= perParent;
+		}
+		return counts;
+	}
+
+	ll frameCountFor(ll bytes) {
+		ll frames = 0;
+		for (ll count : planFrames(bytes)) {
+			frames += count;
+		}
+		return frames;
 	}
 
-	ll getDelayPerExec() {
-		return delayPerExec;
+	ll frameBytesFor(ll bytes) {
+		PooledVector<ll> counts = planFrames(bytes);
+		ll total = 0;
+		for (size_t c = 0; c < counts.size(); c++) {
+			total += counts[c] * frameSizes[c];
+		}
+		return total;
 	}
 
-	ll getMaxMem() {
-		return maxOverallMem;
-	};
-	
-	ll getUsedMem() {
-		ll usedMem = 0; 
+	// First touch: with several nodes, memory comes from the node of the core allocating it and
+	// only spills over to the others when that node is full. Caller holds memoryMutex.
+	bool mapFrames(shared_ptr<Screen> screen) {
+		int node = numaNodes > 1 && Tracer::currentCore() >= 0 ? nodeOfCore(Tracer::currentCore()) : -1;
+		if (node >= 0 && mapFramesOn(screen, node)) {
+			screen->memoryNode = node;
+			return true;
+		}
+		if (!mapFramesOn(screen, -1)) {
+			return false;
+		}
+		if (node >= 0) {
+			remoteAllocations++;
+		}
+		screen->memoryNode = homeNodeOf(memoryMap[screen]);
+		return true;
+	}
 
-		if (allocation_type == "flat") {
-			for (int i = 0; i < flatMemoryArray.size(); i++) {
-				if (!flatMemoryArray[i]) { 
-					usedMem += 1; 
+	// Maps frames for the whole process or, if memory runs out, none. A size class that has run
+	// dry is made up from smaller frames. node < 0 takes frames from anywhere. Caller holds memoryMutex.
+	bool mapFramesOn(shared_ptr<Screen> screen, int node) {
+		PooledVector<ll> counts = planFrames(screen->memory);
+		FrameList taken;
+		for (size_t c = counts.size(); c-- > 0;) {
+			MemoryFrame frame;
+			while (counts[c] > 0 && takeFrame(c, frame, node)) {
+				taken.push_back(frame);
+				counts[c]--;
+			}
+			if (counts[c] > 0) {
+				if (c == 0) {
+					for (const auto& giveBack : taken) {
+						returnFrame(giveBack);
+					}
+					return false;
 				}
+				counts[c - 1] += counts[c] * (frameSizes[c] / frameSizes[c - 1]);
 			}
-			return usedMem;
 		}
-		return maxOverallMem - getFreeMem();
+		auto& mapped = memoryMap[screen];
+		mapped.reserve(mapped.size() + taken.size());
+		for (const auto& frame : taken) {
+			mapped.push_back(frame);
+			screen->allocatedMemory += frame.end - frame.start + 1;
+		}
+		coreStats.local().pagesIn.fetch_add(taken.size(), memory_order_relaxed);
+		return true;
 	}
 
-	ll getFreeMem() {
-		if (allocation_type == "flat") {
-			return maxOverallMem - getUsedMem();
-		}
-		return memoryFrames.size() * memPerFrame;
+	ll nodeBytes() {
+		return maxOverallMem / numaNodes;
 	}
 
+	// Cores are split into contiguous runs, one per node.
+	int nodeOfCore(int core) {
+		return numaNodes > 1 && numCpu > 0 ? static_cast<int>(core * numaNodes / numCpu) : 0;
+	}
 
-	ll getExternalFragmentation() {
-		int ctr = 0;
-		for (auto& block : memoryFrames) {
-			if (block.free) {
-				ctr++;
-			}
+	// The node holding most of a process's frames.
+	int homeNodeOf(const FrameList& frames) {
+		PooledVector<ll> bytes(numaNodes, 0);
+		for (const auto& frame : frames) {
+			bytes[frame.start / nodeBytes()] += frame.end - frame.start + 1;
 		}
-		return ctr * memPerFrame;
+		return static_cast<int>(max_element(bytes.begin(), bytes.end()) - bytes.begin());
 	}
 
-	ll getPagesIn() {
-		return pagesIn;
+	void initFlatMemory(){
+		lock_guard<StatMutex> lock(memoryMutex);
+		flatMemoryBitmap.reset(maxOverallMem);
 	}
 
-	ll getPagesOut() {
-		return pagesOut;
+	// Drops every allocation so a new memory layout can be loaded. Processes that were resident
+	// go back to needing memory and are re-allocated on their next dispatch.
+	void resetMemoryState() {
+		lock_guard<StatMutex> queueLock(queueMutex);
+		lock_guard<StatMutex> memoryLock(memoryMutex);
+		for (auto& screen : oldest) {
+			screen->memoryAllocated = false;
+			screen->allocatedMemory = 0;
+		}
+		oldest.clear();
+		returnWaitersToReadyQueue();
+		memoryMap.clear();
+		flatMemoryMap.clear();
+		freeFrames.clear();
+		freeFrameBytes = 0;
+		framesInUse = 0;
+		sharedFrames.clear();
+		flatMemoryBitmap.clear();
+		runningScreens.clear();
+		coreStats.clearRunning();
 	}
 
-	bool isInitialized() {
-		return initialized;
+	void spawnCore(int id) {
+		{
+			lock_guard<StatMutex> lock(queueMutex);
+			coreStats[id].running = false;
+			coreStats[id].used = 0;
+		}
+		if (allocation_type == "flat") {
+			cores.spawn([this](stop_token token, int id) { return runFlat(token, id); });
+		}
+		else {
+			cores.spawn([this](stop_token token, int id) { return runPaging(token, id); });
+		}
 	}
 
-	void delay() {
-		ll ctr = mainCtr;
-		while (true) {
-			if (((ctr + delayPerExec) % 1000000) >= (mainCtr % 1000000)) {
-				break;
-			}
+	// Joins a core after asking it to stop; the core hands its process back to the ready queue first.
+	void retireCore() {
+		int id = cores.size() - 1;
+		cores.retireLast();
+		lock_guard<StatMutex> lock(queueMutex);
+		runningScreens.erase(id);
+		coreStats[id].used = 0;
+		coreStats[id].running = false;
+	}
+
+	void start() {
+		lock_guard<mutex> lock(lifecycleMutex);
+		if (!cores.empty()) {
+			return;
+		}
+		cores.startThreads(getCoreThreads());
+		for (int i = 0; i < numCpu; i++) {
+			spawnCore(i);
+		}
+		counterThread = jthread([this](stop_token token) { CPUcounter(token); });
+		if (allocation_type == "flat") {
+			compactorThread = jthread([this](stop_token token) { compactor(token); });
 		}
 	}
 
-	void initMemory() {
-		// Initialize memory blocks where the first memory block starts from 0 and goes up to max overall mem
-		lock_guard<mutex> lock(memoryMutex);
-		int numFrames = maxOverallMem / memPerFrame;
-		for (int i = 0; i < numFrames; i++) {
-			MemoryFrame frame;
-			frame.start = i * memPerFrame;
-			frame.end = frame.start + memPerFrame - 1;
-			frame.free = true;
-			memoryFrames.push_back(frame);
+	void stop() {
+		lock_guard<mutex> lock(lifecycleMutex);
+		cores.requestStopAll();
+		while (!cores.empty()) {
+			retireCore();
 		}
+		cores.stopThreads();
+		counterThread = jthread();
+		compactorThread = jthread();
 	}
 
-	void initFlatMemory(){
-		lock_guard<mutex> lock(memoryMutex);
-		flatMemoryArray.clear();
-		flatMemoryArray.resize(maxOverallMem, true);
+	bool isRunning() {
+		lock_guard<mutex> lock(lifecycleMutex);
+		return !cores.empty();
 	}
 
-	void start() {
-		for (int i = 0; i < numCpu; i++) {
-			if(allocation_type == "flat") {
-				thread t(&Scheduler::runFlat, this, i);
-				t.detach();
+	// Grows or shrinks the pool without touching memory or the ready queue.
+	void resizeCores(int count) {
+		lock_guard<mutex> lock(lifecycleMutex);
+		if (!cores.empty()) {
+			while (cores.size() > count) {
+				retireCore();
 			}
-			else {
-				thread t(&Scheduler::runPaging, this, i);
-				t.detach();
+			while (cores.size() < count) {
+				spawnCore(cores.size());
 			}
 		}
-		thread t(&Scheduler::CPUcounter, this);
-		t.detach();
-		
+		numCpu = count;
+	}
+
+	int getQuantumCycles() {
+		return quantumCycles;
 	}
 
-	void CPUcounter() {
+	void CPUcounter(stop_token token) {
 		ll prevCtr = -1;
-		idleCPUTicks = mainCtr-1;
-		while (true) {
-			if (prevCtr == mainCtr) {
-				continue;
-			}
-			prevCtr = mainCtr;
+		idleCPUTicks = clock.now()-1;
+		while (clock.waitPast(prevCtr, token)) {
+			elapsedTicks++;
 			if (runningScreens.empty()) {
 				idleCPUTicks++;
 			}
+			if (numaNodes > 1) {
+				lock_guard<StatMutex> lock(queueMutex);
+				for (const auto& [core, screen] : runningScreens) {
+					size_t node = nodeOfCore(core);
+					if (node < nodeBusyTicks.size()) {
+						nodeBusyTicks[node]++;
+					}
+				}
+				nodeSamples++;
+			}
 		}
 	}
 	
+	// Flat mode only. Each tick earns compaction-budget bytes of copy credit; while memory is
+	// fragmented past compaction-threshold, or an allocation failed for want of a contiguous block,
+	// the credit is spent sliding resident blocks towards address 0. Credit only builds up while
+	// there is work, and is capped at max-overall-mem so a block larger than the budget still moves.
+	void compactor(stop_token token) {
+		ll prevCtr = -1;
+		ll credit = 0;
+		while (clock.waitPast(prevCtr, token)) {
+			if (compactionBudget == 0) {
+				credit = 0;
+				continue;
+			}
+			credit = min(credit + compactionBudget, maxOverallMem);
+			compactStep(credit);
+		}
+	}
+
+	// Caller holds memoryMutex.
+	bool needsCompaction() {
+		ll free = getFreeMem();
+		if (free == 0) {
+			return false;
+		}
+		return getLargestFreeBlock() * 100 < free * compactionThreshold;
+	}
+
+	// Moves blocks down to the lowest free address until credit runs out. Running processes are
+	// left where they are; the queue lock keeps them from being dispatched mid-move, and blocks
+	// above them slide down to just past their end. A pass that gets past every block clears
+	// compactionRequested.
+	void compactStep(ll& credit) {
+		lock_guard<StatMutex> queueLock(queueMutex);
+		lock_guard<StatMutex> memoryLock(memoryMutex);
+		if (!compactionRequested && !needsCompaction()) {
+			credit = 0;
+			return;
+		}
+		STAT_SCOPE(STAT_COMPACT);
+		ll started = nowNs();
+		set<shared_ptr<Screen>> running;
+		for (const auto& [core, screen] : runningScreens) {
+			running.insert(screen);
+		}
+		ll cursor = 0;
+		bool complete = true;
+		ll relocated = compactionRelocations;
+		for (const auto& [start, end, screen] : flatBlocksByStart()) {
+			ll length = end - start + 1;
+			if (start == cursor || running.count(screen) > 0) {
+				cursor = end + 1;
+				continue;
+			}
+			if (credit < length) {
+				complete = false;
+				break;
+			}
+			memmove(ram.at(cursor), ram.at(start), length);
+			freeMemoryFlat(static_cast<int>(start), static_cast<int>(end));
+			occupyMemoryFlat(static_cast<int>(cursor), static_cast<int>(cursor + length - 1));
+			flatMemoryMap[screen] = { cursor, cursor + length - 1 };
+			credit -= length;
+			compactionRelocations++;
+			compactionBytes += length;
+			cursor += length;
+		}
+		if (compactionRelocations != relocated) {
+			freeGeneration++;
+		}
+		if (complete) {
+			compactionRequested = false;
+			compactionPasses++;
+			credit = 0;
+		}
+		compactionNs += nowNs() - started;
+	}
+
 	ll getIdleTicks() {
 		return idleCPUTicks;
 	}
 
 	void pushQueue(shared_ptr<Screen> screen) {
+#if CSOPESY_STATS
+		screen->enqueuedAt = nowNs();
+		if (screen->firstEnqueuedAt == 0) {
+			screen->firstEnqueuedAt = screen->enqueuedAt;
+		}
+#endif
 		readyQueue.push_back(screen);
+		cores.notifyWork();
+	}
+
+	shared_ptr<Screen> popQueue() {
+		if (readyQueue.empty()) {
+			return nullptr;
+		}
+		shared_ptr<Screen> screen = readyQueue.front();
+		readyQueue.pop_front();
+		return screen;
+	}
+
+	void recordDispatch(shared_ptr<Screen> screen) {
+#if CSOPESY_STATS
+		ll now = nowNs();
+		STAT_RECORD(STAT_READY_WAIT, now - screen->enqueuedAt);
+		if (!screen->dispatched) {
+			STAT_RECORD(STAT_SCHED_LATENCY, now - screen->firstEnqueuedAt);
+		}
+#endif
+		if (!screen->dispatched) {
+			screen->firstRunAt = nowNs();
+		}
+		screen->dispatched = true;
+		coreStats.local().dispatches.fetch_add(1, memory_order_relaxed);
+		traceEvent(TRACE_DISPATCH, screen);
 	}
 
 	void removeFromBackingStore(const string& nameToRemove) {
+		STAT_SCOPE(STAT_BACKING_STORE_REMOVE);
 		vector<string> lines;
-		ifstream inputFile("backing_store.txt");
+		ifstream inputFile(backingStore + ".txt");
 
 		if (!inputFile.is_open()) {
 			cerr << "Could not open file for reading." << endl;
@@ -286,7 +1654,7 @@ public:
 
 		inputFile.close();
 
-		ofstream outputFile("backing_store.txt", ios::trunc);
+		ofstream outputFile(backingStore + ".txt", ios::trunc);
 		if (!outputFile.is_open()) {
 			cerr << "Could not open file for writing." << endl;
 			return;
@@ -300,352 +1668,655 @@ public:
 	}
 
 	void putInBackingStore(shared_ptr<Screen> oldest) {
-		ofstream file("backing_store.txt", ios::app);
+		STAT_SCOPE(STAT_BACKING_STORE_PUT);
+		evictions++;
+		ofstream file(backingStore + ".txt", ios::app);
 		if (file.is_open()) {
 			file << oldest->getProcessName() << endl;
 		}
 		file.close();
 	}
 
-	void runPaging(int id) {
-		ll prevCtr = -1;
-		while (true) {
-			if (prevCtr == mainCtr) {
+	// Waiting processes, oldest first. Caller holds queueMutex.
+	vector<MemoryWaiter*> waitersByArrival() {
+		vector<MemoryWaiter*> waiters;
+		for (auto& [need, waiter] : memoryWaitQueue) {
+			waiters.push_back(&waiter);
+		}
+		sort(waiters.begin(), waiters.end(), [](const MemoryWaiter* a, const MemoryWaiter* b) { return a->arrival < b->arrival; });
+		return waiters;
+	}
+
+	// Puts waiters back at the head of the ready queue in arrival order. Caller holds queueMutex.
+	void returnWaitersToReadyQueue() {
+		vector<MemoryWaiter*> waiters = waitersByArrival();
+		for (auto it = waiters.rbegin(); it != waiters.rend(); ++it) {
+			readyQueue.push_front((*it)->screen);
+		}
+		memoryWaitQueue.clear();
+		cores.notifyAllWork();
+	}
+
+	PooledMultimap<ll, MemoryWaiter>::iterator oldestWaiter() {
+		auto oldestIt = memoryWaitQueue.begin();
+		for (auto it = memoryWaitQueue.begin(); it != memoryWaitQueue.end(); ++it) {
+			if (it->second.arrival < oldestIt->second.arrival) {
+				oldestIt = it;
+			}
+		}
+		return oldestIt;
+	}
+
+	bool allocationCapped() {
+		if (admissionTick != clock.now()) {
+			admissionTick = clock.now();
+			failedThisTick = 0;
+		}
+		return failedThisTick >= admissionRetriesPerTick;
+	}
+
+	// One FCFS allocation attempt, counted against admission-retries-per-tick. Caller holds queueMutex.
+	bool tryAllocateFCFS(const shared_ptr<Screen>& screen) {
+		if (allocationCapped()) {
+			return false;
+		}
+		bool allocated = allocation_type == "flat" ? allocateMemoryFlatFCFS(screen) : allocateMemoryPagingFCFS(screen);
+		if (!allocated) {
+			failedThisTick++;
+			failedAllocations++;
+		}
+		return allocated;
+	}
+
+	// Called for an FCFS process without memory as it leaves the ready queue. It may only go ahead
+	// of the waiters if backfilling is on and the oldest waiter has not been overtaken
+	// admission-max-bypass times; otherwise, or if it does not fit, it joins the wait queue.
+	// Caller holds queueMutex.
+	bool admit(const shared_ptr<Screen>& screen) {
+		bool mayOvertake = memoryWaitQueue.empty()
+			|| (admissionBackfill && oldestWaiter()->second.bypassed < admissionMaxBypass);
+		if (mayOvertake && allocationCapped()) {
+			// Parked without a try, so it must not wait for a free that may never come.
+			admissionGeneration = -1;
+		}
+		if (mayOvertake && tryAllocateFCFS(screen)) {
+			if (!memoryWaitQueue.empty()) {
+				oldestWaiter()->second.bypassed++;
+				backfills++;
+			}
+			return true;
+		}
+		if (!mayOvertake && admissionBackfill) {
+			starvationHolds++;
+		}
+		memoryWaitQueue.emplace(screen->memory, MemoryWaiter{ screen, waiterArrivals++, 0 });
+		return false;
+	}
+
+	// Retries waiters once memory has been freed: the oldest first, then, while it may still be
+	// overtaken, the others from the smallest up. Admitted processes already hold their memory and
+	// go to the head of the ready queue. Caller holds queueMutex.
+	void admitWaiting() {
+		ll generation = freeGeneration;
+		if (memoryWaitQueue.empty() || generation == admissionGeneration) {
+			return;
+		}
+		vector<shared_ptr<Screen>> admitted;
+		while (!memoryWaitQueue.empty() && !allocationCapped()) {
+			auto head = oldestWaiter();
+			if (tryAllocateFCFS(head->second.screen)) {
+				admitted.push_back(head->second.screen);
+				memoryWaitQueue.erase(head);
 				continue;
 			}
-			prevCtr = mainCtr;
+			auto it = memoryWaitQueue.begin();
+			while (admissionBackfill && it != memoryWaitQueue.end() && head->second.bypassed < admissionMaxBypass) {
+				if (it == head) {
+					++it;
+					continue;
+				}
+				// Sizes only grow from here, so the first miss ends the scan.
+				if (!tryAllocateFCFS(it->second.screen)) {
+					break;
+				}
+				admitted.push_back(it->second.screen);
+				head->second.bypassed++;
+				backfills++;
+				it = memoryWaitQueue.erase(it);
+			}
+			break;
+		}
+		// A capped scan is picked up again next tick; otherwise wait for the next free.
+		if (!allocationCapped()) {
+			admissionGeneration = generation;
+		}
+		for (auto it = admitted.rbegin(); it != admitted.rend(); ++it) {
+			readyQueue.push_front(*it);
+		}
+		if (!admitted.empty()) {
+			cores.notifyAllWork();
+		}
+		admittedFromWait += admitted.size();
+	}
+
+	ll getMemoryWaitQueueLength() {
+		return memoryWaitQueue.size();
+	}
+
+	// True when no process is queued, waiting for memory or on a core. Cores pop a process and mark
+	// themselves used under queueMutex, so a process in hand is never missed.
+	bool isDrained() {
+		lock_guard<StatMutex> lock(queueMutex);
+		return readyQueue.empty() && memoryWaitQueue.empty() && getCoresUsed() == 0;
+	}
+
+	ll getBackfills() {
+		return backfills;
+	}
+
+	ll getFailedAllocations() {
+		return failedAllocations;
+	}
+
+	ll getStarvationHolds() {
+		return starvationHolds;
+	}
+
+	ll getAdmittedFromWait() {
+		return admittedFromWait;
+	}
+
+	// With several nodes a core looks numa-dispatch-window entries into the ready queue for a
+	// process whose memory is on its own node, and takes the head if there is none.
+	// Caller holds queueMutex.
+	shared_ptr<Screen> popQueueFor(int core) {
+		if (numaNodes > 1 && numaDispatchWindow > 0) {
+			int node = nodeOfCore(core);
+			ll window = min<ll>(numaDispatchWindow, readyQueue.size());
+			for (ll i = 0; i < window; i++) {
+				if (readyQueue[i]->memoryNode == node) {
+					shared_ptr<Screen> screen = readyQueue[i];
+					readyQueue.erase(readyQueue.begin() + i);
+					affineDispatches++;
+					return screen;
+				}
+			}
+		}
+		return popQueue();
+	}
+
+	// Counts dispatches away from a process's memory and moves between nodes. Caller holds queueMutex.
+	void recordNodeDispatch(const shared_ptr<Screen>& screen, int core) {
+		if (numaNodes <= 1) {
+			return;
+		}
+		int node = nodeOfCore(core);
+		if (screen->lastNode >= 0 && screen->lastNode != node) {
+			nodeMigrations++;
+		}
+		screen->lastNode = node;
+		if (screen->memoryNode >= 0 && screen->memoryNode != node) {
+			remoteDispatches++;
+		}
+	}
+
+	// Ticks an instruction run on another node than the process's memory has to wait: remote-access-penalty, or 0 when local.
+	ll remoteStall(const shared_ptr<Screen>& screen, int core) {
+		if (numaNodes <= 1 || remoteAccessPenalty == 0 || screen->memoryNode < 0 || screen->memoryNode == nodeOfCore(core)) {
+			return 0;
+		}
+		remoteStallTicks += remoteAccessPenalty;
+		return remoteAccessPenalty;
+	}
+
+	// Threads the core pool runs on once started; resizing cores later does not change it.
+	int getCoreThreads() {
+		if (coreThreads > 0) {
+			return static_cast<int>(coreThreads);
+		}
+		int host = max(1, static_cast<int>(thread::hardware_concurrency()));
+		return static_cast<int>(min<ll>(numCpu, host));
+	}
+
+	ll getCoreThreadResumes() {
+		return cores.getResumes();
+	}
+
+	ll getNumaNodes() {
+		return numaNodes;
+	}
+
+	// Caller holds memoryMutex.
+	ll getNodeFreeBytes(int node) {
+		ll low = node * nodeBytes();
+		ll high = low + nodeBytes();
+		ll free = 0;
+		for (const auto& [size, starts] : freeFrames) {
+			for (auto it = starts.lower_bound(static_cast<int>(low)); it != starts.end() && *it < high; ++it) {
+				free += size;
+			}
+		}
+		return free;
+	}
+
+	// "first-last" core ids of a node, or "none". Caller holds queueMutex.
+	string getNodeCores(int node) {
+		int first = -1;
+		int last = -1;
+		for (int core = 0; core < numCpu; core++) {
+			if (nodeOfCore(core) == node) {
+				first = first < 0 ? core : first;
+				last = core;
+			}
+		}
+		if (first < 0) {
+			return "none";
+		}
+		return first == last ? to_string(first) : to_string(first) + "-" + to_string(last);
+	}
+
+	// Share of the node's core-ticks spent running a process. Caller holds queueMutex.
+	double getNodeUtilization(int node) {
+		ll cores = 0;
+		for (int core = 0; core < numCpu; core++) {
+			cores += nodeOfCore(core) == node;
+		}
+		if (cores == 0 || nodeSamples == 0 || node >= static_cast<int>(nodeBusyTicks.size())) {
+			return 0;
+		}
+		return nodeBusyTicks[node] * 100.0 / (cores * nodeSamples);
+	}
+
+	ll getAffineDispatches() {
+		return affineDispatches;
+	}
+
+	ll getRemoteDispatches() {
+		return remoteDispatches;
+	}
+
+	ll getNodeMigrations() {
+		return nodeMigrations;
+	}
+
+	ll getRemoteAllocations() {
+		return remoteAllocations;
+	}
+
+	ll getRemoteStallTicks() {
+		return remoteStallTicks;
+	}
+
+	// Each core is a coroutine on the worker pool's threads; it gives its thread back while it waits
+	// for the next tick, for a process to be queued or for a remote-memory stall to pass.
+	CoreTask runPaging(stop_token token, int id) {
+		ll prevCtr = -1;
+		while (co_await cores.nextTick(prevCtr, token)) {
 			shared_ptr<Screen> screen;
 			{
-				lock_guard<mutex> lock(queueMutex);
+				unique_lock<StatMutex> lock(queueMutex);
+				admitWaiting();
 				if (readyQueue.empty()) {
 					runningScreens.erase(id);
-					coresUsed[id] = 0;
+					coreStats[id].used = 0;
+					// Nothing to run: sleep until a process is queued, then wait for the next tick as polling did.
+					if (memoryWaitQueue.empty() && co_await cores.waitForWork(lock, token)) {
+						prevCtr = clock.now();
+					}
 					continue;
 				}
-				screen = readyQueue.front();
-				readyQueue.pop_front();
+				screen = popQueueFor(id);
 				if (!screen->memoryAllocated) {
 					if (scheduler == "rr") {
 						if (!allocateMemoryPagingWithInterupt(screen)) {
 							continue;
 						}
-					} else if (!allocateMemoryPagingFCFS(screen)) {
-						readyQueue.push_front(screen);
+					} else if (!admit(screen)) {
 						continue;
 					}
 				}
-				current_process_task[id] = true;
+				recordDispatch(screen);
+				recordNodeDispatch(screen, id);
+				coreStats[id].running = true;
 				runningScreens[id] = screen;
 				screen->setCoreId(id);
-				coresUsed[id] = 1;
+				coreStats[id].used = 1;
 			}
 
 			if (scheduler == "rr") {
-				for (int i = 0; i < quantumCycles; i++) {
+				int quantum = quantumCycles;
+				for (int i = 0; i < quantum && !token.stop_requested(); i++) {
 					screen->execute();
+					co_await cores.sleepFor(instructionTime, token);
+					touchMemory(screen);
+					logInstruction(screen);
+					ll stall = remoteStall(screen, id);
+					for (ll seen = clock.now(); stall > 0 && co_await cores.nextTick(seen, token); stall--) {
+					}
 
 					if (screen->isFinished()) {
-						{
-							lock_guard<mutex> lock(memoryMutex);
-							freeMemoryPaging(screen);
-							auto it = find(oldest.begin(), oldest.end(), screen);
-							if (it != oldest.end()) {
-								oldest.erase(it);
-							}
+						finishProcess(screen, id);
+						for (ll seen = clock.now(), wait = delayPerExec; wait > 0 && co_await cores.nextTick(seen, token); wait--) {
 						}
-						delay();
 						break;
 					}
 
-					delay();
+					for (ll seen = clock.now(), wait = delayPerExec; wait > 0 && co_await cores.nextTick(seen, token); wait--) {
+					}
 
-					if (!current_process_task[id]) {
+					if (!coreStats[id].running) {
 						break;
 					}
 				}
 
+				traceEvent(screen->isFinished() ? TRACE_FINISH : (coreStats[id].running ? TRACE_QUANTUM_END : TRACE_PREEMPT), screen);
 				if (!screen->isFinished()) {
-					lock_guard<mutex> lock(queueMutex);
+					lock_guard<StatMutex> lock(queueMutex);
 					pushQueue(screen);
 				}
 			}
 			else if (scheduler == "fcfs") {
 
-				while (!screen->isFinished()) {
+				while (!screen->isFinished() && !token.stop_requested()) {
 					screen->execute();
-					delay();
+					co_await cores.sleepFor(instructionTime, token);
+					touchMemory(screen);
+					logInstruction(screen);
+					ll stall = remoteStall(screen, id);
+					for (ll seen = clock.now(); stall > 0 && co_await cores.nextTick(seen, token); stall--) {
+					}
+					for (ll seen = clock.now(), wait = delayPerExec; wait > 0 && co_await cores.nextTick(seen, token); wait--) {
+					}
 				}
-
-				lock_guard<mutex> lock(memoryMutex);
-				freeMemoryPaging(screen);
-				auto it = find(oldest.begin(), oldest.end(), screen);
-				if (it != oldest.end()) {
-					oldest.erase(it);
+				if (!screen->isFinished()) {
+					// Stopped mid-run: close its slice, keep its memory and put it back at the head of the queue.
+					traceEvent(TRACE_PREEMPT, screen);
+					lock_guard<StatMutex> lock(queueMutex);
+					readyQueue.push_front(screen);
+					continue;
 				}
+				traceEvent(TRACE_FINISH, screen);
+
+				finishProcess(screen, id);
+			}
+		}
+	}
+
+	// Called by core id once screen has run its last instruction.
+	void finishProcess(const shared_ptr<Screen>& screen, int id) {
+		releaseMemory(screen);
+		coreStats[id].finished.fetch_add(1, memory_order_relaxed);
+		if (archiveFinished) {
+			lock_guard<StatMutex> lock(queueMutex);
+			finishedQueue.push_back(screen);
+		}
+	}
+
+	// Returns a finished process's memory to the allocator and drops it from the eviction order.
+	void releaseMemory(shared_ptr<Screen> screen) {
+		lock_guard<StatMutex> lock(memoryMutex);
+		freeGeneration++;
+		swap.discard(screen->getProcessName());
+		if (allocation_type == "flat") {
+			auto range = flatMemoryMap.find(screen);
+			if (range != flatMemoryMap.end()) {
+				freeMemoryFlat(range->second.first, range->second.second);
+				flatMemoryMap.erase(range);
 			}
+			screen->allocatedMemory = 0;
+		}
+		else {
+			freeMemoryPaging(screen);
+		}
+		auto it = find(oldest.begin(), oldest.end(), screen);
+		if (it != oldest.end()) {
+			oldest.erase(it);
 		}
 	}
 
 	void freeMemoryPaging(shared_ptr<Screen> screen) {
 		screen->allocatedMemory = 0;
-		map<shared_ptr<Screen>, vector<MemoryFrame>>::iterator it = memoryMap.find(screen);
+		screen->memoryNode = -1;
+		auto it = memoryMap.find(screen);
 		if (it == memoryMap.end()) {
 			return;
 		}
-		vector<MemoryFrame> frames = memoryMap[screen];
-		for (auto& frame : frames) {
-			memoryFrames.push_back(frame);
-			pagesOut++;
+		ll returned = 0;
+		for (auto& frame : it->second) {
+			if (sharedFrames.count(frame.start)) {
+				unshareFrame(frame.start);
+				continue;
+			}
+			returnFrame(frame);
+			returned++;
 		}
+		coreStats.local().pagesOut.fetch_add(returned, memory_order_relaxed);
 		memoryMap.erase(it);
 	}
 
+	// Moves a resident (paging or flat) to the backing store, taking it off its core if it is
+	// running. The caller removes it from oldest. Caller holds queueMutex and memoryMutex.
+	void evictResident(const shared_ptr<Screen>& victim) {
+		auto runningIt = runningScreens.find(victim->getCoreId());
+		if (runningIt != runningScreens.end() && runningIt->second == victim) {
+			runningScreens.erase(victim->getCoreId());
+			coreStats[victim->getCoreId()].used = 0;
+			coreStats[victim->getCoreId()].running = false;
+		}
+		traceEvent(TRACE_EVICT, victim);
+		putInBackingStore(victim);
+		swapOut(victim);
+		if (allocation_type == "flat") {
+			auto range = flatMemoryMap.find(victim);
+			if (range != flatMemoryMap.end()) {
+				freeMemoryFlat(static_cast<int>(range->second.first), static_cast<int>(range->second.second));
+				flatMemoryMap.erase(range);
+			}
+			victim->allocatedMemory = 0;
+		}
+		else {
+			freeMemoryPaging(victim);
+		}
+		victim->memoryAllocated = false;
+	}
+
 	bool allocateMemoryPagingWithInterupt(shared_ptr<Screen> screen) {
-		lock_guard<mutex> lock(memoryMutex);
-		ll mem_to_allocate = safeCeil(screen->memory, memPerFrame);
+		STAT_SCOPE(STAT_ALLOC_PAGING);
+		ll traceStart = Tracer::instance().clock();
+		lock_guard<StatMutex> lock(memoryMutex);
 		removeFromBackingStore(screen->getProcessName());
-		while (memoryFrames.size() < mem_to_allocate) {
+		while (!mapFrames(screen)) {
 			if (oldest.empty()) {
 				return false;
 			}
-			shared_ptr<Screen> oldestScreen = oldest.front();
-				if (runningScreens[oldestScreen->getCoreId()] == oldestScreen) {
-					runningScreens.erase(oldestScreen->getCoreId());
-					coresUsed[oldestScreen->getCoreId()] = 0;
-					current_process_task[oldestScreen->getCoreId()] = false;
-				}
-				putInBackingStore(oldestScreen);
-				freeMemoryPaging(oldestScreen);
-				oldestScreen->memoryAllocated = false;
-				oldest.pop_front();
+			evictResident(oldest.front());
+			oldest.pop_front();
 		}
 
-		while (mem_to_allocate-- > 0) {
-			MemoryFrame frame = memoryFrames.front();
-			memoryFrames.pop_front();
-			frame.free = false;
-			memoryMap[screen].push_back(frame);
-			pagesIn++;
-			screen->allocatedMemory += memPerFrame;
-		}
 		screen->memoryAllocated = true;
+		swapIn(screen);
 		oldest.push_back(screen);
+		traceSpan(TRACE_PAGE_IN, screen, traceStart);
 		return true;
 	}
 
 	bool allocateMemoryPagingFCFS(shared_ptr<Screen> screen) {
-		lock_guard<mutex> lock(memoryMutex);
-		ll mem_to_allocate = safeCeil(screen->memory, memPerFrame);
-
-		if(memoryFrames.size() < mem_to_allocate) {
+		STAT_SCOPE(STAT_ALLOC_PAGING);
+		ll traceStart = Tracer::instance().clock();
+		lock_guard<StatMutex> lock(memoryMutex);
+		if (!mapFrames(screen)) {
 			return false;
 		}
-		
-		while (mem_to_allocate-- > 0) {
-			MemoryFrame frame = memoryFrames.front();
-			memoryFrames.pop_front();
-			frame.free = false;
-			memoryMap[screen].push_back(frame);
-		}
 		screen->memoryAllocated = true;
+		swapIn(screen);
 		oldest.push_back(screen);
+		traceSpan(TRACE_PAGE_IN, screen, traceStart);
 		return true;
 	}
 
-	void runFlat(int id) {
+	CoreTask runFlat(stop_token token, int id) {
 		ll prevCtr = -1;
-
-		while (true) {
-			if (prevCtr == mainCtr) {
-				continue;
-			}
-			prevCtr = mainCtr;
+		while (co_await cores.nextTick(prevCtr, token)) {
 			shared_ptr<Screen> screen;
 			{
-				lock_guard<mutex> lock(queueMutex);
+				unique_lock<StatMutex> lock(queueMutex);
+				admitWaiting();
 				if (readyQueue.empty()) {
 					runningScreens.erase(id);
-					coresUsed[id] = 0;
+					coreStats[id].used = 0;
+					// Nothing to run: sleep until a process is queued, then wait for the next tick as polling did.
+					if (memoryWaitQueue.empty() && co_await cores.waitForWork(lock, token)) {
+						prevCtr = clock.now();
+					}
 					continue;
 				}
-				screen = readyQueue.front();
-				readyQueue.pop_front();
+				screen = popQueue();
 				if (!screen->memoryAllocated) {
 					if (scheduler == "rr") {
 						if (!allocateMemoryFlatWithInterupt(screen)) {
 							continue;
 						}
-					} else if (!allocateMemoryFlatFCFS(screen)) {
-						readyQueue.push_front(screen);
+					} else if (!admit(screen)) {
 						continue;
 					}
 				}
-				current_process_task[id] = true;
+				recordDispatch(screen);
+				coreStats[id].running = true;
 				runningScreens[id] = screen;
 				screen->setCoreId(id);
-				coresUsed[id] = 1;
+				coreStats[id].used = 1;
 			}
 
 			if (scheduler == "rr") {
-				for (int i = 0; i < quantumCycles; i++) {
-					if (!current_process_task[id]) {
+				int quantum = quantumCycles;
+				for (int i = 0; i < quantum && !token.stop_requested(); i++) {
+					if (!coreStats[id].running) {
 						continue; 
 					}
 
 					screen->execute();
+					co_await cores.sleepFor(instructionTime, token);
+					touchMemory(screen);
+					logInstruction(screen);
 
 					if (screen->isFinished()) {
-						{
-							lock_guard<mutex> lock(memoryMutex);
-							freeMemoryFlat(flatMemoryMap[screen].first, flatMemoryMap[screen].second);
-							screen->allocatedMemory = 0;
-							auto it = find(oldest.begin(), oldest.end(), screen);
-							if (it != oldest.end()) {
-								oldest.erase(it);
-							}
+						finishProcess(screen, id);
+						for (ll seen = clock.now(), wait = delayPerExec; wait > 0 && co_await cores.nextTick(seen, token); wait--) {
 						}
-						delay();
 						break;
 					}
-					delay();
+					for (ll seen = clock.now(), wait = delayPerExec; wait > 0 && co_await cores.nextTick(seen, token); wait--) {
+					}
 				}
+				traceEvent(screen->isFinished() ? TRACE_FINISH : (coreStats[id].running ? TRACE_QUANTUM_END : TRACE_PREEMPT), screen);
 				if (!screen->isFinished()) {
-					lock_guard<mutex> lock(queueMutex);
+					lock_guard<StatMutex> lock(queueMutex);
 					pushQueue(screen);
 				}
 			}
 
 			else if (scheduler == "fcfs") {
-				while (!screen->isFinished()) {
+				while (!screen->isFinished() && !token.stop_requested()) {
 					screen->execute();
-					delay();
+					co_await cores.sleepFor(instructionTime, token);
+					touchMemory(screen);
+					logInstruction(screen);
+					for (ll seen = clock.now(), wait = delayPerExec; wait > 0 && co_await cores.nextTick(seen, token); wait--) {
+					}
 				}
-
-				lock_guard<mutex> lock(memoryMutex);
-				freeMemoryFlat(flatMemoryMap[screen].first, flatMemoryMap[screen].second);
-				screen->allocatedMemory = 0;
-				auto it = find(oldest.begin(), oldest.end(), screen);
-				if (it != oldest.end()) {
-					oldest.erase(it);
+				if (!screen->isFinished()) {
+					// Stopped mid-run: close its slice, keep its memory and put it back at the head of the queue.
+					traceEvent(TRACE_PREEMPT, screen);
+					lock_guard<StatMutex> lock(queueMutex);
+					readyQueue.push_front(screen);
+					continue;
 				}
+				traceEvent(TRACE_FINISH, screen);
 
-				flatMemoryMap.erase(screen);
+				finishProcess(screen, id);
 			}
 		}
 	}
 
 
 	void freeMemoryFlat(int start, int end) {
-		for (int i = start; i <= end; i++) {
-			flatMemoryArray[i] = true;
-		}
+		flatMemoryBitmap.clearRange(start, end);
 	}
 
 	void occupyMemoryFlat(int start, int end) {
-		for (int i = start; i <= end; i++) {
-			flatMemoryArray[i] = false;
-		}
+		flatMemoryBitmap.setRange(start, end);
 	}
 
 	bool allocateMemoryFlatWithInterupt(std::shared_ptr<Screen> screen) {
-		lock_guard<mutex> lock(memoryMutex);
-		ll mem_to_allocate = memPerFrame;
+		STAT_SCOPE(STAT_ALLOC_FLAT);
+		ll traceStart = Tracer::instance().clock();
+		lock_guard<StatMutex> lock(memoryMutex);
+		ll mem_to_allocate = screen->memory;
 		removeFromBackingStore(screen->getProcessName());
-		int ctr;
 		int startIdx, endIdx;
 		bool found;
 
 		auto allocateMemoryBlock = [&]() {
-
-			startIdx = -1, endIdx = -1, ctr = 0, found = false;
-
-			for (int i = 0; i < flatMemoryArray.size(); i++) {
-				if (flatMemoryArray[i]) {
-					if (ctr == 0) {
-						startIdx = i;
-					}
-					ctr++;
-
-					if (ctr == mem_to_allocate) {
-						endIdx = i;
-						found = true;
-						break;
-					}
-				}
-				else {
-					ctr = 0;
-					startIdx = -1;
-				}
-			}
+			ll start = flatMemoryBitmap.findFreeRun(mem_to_allocate);
+			found = start >= 0;
+			startIdx = static_cast<int>(start);
+			endIdx = found ? static_cast<int>(start + mem_to_allocate - 1) : -1;
 		};
 
 		allocateMemoryBlock();
 
+		if (!found && getFreeMem() >= mem_to_allocate) {
+			// Enough memory is free, just not in one piece; evict now, but let the compactor catch up.
+			compactionRequested = true;
+		}
 		while (!found) {
-			if (!oldest.empty()) {
+			if (oldest.empty()) {
 				return false;
 			}
-			shared_ptr<Screen> oldestScreen = oldest.front();
-			if (runningScreens[oldestScreen->getCoreId()] == oldestScreen) {
-				runningScreens.erase(oldestScreen->getCoreId());
-				current_process_task[oldestScreen->getCoreId()] = false;
-			}
-			putInBackingStore(oldestScreen);
-			freeMemoryFlat(flatMemoryMap[oldestScreen].first, flatMemoryMap[oldestScreen].second);
-			oldestScreen->allocatedMemory = 0;
-			flatMemoryMap.erase(oldestScreen);
-			oldestScreen->memoryAllocated = false;
+			evictResident(oldest.front());
 			oldest.pop_front();
 			allocateMemoryBlock();
 		}
 		screen->allocatedMemory = mem_to_allocate;
+		screen->memoryAllocated = true;
 		flatMemoryMap[screen] = { startIdx, endIdx };
 		occupyMemoryFlat(startIdx, endIdx);
+		swapIn(screen);
 		oldest.push_back(screen);
+		traceSpan(TRACE_PAGE_IN, screen, traceStart);
 		return true;
 	}
 
 	bool allocateMemoryFlatFCFS(std::shared_ptr<Screen> screen) {
-		lock_guard<mutex> lock(memoryMutex);
-		ll mem_to_allocate = memPerFrame;
+		STAT_SCOPE(STAT_ALLOC_FLAT);
+		ll traceStart = Tracer::instance().clock();
+		lock_guard<StatMutex> lock(memoryMutex);
+		ll mem_to_allocate = screen->memory;
 
-		int ctr;
 		int startIdx, endIdx;
 		bool found;
 
 		auto allocateMemoryBlock = [&]() {
-
-			startIdx = -1, endIdx = -1, ctr = 0, found = false;
-
-			for (int i = 0; i < flatMemoryArray.size(); i++) {
-				if (flatMemoryArray[i]) {
-					if (ctr == 0) {
-						startIdx = i;
-					}
-					ctr++;
-
-					if (ctr == mem_to_allocate) {
-						endIdx = i;
-						found = true;
-						break;
-					}
-				}
-				else {
-					ctr = 0;
-					startIdx = -1;
-				}
-			}
+			ll start = flatMemoryBitmap.findFreeRun(mem_to_allocate);
+			found = start >= 0;
+			startIdx = static_cast<int>(start);
+			endIdx = found ? static_cast<int>(start + mem_to_allocate - 1) : -1;
 		};
 
 		allocateMemoryBlock();
 
 		if(!found) {
+			compactionRequested = true;
 			return false;
 		}
 
+		screen->allocatedMemory = mem_to_allocate;
+		screen->memoryAllocated = true;
 		flatMemoryMap[screen] = { startIdx, endIdx };
 		occupyMemoryFlat(startIdx, endIdx);
+		swapIn(screen);
 		oldest.push_back(screen);
+		traceSpan(TRACE_PAGE_IN, screen, traceStart);
 		return true;
 	}
 
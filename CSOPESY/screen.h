@@ -16,14 +16,23 @@ protected:
 	void write(const string& text, WORD color = 7) {
 		lock_guard<mutex> lock(console_mutex);
 		buffer.push_back({ text, color });
+		if (!rendering) {
+			return;
+		}
 		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), color);
 		cout << text << endl;
 		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7);
 	}
 
 public:
+	// Turned off by headless runs; buffers are still kept so screens can be inspected afterwards.
+	inline static atomic<bool> rendering = true;
+
 	virtual void redraw() {
-		system("cls");
+		if (!rendering) {
+			return;
+		}
+		clearConsole();
 		lock_guard<mutex> lock(console_mutex);
 		for (const auto& entry : buffer) {
 			SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), entry.color);
@@ -40,16 +49,63 @@ public:
 
 };
 
-class Screen : public abstract_screen {
+// Everything needed to recreate a Screen; used by checkpoints. Times are nowNs() values.
+struct ScreenState {
+	string processName;
+	int currentLine = 1;
+	int totalLine = 0;
+	ll timestamp = 0;
+	bool finished = false;
+	bool initialized = false;
+	int coreId = -1;
+	int memory = 0;
+	bool memoryAllocated = false;
+	int allocatedMemory = 0;
+	ll createdAt = 0;
+	ll firstRunAt = 0;
+	ll finishedAt = 0;
+	ll enqueuedAt = 0;
+	ll firstEnqueuedAt = 0;
+	bool dispatched = false;
+	ll priority = 0;
+	vector<BufferEntry> buffer;
+};
+
+// The part of a process a core reads or writes on every dispatch and instruction, on a cache line
+// of its own so that cores never pull in the name, console buffer or locks the UI uses. The
+// progress fields are atomics because the console reads them while a core is running the process.
+class alignas(64) ProcessControl {
+protected:
+	atomic<int> currentLine = 1;
+	int totalLine = 0;
+	atomic<int> coreId = -1;
+	atomic<bool> finished = false;
+
+public:
+	bool memoryAllocated = false;
+	bool dispatched = false;
+	int memory = 0;
+	int allocatedMemory = 0;
+	// NUMA node holding most of its memory (-1 while it has none) and of the core it last ran on.
+	int memoryNode = -1;
+	int lastNode = -1;
+	// Written by the core before finished is set, so it is valid once isFinished() is true.
+	ll finishedAt = 0;
+	ll enqueuedAt = 0;
+	ll firstRunAt = 0;
+	ll firstEnqueuedAt = 0;
+};
+
+static_assert(sizeof(ProcessControl) == 64, "ProcessControl should fill exactly one cache line");
+
+// A process: ProcessControl for the scheduler, and the cold descriptor (name, creation time,
+// console buffer) for the UI and checkpoints. Processes are shared by pointer and never copied;
+// ScreenState is the copy.
+class Screen : public abstract_screen, public ProcessControl {
 private:
 	string processName;
-	int currentLine;
-	int totalLine;
 	time_t timestamp;
-	bool finished = false;
 	bool initialized = false;
-	int core_id = -1;
-	mutex screen_mutex;
 
 
 	stringstream
@@ -58,65 +114,101 @@ private:
 		char buffer[26];
 		ctime_s(buffer, sizeof(buffer), &timestamp);
 		ss << "Process: " << processName << endl;
-		if (finished) {
+		if (isFinished()) {
 			ss << "Finished!" << endl;
 		}
 		else {
-			ss << "Current Line: " << currentLine << " / " << totalLine << endl;
+			ss << "Current Line: " << getCurrentLine() << " / " << totalLine << endl;
 		}
 		ss << "Timestamp: " << buffer;
+		if (priority != 0) {
+			ss << "Priority: " << priority << endl;
+		}
 
 		return ss;
 	}
 
 public:
-	int memory;
-	bool memoryAllocated = false;
-	int allocatedMemory = 0;
+	ll createdAt = nowNs();
+	// Carried from the arrival that created the process; no scheduling policy reads it yet.
+	ll priority = 0;
 
 	Screen(std::string name, int min, int max, int minMem = 0, int maxMem = 0)
-		: processName(name), currentLine(1), timestamp(time(nullptr)) {
+		: processName(name), timestamp(time(nullptr)) {
 		srand(static_cast<unsigned int>(time(nullptr)));
 		totalLine = min + rand() % ((max + 1) - min);
 		memory =  minMem + rand() % ((maxMem + 1) - minMem);
 	}
 
-	Screen(const Screen& other) {
-		processName = other.processName;
-		currentLine = other.currentLine;
-		totalLine = other.totalLine;
-		timestamp = other.timestamp;
-		finished = other.finished;
-		initialized = other.initialized;
-		core_id = other.core_id;
-		memory = other.memory;
-		memoryAllocated = other.memoryAllocated;
+	Screen(const Screen&) = delete;
+	Screen& operator=(const Screen&) = delete;
 
+	Screen() {
 	}
 
-	Screen& operator=(const Screen& other) {
-		if (this == &other)
-			return *this;
-		processName = other.processName;
-		currentLine = other.currentLine;
-		totalLine = other.totalLine;
-		timestamp = other.timestamp;
-		buffer = other.buffer;
-		finished = other.finished;
-		initialized = other.initialized;
-		core_id = other.core_id;
-		memory = other.memory;
-		memoryAllocated = other.memoryAllocated;
-		return *this;
+	explicit Screen(const ScreenState& state)
+		: processName(state.processName), timestamp(static_cast<time_t>(state.timestamp)), initialized(state.initialized) {
+		currentLine = state.currentLine;
+		totalLine = state.totalLine;
+		finished = state.finished;
+		coreId = state.coreId;
+		buffer = state.buffer;
+		memory = state.memory;
+		memoryAllocated = state.memoryAllocated;
+		allocatedMemory = state.allocatedMemory;
+		createdAt = state.createdAt;
+		firstRunAt = state.firstRunAt;
+		finishedAt = state.finishedAt;
+		enqueuedAt = state.enqueuedAt;
+		firstEnqueuedAt = state.firstEnqueuedAt;
+		dispatched = state.dispatched;
+		priority = state.priority;
 	}
 
-	Screen() {
+	// A new process continuing this one's program from its current line, as after fork().
+	ScreenState forkState(const string& childName) {
+		ScreenState state;
+		state.currentLine = getCurrentLine();
+		state.processName = childName;
+		state.totalLine = totalLine;
+		state.timestamp = static_cast<ll>(time(nullptr));
+		state.memory = memory;
+		state.createdAt = nowNs();
+		state.priority = priority;
+		return state;
+	}
+
+	// Safe to call while a core is executing this process.
+	ScreenState saveState() {
+		ScreenState state;
+		state.finished = isFinished();
+		state.finishedAt = state.finished ? finishedAt : 0;
+		state.currentLine = getCurrentLine();
+		{
+			lock_guard<mutex> lock(console_mutex);
+			state.buffer = buffer;
+		}
+		state.processName = processName;
+		state.totalLine = totalLine;
+		state.timestamp = static_cast<ll>(timestamp);
+		state.initialized = initialized;
+		state.coreId = getCoreId();
+		state.memory = memory;
+		state.memoryAllocated = memoryAllocated;
+		state.allocatedMemory = allocatedMemory;
+		state.createdAt = createdAt;
+		state.firstRunAt = firstRunAt;
+		state.enqueuedAt = enqueuedAt;
+		state.firstEnqueuedAt = firstEnqueuedAt;
+		state.dispatched = dispatched;
+		state.priority = priority;
+		return state;
 	}
 	void setCoreId(int id) {
-		core_id = id;
+		coreId.store(id, memory_order_relaxed);
 	}
 	int getCoreId() const {
-		return core_id;
+		return coreId.load(memory_order_relaxed);
 	}
 	string convert_unix_to_string(time_t unix_timestamp) {
 		struct tm time_info;
@@ -143,7 +235,7 @@ public:
 	}
 
 	int getCurrentLine() const {
-		return currentLine;
+		return currentLine.load(memory_order_relaxed);
 	}
 
 	int getTotalLine() const {
@@ -166,22 +258,29 @@ public:
 		initialized = true;
 	}
 
+	// Wall-clock time one instruction occupies its core. The core waits it out after execute()
+	// without holding a thread, see WorkerPool::sleepFor.
+	static constexpr chrono::milliseconds INSTRUCTION_TIME{ 10 };
+
+	// Only the core running the process calls this, so the increment needs no read-modify-write.
 	void execute() {
-		lock_guard<mutex> lock(screen_mutex);
-		currentLine++;
-		if (currentLine == totalLine) {
-			finished = true;
+		int line = currentLine.load(memory_order_relaxed) + 1;
+		currentLine.store(line, memory_order_relaxed);
+		if (line >= totalLine) {
+			finishedAt = nowNs();
+			finished.store(true, memory_order_release);
 		}
-		this_thread::sleep_for(chrono::milliseconds(10));
 	}
 
 	void openScreen() {
-		system("cls");
+		if (rendering) {
+			clearConsole();
+		}
 		screenInfo();
 	}
 
-	bool isFinished() {
-		return finished;
+	bool isFinished() const {
+		return finished.load(memory_order_acquire);
 	}
 	void screenInfo() {
 		string content = printScreen_helper().str();
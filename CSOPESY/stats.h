@@ -0,0 +1,248 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+typedef unsigned long long ull;
+
+// Latency instrumentation is on by default in debug builds only. Release builds
+// can opt in with CSOPESY_STATS=1; otherwise every hook below compiles to nothing.
+#ifndef CSOPESY_STATS
+#ifdef _DEBUG
+#define CSOPESY_STATS 1
+#else
+#define CSOPESY_STATS 0
+#endif
+#endif
+
+enum StatId {
+	STAT_READY_WAIT,
+	STAT_SCHED_LATENCY,
+	STAT_ALLOC_PAGING,
+	STAT_ALLOC_FLAT,
+	STAT_BACKING_STORE_REMOVE,
+	STAT_BACKING_STORE_PUT,
+	STAT_SWAP_IN,
+	STAT_SWAP_OUT,
+	STAT_COMPACT,
+	STAT_QUEUE_LOCK_WAIT,
+	STAT_QUEUE_LOCK_HOLD,
+	STAT_MEMORY_LOCK_WAIT,
+	STAT_MEMORY_LOCK_HOLD,
+	STAT_COUNT
+};
+
+const char* statName(int id) {
+	switch (id) {
+	case STAT_READY_WAIT: return "ready-queue-wait";
+	case STAT_SCHED_LATENCY: return "enqueue-to-first-run";
+	case STAT_ALLOC_PAGING: return "alloc-paging";
+	case STAT_ALLOC_FLAT: return "alloc-flat";
+	case STAT_BACKING_STORE_REMOVE: return "backing-store-remove";
+	case STAT_BACKING_STORE_PUT: return "backing-store-put";
+	case STAT_SWAP_IN: return "swap-in-copy";
+	case STAT_SWAP_OUT: return "swap-out-copy";
+	case STAT_COMPACT: return "compact-step";
+	case STAT_QUEUE_LOCK_WAIT: return "queueMutex-wait";
+	case STAT_QUEUE_LOCK_HOLD: return "queueMutex-hold";
+	case STAT_MEMORY_LOCK_WAIT: return "memoryMutex-wait";
+	case STAT_MEMORY_LOCK_HOLD: return "memoryMutex-hold";
+	}
+	return "unknown";
+}
+
+ll nowNs() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct HistogramSnapshot {
+	vector<ull> counts;
+	ull total = 0;
+	ull maxValue = 0;
+
+	ull percentile(double p) const;
+};
+
+// Log-linear (HDR-style) histogram: 16 linear sub-buckets per power of two,
+// which keeps the relative error of any reported value under ~6%.
+class LatencyHistogram {
+public:
+	static const int SUB_BITS = 4;
+	static const int SUB_COUNT = 1 << SUB_BITS;
+	static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+	static int bucketOf(ull value) {
+		if (value < SUB_COUNT) {
+			return static_cast<int>(value);
+		}
+		int msb = 63 - countl_zero(value);
+		int shift = msb - SUB_BITS;
+		return (shift + 1) * SUB_COUNT + static_cast<int>((value >> shift) & (SUB_COUNT - 1));
+	}
+
+	static ull bucketHigh(int idx) {
+		if (idx < SUB_COUNT) {
+			return idx;
+		}
+		int shift = idx / SUB_COUNT - 1;
+		ull low = static_cast<ull>(SUB_COUNT + idx % SUB_COUNT) << shift;
+		return low + ((1ULL << shift) - 1);
+	}
+
+	// Only the owning thread records, so relaxed atomics are enough for readers to merge safely.
+	void record(ull value) {
+		counts[bucketOf(value)].fetch_add(1, memory_order_relaxed);
+		total.fetch_add(1, memory_order_relaxed);
+		if (value > maxValue.load(memory_order_relaxed)) {
+			maxValue.store(value, memory_order_relaxed);
+		}
+	}
+
+	void mergeInto(HistogramSnapshot& snapshot) const {
+		for (int i = 0; i < BUCKETS; i++) {
+			snapshot.counts[i] += counts[i].load(memory_order_relaxed);
+		}
+		snapshot.total += total.load(memory_order_relaxed);
+		snapshot.maxValue = max(snapshot.maxValue, maxValue.load(memory_order_relaxed));
+	}
+
+	void reset() {
+		for (int i = 0; i < BUCKETS; i++) {
+			counts[i].store(0, memory_order_relaxed);
+		}
+		total.store(0, memory_order_relaxed);
+		maxValue.store(0, memory_order_relaxed);
+	}
+
+private:
+	atomic<ull> counts[BUCKETS] = {};
+	atomic<ull> total = 0;
+	atomic<ull> maxValue = 0;
+};
+
+ull HistogramSnapshot::percentile(double p) const {
+	if (total == 0) {
+		return 0;
+	}
+	ull rank = static_cast<ull>(ceil(p / 100.0 * total));
+	ull seen = 0;
+	for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank && counts[i] > 0) {
+			return min(LatencyHistogram::bucketHigh(i), maxValue);
+		}
+	}
+	return maxValue;
+}
+
+struct ThreadStats {
+	LatencyHistogram histograms[STAT_COUNT];
+};
+
+class StatsRegistry {
+private:
+	mutex registryMutex;
+	// Blocks are never freed so that samples from exited threads still show up when merging.
+	vector<unique_ptr<ThreadStats>> threads;
+
+public:
+	static StatsRegistry& instance() {
+		static StatsRegistry registry;
+		return registry;
+	}
+
+	ThreadStats& local() {
+		thread_local ThreadStats* mine = nullptr;
+		if (mine == nullptr) {
+			auto block = make_unique<ThreadStats>();
+			mine = block.get();
+			lock_guard<mutex> lock(registryMutex);
+			threads.push_back(move(block));
+		}
+		return *mine;
+	}
+
+	void record(StatId id, ll ns) {
+		local().histograms[id].record(ns < 0 ? 0 : static_cast<ull>(ns));
+	}
+
+	HistogramSnapshot merged(StatId id) {
+		HistogramSnapshot snapshot;
+		snapshot.counts.assign(LatencyHistogram::BUCKETS, 0);
+		lock_guard<mutex> lock(registryMutex);
+		for (auto& block : threads) {
+			block->histograms[id].mergeInto(snapshot);
+		}
+		return snapshot;
+	}
+
+	void reset() {
+		lock_guard<mutex> lock(registryMutex);
+		for (auto& block : threads) {
+			for (auto& histogram : block->histograms) {
+				histogram.reset();
+			}
+		}
+	}
+};
+
+class ScopedStatTimer {
+private:
+	StatId id;
+	ll start;
+
+public:
+	ScopedStatTimer(StatId id) : id(id), start(nowNs()) {}
+	~ScopedStatTimer() {
+		StatsRegistry::instance().record(id, nowNs() - start);
+	}
+};
+
+#if CSOPESY_STATS
+
+#define STAT_RECORD(id, ns) StatsRegistry::instance().record(id, ns)
+#define STAT_SCOPE(id) ScopedStatTimer scopedStatTimer(id)
+
+// Drop-in replacement for std::mutex that records how long callers waited for it and how long it was held.
+class StatMutex {
+private:
+	mutex inner;
+	StatId waitStat;
+	StatId holdStat;
+	ll lockedAt = 0;
+
+public:
+	StatMutex(StatId waitStat, StatId holdStat) : waitStat(waitStat), holdStat(holdStat) {}
+
+	void lock() {
+		ll requestedAt = nowNs();
+		inner.lock();
+		lockedAt = nowNs();
+		StatsRegistry::instance().record(waitStat, lockedAt - requestedAt);
+	}
+
+	bool try_lock() {
+		if (!inner.try_lock()) {
+			return false;
+		}
+		lockedAt = nowNs();
+		return true;
+	}
+
+	void unlock() {
+		ll held = nowNs() - lockedAt;
+		inner.unlock();
+		StatsRegistry::instance().record(holdStat, held);
+	}
+};
+
+#else
+
+#define STAT_RECORD(id, ns) ((void)0)
+#define STAT_SCOPE(id) ((void)0)
+
+class StatMutex : public mutex {
+public:
+	StatMutex(StatId, StatId) {}
+};
+
+#endif
@@ -0,0 +1,452 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+// One config key a sweep varies: a list of values, or for random search an integer range.
+struct SweepAxis {
+	string key;
+	vector<string> values;
+	bool range = false;
+	ll low = 0;
+	ll high = 0;
+	bool powerOfTwo = false;
+};
+
+struct SweepOptions {
+	string specPath;
+	string configPath = "config.txt";
+	string outputPath;
+	vector<string> overrides;
+	ll durationTicks = 1000;
+	ll tickMicros = 100000;
+	// Simulators run at once; 0 means one per host core.
+	int jobs = 0;
+	// 0 runs the full grid; otherwise this many random points.
+	ll samples = 0;
+	ll seed = 1;
+};
+
+// What one simulator did with one point of the sweep. Turnaround is wall time in microseconds over
+// the processes that finished; utilization averages the share of busy cores sampled every tick.
+struct SweepResult {
+	vector<string> values;
+	string error;
+	ll ticks = 0;
+	ll created = 0;
+	ll finished = 0;
+	double throughput = 0;
+	double turnaroundMean = 0;
+	ll turnaroundP99 = 0;
+	ll pageFaults = 0;
+	ll pagesOut = 0;
+	double utilization = 0;
+};
+
+// Reads "key v1,v2,..." or "key low..high" lines ("=" or ":" may follow the key; # starts a
+// comment). Keys must be config keys; values are checked when each run reads its config.
+bool parseSweepSpec(const string& path, vector<SweepAxis>& axes, vector<string>& errors) {
+	ifstream file(path);
+	if (!file.is_open()) {
+		errors.push_back("could not open sweep spec " + path);
+		return false;
+	}
+	string line;
+	int lineNumber = 0;
+	while (getline(file, line)) {
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+		string_view text = trimConfigText(line);
+		if (text.empty()) {
+			continue;
+		}
+		string where = path + ":" + to_string(lineNumber);
+		size_t split = text.find_first_of(" \t=:");
+		if (split == string_view::npos) {
+			errors.push_back(where + ": expected a key and its values");
+			continue;
+		}
+		SweepAxis axis;
+		axis.key = string(text.substr(0, split));
+		string values(trimConfigText(text.substr(split + 1)));
+		if (!values.empty() && (values[0] == '=' || values[0] == ':')) {
+			values = string(trimConfigText(string_view(values).substr(1)));
+		}
+		const ConfigField* field = nullptr;
+		for (const auto& candidate : configSchema()) {
+			if (axis.key == candidate.key) {
+				field = &candidate;
+			}
+		}
+		if (field == nullptr) {
+			errors.push_back(where + ": unknown config key " + axis.key);
+			continue;
+		}
+		size_t dots = values.find("..");
+		if (dots != string::npos) {
+			try {
+				axis.low = stoll(values.substr(0, dots));
+				axis.high = stoll(values.substr(dots + 2));
+			}
+			catch (...) {
+				errors.push_back(where + ": '" + values + "' is not a low..high range");
+				continue;
+			}
+			if (field->number == nullptr || axis.low > axis.high) {
+				errors.push_back(where + ": " + axis.key + " needs a numeric range with low <= high");
+				continue;
+			}
+			axis.range = true;
+			axis.powerOfTwo = field->powerOfTwo;
+		}
+		else {
+			stringstream list(values);
+			string value;
+			while (getline(list, value, ',')) {
+				string trimmed(unquoteConfigValue(trimConfigText(value)));
+				if (!trimmed.empty()) {
+					axis.values.push_back(trimmed);
+				}
+			}
+			if (axis.values.empty()) {
+				errors.push_back(where + ": no values for " + axis.key);
+				continue;
+			}
+		}
+		for (const auto& existing : axes) {
+			if (existing.key == axis.key) {
+				errors.push_back(where + ": " + axis.key + " is listed twice");
+			}
+		}
+		axes.push_back(axis);
+	}
+	if (axes.empty() && errors.empty()) {
+		errors.push_back(path + ": no keys to sweep");
+	}
+	return errors.empty();
+}
+
+// Every combination of the axes' values, the last axis changing fastest.
+vector<vector<string>> sweepGrid(const vector<SweepAxis>& axes, vector<string>& errors) {
+	vector<vector<string>> points(1);
+	for (const auto& axis : axes) {
+		if (axis.range) {
+			errors.push_back(axis.key + ": ranges need random search (--samples N)");
+			return {};
+		}
+		vector<vector<string>> next;
+		for (const auto& point : points) {
+			for (const auto& value : axis.values) {
+				next.push_back(point);
+				next.back().push_back(value);
+			}
+		}
+		points = move(next);
+	}
+	return points;
+}
+
+// samples points, each axis drawn on its own: uniformly from a list, uniformly from a range, or
+// for power-of-two keys uniformly over the exponents in the range.
+vector<vector<string>> sweepRandom(const vector<SweepAxis>& axes, ll samples, ll seed) {
+	mt19937_64 rng(static_cast<ull>(seed));
+	vector<vector<string>> points;
+	for (ll i = 0; i < samples; i++) {
+		vector<string> point;
+		for (const auto& axis : axes) {
+			if (!axis.range) {
+				uniform_int_distribution<size_t> pick(0, axis.values.size() - 1);
+				point.push_back(axis.values[pick(rng)]);
+			}
+			else if (axis.powerOfTwo && axis.low > 0) {
+				int lowBit = static_cast<int>(bit_width(bit_ceil(static_cast<ull>(axis.low)))) - 1;
+				int highBit = static_cast<int>(bit_width(static_cast<ull>(axis.high))) - 1;
+				uniform_int_distribution<int> exponent(lowBit, max(lowBit, highBit));
+				point.push_back(to_string(1LL << exponent(rng)));
+			}
+			else {
+				uniform_int_distribution<ll> value(axis.low, axis.high);
+				point.push_back(to_string(value(rng)));
+			}
+		}
+		points.push_back(point);
+	}
+	return points;
+}
+
+// Runs sweep points in parallel, each in a Scheduler with its own TickClock, counter, worker pool,
+// simulated RAM and backing store, so nothing but the process pools and stats is shared.
+// Processes are created on the run's thread the way scheduler-test would: batch-process-size every
+// batch-process-freq ticks (batch-process-delay-ms is wall time and is ignored), or from the
+// arrival generator when arrival-process is set.
+class SweepRunner {
+private:
+	const SweepOptions& options;
+	const vector<SweepAxis>& axes;
+	mutex progressMutex;
+	size_t completed = 0;
+
+	SweepResult runPoint(const vector<string>& values, size_t index) {
+		SweepResult result;
+		result.values = values;
+		vector<string> overrides = options.overrides;
+		for (size_t i = 0; i < axes.size(); i++) {
+			overrides.push_back(axes[i].key + "=" + values[i]);
+		}
+		SchedulerConfig config;
+		vector<string> errors;
+		if (!readConfigFile(options.configPath, config, errors, overrides)) {
+			result.error = errors.empty() ? "invalid configuration" : errors.front();
+			return result;
+		}
+
+		volatile ll counter = 0;
+		TickClock clock(counter);
+		Scheduler scheduler(clock);
+		string store = (filesystem::temp_directory_path() / ("csopesy-sweep-" + to_string(nowNs()) + "-" + to_string(index))).string();
+		scheduler.setBackingStore(store);
+		// Keep the console's ten instructions per default-length tick, so --tick-us speeds the
+		// whole run up rather than just the clock.
+		scheduler.setInstructionTime(chrono::duration_cast<chrono::nanoseconds>(Screen::INSTRUCTION_TIME) * options.tickMicros / SweepOptions().tickMicros);
+		vector<string> messages;
+		if (!scheduler.getConfig(options.configPath, messages, overrides)) {
+			result.error = messages.empty() ? "could not initialize" : messages.front();
+			return result;
+		}
+
+		ArrivalSettings arrivals = ArrivalSettings::from(config);
+		bool openLoop = arrivals.process != "fixed";
+		ArrivalGenerator generator;
+		string error;
+		if (openLoop && !generator.start(arrivals, config.maxOverallMem, error)) {
+			scheduler.stop();
+			result.error = error;
+			return result;
+		}
+		mt19937_64 rng(static_cast<ull>(config.arrivalSeed));
+		bool archiving = scheduler.isArchivingFinished();
+		vector<shared_ptr<Screen>> processes;
+		vector<shared_ptr<Screen>> finished;
+		vector<ll> turnaround;
+		vector<Arrival> batch;
+		double busy = 0;
+
+		auto start = chrono::steady_clock::now();
+		for (ll tick = 1; tick <= options.durationTicks; tick++) {
+			this_thread::sleep_until(start + chrono::microseconds(tick * options.tickMicros));
+			clock.advance(1000000);
+			batch.clear();
+			if (openLoop) {
+				generator.due(static_cast<double>(tick), scheduler.getMinIns(), scheduler.getMaxIns(), scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc(), batch);
+			}
+			else if (tick % scheduler.getBatchProcessFrequency() == 0) {
+				uniform_int_distribution<ll> instructions(scheduler.getMinIns(), scheduler.getMaxIns());
+				uniform_int_distribution<ll> memory(scheduler.getMinMemPerProc(), scheduler.getMaxMemPerProc());
+				for (ll i = 0; i < scheduler.getBatchProcessSize(); i++) {
+					Arrival arrival;
+					arrival.tick = static_cast<double>(tick);
+					arrival.instructions = instructions(rng);
+					arrival.memory = memory(rng);
+					batch.push_back(arrival);
+				}
+			}
+			if (!batch.empty()) {
+				vector<shared_ptr<Screen>> created;
+				for (const auto& arrival : batch) {
+					ScreenState state;
+					state.processName = "p" + to_string(result.created++);
+					state.totalLine = static_cast<int>(arrival.instructions);
+					state.memory = static_cast<int>(arrival.memory);
+					state.priority = arrival.priority;
+					state.timestamp = static_cast<ll>(time(nullptr));
+					state.createdAt = nowNs();
+					created.push_back(makeScreen(state));
+				}
+				{
+					lock_guard<StatMutex> lock(scheduler.queueMutex);
+					for (const auto& sc : created) {
+						scheduler.pushQueue(sc);
+					}
+				}
+				if (!archiving) {
+					processes.insert(processes.end(), created.begin(), created.end());
+				}
+			}
+			if (archiving) {
+				finished.clear();
+				scheduler.takeFinished(finished);
+				for (const auto& sc : finished) {
+					turnaround.push_back((sc->finishedAt - sc->createdAt) / 1000);
+				}
+			}
+			busy += static_cast<double>(scheduler.getCoresUsed()) / scheduler.getNumCpu();
+			if (openLoop && generator.exhausted() && scheduler.isDrained()) {
+				result.ticks = tick;
+				break;
+			}
+			result.ticks = tick;
+		}
+		scheduler.stop();
+		for (const auto& sc : processes) {
+			if (sc->isFinished() && sc->finishedAt != 0) {
+				turnaround.push_back((sc->finishedAt - sc->createdAt) / 1000);
+			}
+		}
+		error_code ignored;
+		filesystem::remove(store + ".txt", ignored);
+		filesystem::remove(store + ".bin", ignored);
+
+		result.finished = static_cast<ll>(turnaround.size());
+		result.throughput = result.ticks > 0 ? result.finished * 1000.0 / result.ticks : 0;
+		if (!turnaround.empty()) {
+			double sum = 0;
+			for (ll value : turnaround) {
+				sum += value;
+			}
+			result.turnaroundMean = sum / turnaround.size();
+			sort(turnaround.begin(), turnaround.end());
+			size_t idx = static_cast<size_t>(ceil(0.99 * turnaround.size()));
+			result.turnaroundP99 = turnaround[min(turnaround.size() - 1, idx == 0 ? 0 : idx - 1)];
+		}
+		result.pageFaults = scheduler.getPagesIn();
+		result.pagesOut = scheduler.getPagesOut();
+		result.utilization = result.ticks > 0 ? busy * 100 / result.ticks : 0;
+		return result;
+	}
+
+public:
+	SweepRunner(const SweepOptions& options, const vector<SweepAxis>& axes) : options(options), axes(axes) {}
+
+	vector<SweepResult> run(const vector<vector<string>>& points) {
+		vector<SweepResult> results(points.size());
+		int jobs = options.jobs > 0 ? options.jobs : max(1, static_cast<int>(thread::hardware_concurrency()));
+		jobs = static_cast<int>(min<size_t>(jobs, max<size_t>(points.size(), 1)));
+		atomic<size_t> next = 0;
+		{
+			vector<jthread> workers;
+			for (int i = 0; i < jobs; i++) {
+				workers.emplace_back([&] {
+					for (size_t index = next++; index < points.size(); index = next++) {
+						results[index] = runPoint(points[index], index);
+						lock_guard<mutex> lock(progressMutex);
+						completed++;
+						cerr << "Run " << completed << "/" << points.size() << " done" << (results[index].error.empty() ? "" : ": " + results[index].error) << endl;
+					}
+				});
+			}
+		}
+		return results;
+	}
+};
+
+string sweepJsonText(const string& text) {
+	string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+// One quoted CSV field, so values with commas or quotes (trace paths, error text) stay in their column.
+string sweepCsvText(const string& text) {
+	string escaped = "\"";
+	for (char c : text) {
+		escaped += c;
+		if (c == '"') {
+			escaped += '"';
+		}
+	}
+	return escaped + "\"";
+}
+
+// JSON when path ends in .json, CSV otherwise. One row per run, in run order.
+bool writeSweepResults(const string& path, const vector<SweepAxis>& axes, const vector<SweepResult>& results) {
+	ofstream out(path);
+	if (!out.is_open()) {
+		return false;
+	}
+	out << fixed << setprecision(3);
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	if (json) {
+		out << "[" << endl;
+		for (size_t run = 0; run < results.size(); run++) {
+			const SweepResult& result = results[run];
+			out << "  {\"run\": " << run;
+			for (size_t i = 0; i < axes.size(); i++) {
+				out << ", \"" << axes[i].key << "\": \"" << sweepJsonText(result.values[i]) << "\"";
+			}
+			if (!result.error.empty()) {
+				out << ", \"error\": \"" << sweepJsonText(result.error) << "\"";
+			}
+			else {
+				out << ", \"ticks\": " << result.ticks << ", \"processes_created\": " << result.created << ", \"processes_finished\": " << result.finished
+					<< ", \"throughput_per_1000_ticks\": " << result.throughput << ", \"turnaround_mean_us\": " << result.turnaroundMean
+					<< ", \"turnaround_p99_us\": " << result.turnaroundP99 << ", \"page_faults\": " << result.pageFaults
+					<< ", \"pages_out\": " << result.pagesOut << ", \"utilization_percent\": " << result.utilization;
+			}
+			out << "}" << (run + 1 < results.size() ? "," : "") << endl;
+		}
+		out << "]" << endl;
+		return true;
+	}
+	out << "run";
+	for (const auto& axis : axes) {
+		out << "," << axis.key;
+	}
+	out << ",ticks,processes_created,processes_finished,throughput_per_1000_ticks,turnaround_mean_us,turnaround_p99_us,page_faults,pages_out,utilization_percent,error" << endl;
+	for (size_t run = 0; run < results.size(); run++) {
+		const SweepResult& result = results[run];
+		out << run;
+		for (const auto& value : result.values) {
+			out << "," << sweepCsvText(value);
+		}
+		out << "," << result.ticks << "," << result.created << "," << result.finished << "," << result.throughput << "," << result.turnaroundMean
+			<< "," << result.turnaroundP99 << "," << result.pageFaults << "," << result.pagesOut << "," << result.utilization << "," << sweepCsvText(result.error) << endl;
+	}
+	return true;
+}
+
+// --sweep: expands the spec into points, runs them and prints one line per run.
+int runSweep(const SweepOptions& options) {
+	vector<SweepAxis> axes;
+	vector<string> errors;
+	vector<vector<string>> points;
+	if (parseSweepSpec(options.specPath, axes, errors)) {
+		points = options.samples > 0 ? sweepRandom(axes, options.samples, options.seed) : sweepGrid(axes, errors);
+	}
+	if (!errors.empty()) {
+		for (const auto& error : errors) {
+			cerr << "Sweep error: " << error << endl;
+		}
+		return 2;
+	}
+	cerr << "Sweeping " << points.size() << " configurations for " << options.durationTicks << " ticks each" << endl;
+	auto start = chrono::steady_clock::now();
+	SweepRunner runner(options, axes);
+	vector<SweepResult> results = runner.run(points);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	cout << fixed << setprecision(2);
+	for (size_t run = 0; run < results.size(); run++) {
+		const SweepResult& result = results[run];
+		cout << "Run " << run << ":";
+		for (size_t i = 0; i < axes.size(); i++) {
+			cout << " " << axes[i].key << "=" << result.values[i];
+		}
+		if (!result.error.empty()) {
+			cout << "  error: " << result.error << endl;
+			continue;
+		}
+		cout << "  throughput " << result.throughput << "/1000 ticks, turnaround (us) mean " << result.turnaroundMean << " p99 " << result.turnaroundP99
+			<< ", page faults " << result.pageFaults << ", utilization " << result.utilization << "%" << endl;
+	}
+	cout << results.size() << " runs in " << seconds << " s" << endl;
+	if (!options.outputPath.empty() && !writeSweepResults(options.outputPath, axes, results)) {
+		cerr << "Could not open " << options.outputPath << " for writing." << endl;
+		return 1;
+	}
+	return 0;
+}
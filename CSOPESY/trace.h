@@ -0,0 +1,250 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+enum TraceEventType : unsigned char {
+	TRACE_DISPATCH,
+	TRACE_QUANTUM_END,
+	TRACE_PREEMPT,
+	TRACE_FINISH,
+	TRACE_EVICT,
+	TRACE_PAGE_IN
+};
+
+const char* traceEventName(TraceEventType type) {
+	switch (type) {
+	case TRACE_DISPATCH: return "dispatch";
+	case TRACE_QUANTUM_END: return "quantum-end";
+	case TRACE_PREEMPT: return "preempt";
+	case TRACE_FINISH: return "finish";
+	case TRACE_EVICT: return "evict";
+	case TRACE_PAGE_IN: return "page-in";
+	}
+	return "unknown";
+}
+
+struct TraceEvent {
+	ll ts;
+	ll dur;
+	int core;
+	TraceEventType type;
+	char process[19];
+};
+
+// Single-producer/single-consumer ring owned by one thread. The owner never blocks:
+// when the drainer falls behind, new events are dropped and counted instead.
+class TraceBuffer {
+public:
+	static const size_t CAPACITY = 1 << 14;
+
+	bool push(const TraceEvent& event) {
+		size_t head = writeIdx.load(memory_order_relaxed);
+		if (head - readIdx.load(memory_order_acquire) >= CAPACITY) {
+			dropped.fetch_add(1, memory_order_relaxed);
+			return false;
+		}
+		events[head & (CAPACITY - 1)] = event;
+		writeIdx.store(head + 1, memory_order_release);
+		return true;
+	}
+
+	void drainInto(vector<TraceEvent>& out) {
+		size_t tail = readIdx.load(memory_order_relaxed);
+		size_t head = writeIdx.load(memory_order_acquire);
+		for (; tail != head; tail++) {
+			out.push_back(events[tail & (CAPACITY - 1)]);
+		}
+		readIdx.store(tail, memory_order_release);
+	}
+
+	ll takeDropped() {
+		return dropped.exchange(0, memory_order_relaxed);
+	}
+
+private:
+	TraceEvent events[CAPACITY];
+	atomic<size_t> writeIdx = 0;
+	atomic<size_t> readIdx = 0;
+	atomic<ll> dropped = 0;
+};
+
+class Tracer {
+private:
+	atomic<bool> enabled = false;
+	mutex tracerMutex;
+	vector<unique_ptr<TraceBuffer>> buffers;
+	vector<TraceEvent> collected;
+	ll droppedEvents = 0;
+	ll startedAt = 0;
+	thread drainer;
+	atomic<bool> draining = false;
+
+	TraceBuffer& local() {
+		thread_local TraceBuffer* mine = nullptr;
+		if (mine == nullptr) {
+			auto buffer = make_unique<TraceBuffer>();
+			mine = buffer.get();
+			lock_guard<mutex> lock(tracerMutex);
+			buffers.push_back(move(buffer));
+		}
+		return *mine;
+	}
+
+	void drainAll() {
+		lock_guard<mutex> lock(tracerMutex);
+		for (auto& buffer : buffers) {
+			buffer->drainInto(collected);
+			droppedEvents += buffer->takeDropped();
+		}
+	}
+
+	void drainLoop() {
+		while (draining) {
+			this_thread::sleep_for(chrono::milliseconds(50));
+			drainAll();
+		}
+	}
+
+	static string escapeJson(const string& text) {
+		string escaped;
+		for (char c : text) {
+			if (c == '"' || c == '\\') {
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+		return escaped;
+	}
+
+public:
+	static Tracer& instance() {
+		static Tracer tracer;
+		return tracer;
+	}
+
+	// Set by each core loop so that events raised from shared helpers are attributed to the right core.
+	static int& currentCore() {
+		thread_local int core = -1;
+		return core;
+	}
+
+	~Tracer() {
+		draining = false;
+		if (drainer.joinable()) {
+			drainer.join();
+		}
+	}
+
+	bool isEnabled() {
+		return enabled.load(memory_order_relaxed);
+	}
+
+	ll clock() {
+		return isEnabled() ? nowNs() : 0;
+	}
+
+	void record(TraceEventType type, const string& process, ll start, ll end) {
+		TraceEvent event;
+		event.ts = start;
+		event.dur = end - start;
+		event.core = currentCore();
+		event.type = type;
+		strncpy(event.process, process.c_str(), sizeof(event.process) - 1);
+		event.process[sizeof(event.process) - 1] = '\0';
+		local().push(event);
+	}
+
+	void start() {
+		if (enabled) {
+			return;
+		}
+		drainAll();
+		{
+			lock_guard<mutex> lock(tracerMutex);
+			collected.clear();
+			droppedEvents = 0;
+			startedAt = nowNs();
+		}
+		draining = true;
+		drainer = thread(&Tracer::drainLoop, this);
+		enabled = true;
+	}
+
+	// Stops recording and writes everything captured since start() as Chrome trace JSON,
+	// which chrome://tracing and ui.perfetto.dev both load directly.
+	bool stop(const string& outputFileName, ll& eventCount, ll& dropped) {
+		enabled = false;
+		draining = false;
+		if (drainer.joinable()) {
+			drainer.join();
+		}
+		drainAll();
+
+		lock_guard<mutex> lock(tracerMutex);
+		sort(collected.begin(), collected.end(), [](const TraceEvent& a, const TraceEvent& b) {
+			return a.ts < b.ts;
+		});
+		eventCount = collected.size();
+		dropped = droppedEvents;
+
+		ofstream outFile(outputFileName);
+		if (!outFile.is_open()) {
+			return false;
+		}
+		set<int> cores;
+		outFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+		outFile << fixed << setprecision(3);
+		bool first = true;
+		for (const auto& event : collected) {
+			cores.insert(event.core);
+			double ts = (event.ts - startedAt) / 1000.0;
+			string name = escapeJson(event.process);
+			outFile << (first ? "" : ",\n");
+			first = false;
+			switch (event.type) {
+			case TRACE_DISPATCH:
+				outFile << "{\"name\":\"" << name << "\",\"ph\":\"B\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << event.core << "}";
+				break;
+			case TRACE_QUANTUM_END:
+			case TRACE_PREEMPT:
+			case TRACE_FINISH:
+				outFile << "{\"ph\":\"E\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << event.core
+					<< ",\"args\":{\"reason\":\"" << traceEventName(event.type) << "\"}}";
+				break;
+			case TRACE_EVICT:
+				outFile << "{\"name\":\"evict " << name << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << event.core << "}";
+				break;
+			case TRACE_PAGE_IN:
+				outFile << "{\"name\":\"page-in " << name << "\",\"ph\":\"X\",\"ts\":" << ts << ",\"dur\":" << event.dur / 1000.0
+					<< ",\"pid\":1,\"tid\":" << event.core << "}";
+				break;
+			}
+		}
+		for (int core : cores) {
+			outFile << (first ? "" : ",\n");
+			first = false;
+			outFile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << core
+				<< ",\"args\":{\"name\":\"" << (core < 0 ? string("scheduler") : "core " + to_string(core)) << "\"}}";
+		}
+		outFile << endl << "]}" << endl;
+		outFile.close();
+		collected.clear();
+		return true;
+	}
+};
+
+void traceEvent(TraceEventType type, const shared_ptr<Screen>& screen) {
+	Tracer& tracer = Tracer::instance();
+	if (tracer.isEnabled()) {
+		ll now = nowNs();
+		tracer.record(type, screen->getProcessName(), now, now);
+	}
+}
+
+void traceSpan(TraceEventType type, const shared_ptr<Screen>& screen, ll start) {
+	Tracer& tracer = Tracer::instance();
+	if (tracer.isEnabled() && start != 0) {
+		tracer.record(type, screen->getProcessName(), start, nowNs());
+	}
+}
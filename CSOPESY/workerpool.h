@@ -0,0 +1,430 @@
+#pragma once
+
+using namespace std;
+typedef long long ll;
+
+extern volatile ll mainCtr;
+
+class WorkerPool;
+class TickClock;
+
+// Coroutine body of one simulated core. It starts suspended; WorkerPool::spawn queues it on the
+// pool's threads and waits for it in retireLast().
+struct CoreTask {
+	struct promise_type {
+		WorkerPool* pool = nullptr;
+		int id = -1;
+
+		CoreTask get_return_object() {
+			return CoreTask{ coroutine_handle<promise_type>::from_promise(*this) };
+		}
+		suspend_always initial_suspend() noexcept {
+			return {};
+		}
+		struct FinalAwaiter {
+			bool await_ready() noexcept {
+				return false;
+			}
+			void await_suspend(coroutine_handle<promise_type> handle) noexcept;
+			void await_resume() noexcept {}
+		};
+		FinalAwaiter final_suspend() noexcept {
+			return {};
+		}
+		void return_void() {}
+		void unhandled_exception() {
+			terminate();
+		}
+	};
+
+	coroutine_handle<promise_type> handle;
+};
+
+// A suspended core: what to resume and which core it is, so the thread resuming it can set
+// Tracer::currentCore() for the helpers that attribute work to a core.
+struct ParkedCore {
+	coroutine_handle<> handle;
+	int id;
+};
+
+// Runs core coroutines on a fixed set of OS threads, independent of how many cores there are.
+// A core gives its thread back whenever it waits: for the next tick (nextTick), for a process to
+// be queued (waitForWork), for an instruction's run time (sleepFor) or for stop. So a few threads
+// can drive hundreds of cores.
+class WorkerPool {
+private:
+	struct Core {
+		coroutine_handle<CoreTask::promise_type> handle;
+		stop_source stop;
+		bool done = false;
+	};
+
+	TickClock& clock;
+	// Guards every member below, including the two parked lists.
+	mutex poolMutex;
+	condition_variable_any runnableReady;
+	condition_variable coreFinished;
+	deque<ParkedCore> runnable;
+	vector<unique_ptr<Core>> cores;
+	vector<jthread> threads;
+	// Waiting for the clock to move past the value each one last saw.
+	vector<ParkedCore> tickWaiters;
+	// Waiting for work; woken one at a time by notifyWork().
+	deque<ParkedCore> workWaiters;
+	// Sleeping until a point in wall-clock time, e.g. for the length of an instruction.
+	multimap<chrono::steady_clock::time_point, ParkedCore> sleepers;
+	// Bumped when a sleeper is added, so a thread waiting for a later deadline looks again.
+	ll sleepersChanged = 0;
+	ll resumes = 0;
+
+	// The clock's current tick; defined after TickClock.
+	ll now() const;
+
+	void schedule(const ParkedCore& core) {
+		runnable.push_back(core);
+		runnableReady.notify_one();
+	}
+
+	void wakeDueSleepers() {
+		auto now = chrono::steady_clock::now();
+		while (!sleepers.empty() && sleepers.begin()->first <= now) {
+			runnable.push_back(sleepers.begin()->second);
+			sleepers.erase(sleepers.begin());
+		}
+	}
+
+	void threadLoop(stop_token token) {
+		while (true) {
+			ParkedCore next;
+			{
+				unique_lock<mutex> lock(poolMutex);
+				while (true) {
+					if (token.stop_requested()) {
+						return;
+					}
+					wakeDueSleepers();
+					if (!runnable.empty()) {
+						break;
+					}
+					ll seen = sleepersChanged;
+					auto ready = [this, seen] { return !runnable.empty() || sleepersChanged != seen; };
+					if (sleepers.empty()) {
+						runnableReady.wait(lock, token, ready);
+					}
+					else {
+						runnableReady.wait_until(lock, token, sleepers.begin()->first, ready);
+					}
+				}
+				next = runnable.front();
+				runnable.pop_front();
+				resumes++;
+			}
+			Tracer::currentCore() = next.id;
+			next.handle.resume();
+		}
+	}
+
+	// Moves a parked core back to the run queue if it is waiting on anything. Caller holds poolMutex.
+	void wakeParked(int id) {
+		for (auto it = tickWaiters.begin(); it != tickWaiters.end(); ++it) {
+			if (it->id == id) {
+				schedule(*it);
+				tickWaiters.erase(it);
+				return;
+			}
+		}
+		for (auto it = workWaiters.begin(); it != workWaiters.end(); ++it) {
+			if (it->id == id) {
+				schedule(*it);
+				workWaiters.erase(it);
+				return;
+			}
+		}
+		for (auto it = sleepers.begin(); it != sleepers.end(); ++it) {
+			if (it->second.id == id) {
+				schedule(it->second);
+				sleepers.erase(it);
+				return;
+			}
+		}
+	}
+
+public:
+	struct TickAwaiter {
+		WorkerPool* pool;
+		ll& seen;
+		stop_token token;
+
+		bool await_ready() {
+			return token.stop_requested() || pool->now() != seen;
+		}
+		bool await_suspend(coroutine_handle<CoreTask::promise_type> handle) {
+			lock_guard<mutex> lock(pool->poolMutex);
+			if (token.stop_requested() || pool->now() != seen) {
+				return false;
+			}
+			pool->tickWaiters.push_back({ handle, handle.promise().id });
+			return true;
+		}
+		// True once the tick has moved on; false when the core was asked to stop.
+		bool await_resume() {
+			seen = pool->now();
+			return !token.stop_requested();
+		}
+	};
+
+	struct SleepAwaiter {
+		WorkerPool* pool;
+		chrono::steady_clock::time_point until;
+		stop_token token;
+
+		bool await_ready() {
+			return token.stop_requested() || chrono::steady_clock::now() >= until;
+		}
+		bool await_suspend(coroutine_handle<CoreTask::promise_type> handle) {
+			lock_guard<mutex> lock(pool->poolMutex);
+			if (token.stop_requested()) {
+				return false;
+			}
+			pool->sleepers.emplace(until, ParkedCore{ handle, handle.promise().id });
+			pool->sleepersChanged++;
+			pool->runnableReady.notify_one();
+			return true;
+		}
+		// False when the core was asked to stop before the time was up.
+		bool await_resume() {
+			return !token.stop_requested();
+		}
+	};
+
+	template <class Lock>
+	struct WorkAwaiter {
+		WorkerPool* pool;
+		Lock& lock;
+		stop_token token;
+
+		bool await_ready() {
+			return token.stop_requested();
+		}
+		// Registers before the caller's lock is dropped, so a producer that queues work under that
+		// lock always finds this core parked. The lock is released without touching it again, as
+		// another thread may resume the coroutine as soon as the mutex is free.
+		bool await_suspend(coroutine_handle<CoreTask::promise_type> handle) {
+			{
+				lock_guard<mutex> poolLock(pool->poolMutex);
+				if (token.stop_requested()) {
+					return false;
+				}
+				pool->workWaiters.push_back({ handle, handle.promise().id });
+			}
+			auto* held = lock.release();
+			held->unlock();
+			return true;
+		}
+		bool await_resume() {
+			return !token.stop_requested();
+		}
+	};
+
+	// Cores follow the console's clock unless given their own.
+	WorkerPool();
+	explicit WorkerPool(TickClock& clock);
+	~WorkerPool();
+
+	// Starts the OS threads that resume cores; a no-op if they are already running.
+	void startThreads(int count) {
+		lock_guard<mutex> lock(poolMutex);
+		if (!threads.empty()) {
+			return;
+		}
+		for (int i = 0; i < max(count, 1); i++) {
+			threads.emplace_back([this](stop_token token) { threadLoop(token); });
+		}
+	}
+
+	// Only once every core has been retired.
+	void stopThreads() {
+		vector<jthread> stopping;
+		{
+			lock_guard<mutex> lock(poolMutex);
+			stopping.swap(threads);
+		}
+		stopping.clear();
+	}
+
+	int threadCount() {
+		lock_guard<mutex> lock(poolMutex);
+		return static_cast<int>(threads.size());
+	}
+
+	ll getResumes() {
+		lock_guard<mutex> lock(poolMutex);
+		return resumes;
+	}
+
+	int size() {
+		lock_guard<mutex> lock(poolMutex);
+		return static_cast<int>(cores.size());
+	}
+
+	bool empty() {
+		return size() == 0;
+	}
+
+	// body(token, id) is a coroutine that returns when the token is stopped.
+	void spawn(function<CoreTask(stop_token, int)> body) {
+		auto core = make_unique<Core>();
+		lock_guard<mutex> lock(poolMutex);
+		int id = static_cast<int>(cores.size());
+		core->handle = body(core->stop.get_token(), id).handle;
+		core->handle.promise().pool = this;
+		core->handle.promise().id = id;
+		schedule({ core->handle, id });
+		cores.push_back(move(core));
+	}
+
+	// Stops the most recently spawned core, waits for its coroutine to finish and frees it.
+	void retireLast() {
+		unique_lock<mutex> lock(poolMutex);
+		Core& core = *cores.back();
+		core.stop.request_stop();
+		wakeParked(static_cast<int>(cores.size()) - 1);
+		coreFinished.wait(lock, [&core] { return core.done; });
+		core.handle.destroy();
+		cores.pop_back();
+	}
+
+	void requestStopAll() {
+		lock_guard<mutex> lock(poolMutex);
+		for (size_t id = 0; id < cores.size(); id++) {
+			cores[id]->stop.request_stop();
+			wakeParked(static_cast<int>(id));
+		}
+	}
+
+	// Called by the clock on every tick; resumes every core waiting for one.
+	void tick() {
+		lock_guard<mutex> lock(poolMutex);
+		for (const auto& core : tickWaiters) {
+			schedule(core);
+		}
+		tickWaiters.clear();
+	}
+
+	TickAwaiter nextTick(ll& seen, stop_token token) {
+		return TickAwaiter{ this, seen, token };
+	}
+
+	SleepAwaiter sleepFor(chrono::nanoseconds duration, stop_token token) {
+		return SleepAwaiter{ this, chrono::steady_clock::now() + duration, token };
+	}
+
+	// co_await with lock held on the mutex that guards the work; returns false on stop.
+	template <class Lock>
+	WorkAwaiter<Lock> waitForWork(Lock& lock, stop_token token) {
+		return WorkAwaiter<Lock>{ this, lock, token };
+	}
+
+	void notifyWork() {
+		lock_guard<mutex> lock(poolMutex);
+		if (!workWaiters.empty()) {
+			schedule(workWaiters.front());
+			workWaiters.pop_front();
+		}
+	}
+
+	void notifyAllWork() {
+		lock_guard<mutex> lock(poolMutex);
+		for (const auto& core : workWaiters) {
+			schedule(core);
+		}
+		workWaiters.clear();
+	}
+
+	void finished(int id) {
+		lock_guard<mutex> lock(poolMutex);
+		cores[id]->done = true;
+		coreFinished.notify_all();
+	}
+};
+
+void CoreTask::promise_type::FinalAwaiter::await_suspend(coroutine_handle<promise_type> handle) noexcept {
+	handle.promise().pool->finished(handle.promise().id);
+}
+
+// The simulated clock. Whoever drives its counter advances it through here. Threads that act once
+// per tick park in waitPast(); core coroutines are resumed through the pools that registered. The
+// console's clock counts in mainCtr; a sweep gives every simulator its own clock and counter.
+class TickClock {
+private:
+	volatile ll& counter;
+	mutex clockMutex;
+	condition_variable_any ticked;
+	vector<WorkerPool*> pools;
+
+public:
+	explicit TickClock(volatile ll& counter) : counter(counter) {}
+
+	static TickClock& instance() {
+		static TickClock clock(mainCtr);
+		return clock;
+	}
+
+	ll now() const {
+		return counter;
+	}
+
+	void addPool(WorkerPool* pool) {
+		lock_guard<mutex> lock(clockMutex);
+		pools.push_back(pool);
+	}
+
+	void removePool(WorkerPool* pool) {
+		lock_guard<mutex> lock(clockMutex);
+		pools.erase(remove(pools.begin(), pools.end(), pool), pools.end());
+	}
+
+	void advance(ll wrap) {
+		lock_guard<mutex> lock(clockMutex);
+		counter = (counter + 1) % wrap;
+		for (WorkerPool* pool : pools) {
+			pool->tick();
+		}
+		ticked.notify_all();
+	}
+
+	// Returns once the counter differs from seen, with seen updated to it, or false if stop was requested first.
+	bool waitPast(ll& seen, stop_token token) {
+		unique_lock<mutex> lock(clockMutex);
+		if (!ticked.wait(lock, token, [this, &seen] { return counter != seen; })) {
+			return false;
+		}
+		seen = counter;
+		return true;
+	}
+
+	void waitPast(ll& seen) {
+		unique_lock<mutex> lock(clockMutex);
+		ticked.wait(lock, [this, &seen] { return counter != seen; });
+		seen = counter;
+	}
+};
+
+WorkerPool::WorkerPool() : WorkerPool(TickClock::instance()) {}
+
+WorkerPool::WorkerPool(TickClock& clock) : clock(clock) {
+	clock.addPool(this);
+}
+
+ll WorkerPool::now() const {
+	return clock.now();
+}
+
+WorkerPool::~WorkerPool() {
+	clock.removePool(this);
+	requestStopAll();
+	while (!empty()) {
+		retireLast();
+	}
+	stopThreads();
+}